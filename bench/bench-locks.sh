@@ -0,0 +1,71 @@
+#!/bin/sh
+
+# Compares the agent-internal locks of the Shadow VM agent (spin-then-futex)
+# with JVMTI raw monitors under the TaggingTest workload.
+#
+# Requires a finished "ant build". Both agent variants are built with lock
+# statistics enabled, the statistics are printed by the agent at VM death.
+#
+# Usage: bench-locks.sh [runs]
+
+RUNS=${1:-5}
+
+BASE_DIR=`cd \`dirname $0\`/.. && pwd`
+LIB_DIR=${BASE_DIR}/output/lib
+APP_DIR=${BASE_DIR}/output/build/analysis
+AGENT_SRC=${BASE_DIR}/src-shvm-agent
+
+if [ "`uname`" = "Darwin" ]; then
+	LIB_SUFFIX=jnilib
+else
+	LIB_SUFFIX=so
+fi
+
+BENCH_DIR=`mktemp -d`
+trap 'rm -rf ${BENCH_DIR}' EXIT
+
+# build agent variant - $1 name, $2 extra make options
+build_agent() {
+	make -s -C ${AGENT_SRC} WHOLE=1 LOCK_STATS=1 $2 \
+		LIBRARY_BASE=dislreagent-$1 || exit 1
+	mv ${AGENT_SRC}/libdislreagent-$1.${LIB_SUFFIX} ${BENCH_DIR}/
+}
+
+# single run of the workload - $1 agent variant name
+run_workload() {
+	java -Ddisl.exclusionList=${BASE_DIR}/excl.lst \
+		-Ddislserver.disablebypass=true \
+		-cp ${LIB_DIR}/disl-analysis.jar:${LIB_DIR}/disl-server.jar \
+		ch.usi.dag.dislserver.DiSLServer &
+	SERVER_PID=$!
+
+	java -cp ${LIB_DIR}/disl-analysis.jar:${LIB_DIR}/dislre-server.jar \
+		ch.usi.dag.dislreserver.DiSLREServer > /dev/null &
+	RE_SERVER_PID=$!
+
+	# wait for server startup
+	sleep 3
+
+	START=`date +%s%N`
+
+	java -agentpath:${LIB_DIR}/libdislagent.${LIB_SUFFIX} \
+		-agentpath:${BENCH_DIR}/libdislreagent-$1.${LIB_SUFFIX} \
+		-Xbootclasspath/a:${LIB_DIR}/disl-analysis.jar:${LIB_DIR}/dislre-dispatch.jar:${LIB_DIR}/disl-bypass.jar \
+		-cp ${APP_DIR} test.TaggingTest
+
+	END=`date +%s%N`
+
+	wait ${RE_SERVER_PID}
+	kill ${SERVER_PID} 2> /dev/null
+	wait ${SERVER_PID} 2> /dev/null
+
+	echo "$1: `expr \( ${END} - ${START} \) / 1000000` ms"
+}
+
+build_agent futex ""
+build_agent rawmonitor "RAW_MONITOR_LOCKS=1"
+
+for i in `seq ${RUNS}`; do
+	run_workload futex
+	run_workload rawmonitor
+done
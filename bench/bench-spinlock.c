@@ -0,0 +1,94 @@
+// Micro benchmark of the agent-internal lock (shared/spinlock.c) against a
+// pthread mutex, timing enter/exit around a counter increment.
+//
+// The raw monitor variant of the lock needs a running JVM, so it is not
+// measured here - bench-locks.sh compares both agent builds end-to-end
+// under the TaggingTest workload. The pthread mutex only serves as a
+// baseline and is not a stand-in for a raw monitor, which goes through the
+// VM on every enter.
+//
+// Built and run by "make bench" in src-shvm-agent.
+//
+// Usage: bench-spinlock [iterations per thread]
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src-shvm-agent/shared/spinlock.h"
+
+#define MAX_THREADS 8
+
+static spin_lock spin;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static long iterations = 5000000;
+static volatile long counter = 0;
+
+static void * _spin_loop(void * arg) {
+  for (long i = 0; i < iterations; ++i) {
+    sl_enter(&spin);
+    ++counter;
+    sl_exit(&spin);
+  }
+
+  return NULL;
+}
+
+static void * _mutex_loop(void * arg) {
+  for (long i = 0; i < iterations; ++i) {
+    pthread_mutex_lock(&mutex);
+    ++counter;
+    pthread_mutex_unlock(&mutex);
+  }
+
+  return NULL;
+}
+
+static double _now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// returns the time per enter/exit pair in ns
+static double _run(void * (* loop)(void *), int thread_count) {
+  pthread_t threads[MAX_THREADS];
+  counter = 0;
+
+  double start = _now_ns();
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_create(&threads[i], NULL, loop, NULL);
+  }
+
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  double elapsed = _now_ns() - start;
+  if (counter != iterations * thread_count) {
+    fprintf(stderr, "lost updates: %ld of %ld\n", counter,
+        iterations * thread_count);
+    exit(EXIT_FAILURE);
+  }
+
+  return elapsed / (iterations * thread_count);
+}
+
+int main(int argc, char * argv[]) {
+  if (argc > 1) {
+    iterations = atol(argv[1]);
+  }
+
+  sl_create(&spin, NULL, "bench");
+
+  printf("threads   pthread mutex   spin-then-futex\n");
+  for (int thread_count = 1; thread_count <= MAX_THREADS; thread_count *= 2) {
+    double mutex_ns = _run(_mutex_loop, thread_count);
+    double spin_ns = _run(_spin_loop, thread_count);
+    printf("%-9d %10.1f ns   %12.1f ns\n", thread_count, mutex_ns, spin_ns);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -10,45 +10,46 @@ import java.util.Iterator;
 import java.util.Map.Entry;
 import java.util.zip.GZIPOutputStream;
 
-import ch.usi.dag.dislreserver.remoteanalysis.RemoteAnalysis;
+import ch.usi.dag.dislreserver.remoteanalysis.ThreadConfinedAnalysis;
 import ch.usi.dag.dislreserver.shadow.ShadowClass;
 import ch.usi.dag.dislreserver.shadow.ShadowObject;
 import ch.usi.dag.dislreserver.shadow.ShadowObjectTable;
 import ch.usi.dag.dislreserver.shadow.ShadowString;
 
-public class ImmutabilityAnalysis extends RemoteAnalysis {
+// Each application thread gets its own instance of the analysis, holding
+// the objects under construction in that thread. Only the primary instance
+// dumps the profile.
+public class ImmutabilityAnalysis
+extends ThreadConfinedAnalysis<ImmutabilityAnalysis> {
 
     private final String dumpFile = System.getProperty(getClass().getPackage()
             .getName() + ".Profile", "profile.tsv.gz");
 
-    private final PrintStream out;
+    // opened by the primary instance on first use
+    private PrintStream out;
 
     // keeps track of all allocated objects for particular thread
-    private static ThreadLocal<Deque<ShadowObject>> objectsUnderConstruction = new ThreadLocal<Deque<ShadowObject>>() {
-    	@Override
-    	protected Deque<ShadowObject> initialValue() {
-    		
-    		return new ArrayDeque<ShadowObject>();
-    	}
-    };
-    
-    public ImmutabilityAnalysis() {
-        PrintStream tmp = null;
-
-        try {
-            tmp = new PrintStream(new GZIPOutputStream(
-                new BufferedOutputStream(new FileOutputStream(dumpFile)))
-            );
-        } catch(IOException e) {
-            e.printStackTrace();
+    private final Deque<ShadowObject> objectsUnderConstruction =
+            new ArrayDeque<ShadowObject>();
+
+    private PrintStream getOut() {
+
+        if (out == null) {
+            try {
+                out = new PrintStream(new GZIPOutputStream(
+                    new BufferedOutputStream(new FileOutputStream(dumpFile)))
+                );
+            } catch(IOException e) {
+                e.printStackTrace();
+            }
         }
 
-        out = tmp;
+        return out;
     }
 
     private boolean isObjectUnderConstruction(ShadowObject object) {
 		
-        for(Object ouc : objectsUnderConstruction.get()) {
+        for(Object ouc : objectsUnderConstruction) {
             if(ouc == object) {
                 return true;
             }
@@ -57,13 +58,13 @@ public class ImmutabilityAnalysis extends RemoteAnalysis {
         return false;
 	}
 
-	public static void constructorStart(ShadowObject forObj) {
-		objectsUnderConstruction.get().push(forObj);
+	public void constructorStart(ShadowObject forObj) {
+		objectsUnderConstruction.push(forObj);
 	}
 
-	public static void constructorEnd() {
+	public void constructorEnd() {
 	    
-		ShadowObject obj = objectsUnderConstruction.get().pollFirst();
+		ShadowObject obj = objectsUnderConstruction.pollFirst();
 		
 		// sanity checking
 		if(obj == null) {
@@ -108,12 +109,18 @@ public class ImmutabilityAnalysis extends RemoteAnalysis {
 			
 			ImmutabilityShadowObjectState isos = issh.getObjectState();
 			
-			if(isos != null) {
+			if(isos != null && getOut() != null) {
 				isos.dump(out);
 			}
         }
 	}
 	
+	@Override
+	public void merge(ImmutabilityAnalysis other) {
+		// the object states are kept in the shadow objects, objects still
+		// under construction when the thread ended are not tracked further
+	}
+
 	@Override
 	public void objectFree(ShadowObject so) {
 	    
@@ -132,7 +139,10 @@ public class ImmutabilityAnalysis extends RemoteAnalysis {
         	dumpShadowObjectState(issh);
         }
 
-        out.close();
+        // the profile is written even if no object state was dumped
+        if (getOut() != null) {
+            out.close();
+        }
 	}
 
 }
@@ -1,23 +1,35 @@
 package analysis;
 
-import ch.usi.dag.dislreserver.remoteanalysis.RemoteAnalysis;
+import ch.usi.dag.dislreserver.remoteanalysis.Batch;
+import ch.usi.dag.dislreserver.remoteanalysis.ThreadConfinedAnalysis;
 import ch.usi.dag.dislreserver.shadow.ShadowObject;
 
 
-public class Remote extends RemoteAnalysis {
+public class Remote extends ThreadConfinedAnalysis <Remote> {
 
     long addCount = 0;
 
     long removeCount = 0;
 
 
-    public synchronized void add (final ShadowObject obj) {
-        addCount++;
+    // objects are received in batches, as raw net references
+    // each ordering id has its own instance - no synchronization needed
+    @Batch
+    public void add (final long [] netRefs, final int count) {
+        addCount += count;
     }
 
 
-    public synchronized void remove (final ShadowObject obj) {
-        removeCount++;
+    @Batch
+    public void remove (final long [] netRefs, final int count) {
+        removeCount += count;
+    }
+
+
+    @Override
+    public void merge (final Remote other) {
+        addCount += other.addCount;
+        removeCount += other.removeCount;
     }
 
 
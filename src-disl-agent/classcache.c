@@ -0,0 +1,675 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jvmti.h>
+
+#include "common.h"
+#include "classcache.h"
+
+
+#ifndef MINGW
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "threads.h"
+
+
+/**
+ * Names of the cache files in the cache directory. The index file is
+ * memory mapped and contains the cache header followed by a hash table of
+ * cache entries. The blobs file contains the original and the instrumented
+ * class bytes referred to by the entries.
+ */
+#define CACHE_INDEX_FILE "index"
+#define CACHE_BLOBS_FILE "blobs"
+
+#define CACHE_MAGIC 0x4453434c
+#define CACHE_VERSION 1
+
+#define CACHE_CAPACITY_MIN 1024
+#define CACHE_CAPACITY_MAX (1 << 24)
+
+#define FINGERPRINT_SIZE_MAX 64
+
+/**
+ * Maximal number of entries with the same key checked by a lookup. Keys
+ * only collide if the class hashes do.
+ */
+#define LOOKUP_CANDIDATES_MAX 4
+
+
+struct cache_header {
+	uint32_t magic;
+	uint32_t version;
+
+	/** Number of entries in the hash table, a power of two. */
+	uint32_t capacity;
+
+	/** Number of used entries. */
+	uint32_t count;
+
+	/** Number of valid bytes in the blobs file. */
+	uint64_t blobs_size;
+
+	/**
+	 * Fingerprint of the instrumentation used by the server. The cache
+	 * is cleared when the server instrumentation changes.
+	 */
+	uint32_t fingerprint_size;
+
+	/**
+	 * Incremented whenever the cache is cleared. The blobs of entries
+	 * of the same generation never change.
+	 */
+	uint32_t generation;
+
+	uint8_t fingerprint [FINGERPRINT_SIZE_MAX];
+};
+
+
+struct cache_entry {
+	/** Hash of the original class bytes and code flags, zero if unused. */
+	uint64_t hash;
+
+	/**
+	 * Offset of the original class bytes in the blobs file. The original
+	 * class bytes are followed by the instrumented class bytes.
+	 */
+	uint64_t offset;
+
+	jint code_flags;
+	uint32_t original_size;
+
+	/** Size of the instrumented class bytes, zero if not modified. */
+	uint32_t class_size;
+	uint32_t reserved;
+};
+
+
+static struct {
+	bool enabled;
+
+	int index_fd;
+	int blobs_fd;
+
+	size_t index_size;
+	struct cache_header * header;
+	struct cache_entry * entries;
+
+	/**
+	 * Mutex to protect the index and the writes to the blobs file. The
+	 * blobs are read without the mutex, see class_cache_lookup().
+	 */
+	mutex_t mutex;
+} cache;
+
+
+//
+
+/**
+ * Returns a hash of the class bytes and code flags. The FNV-1a hash is used
+ * to select a bucket, the class bytes are compared on a match.
+ */
+static uint64_t
+__class_hash (jint code_flags, const jvmtiClassDefinition * class_def) {
+	uint64_t hash = UINT64_C (0xcbf29ce484222325);
+	for (jint i = 0; i < class_def->class_byte_count; i++) {
+		hash ^= class_def->class_bytes [i];
+		hash *= UINT64_C (0x100000001b3);
+	}
+
+	hash ^= (uint32_t) code_flags;
+	hash *= UINT64_C (0x100000001b3);
+
+	// zero marks an unused entry
+	return (hash != 0) ? hash : 1;
+}
+
+
+static char *
+__path (const char * dir_name, const char * file_name) {
+	size_t length = strlen (dir_name) + strlen (file_name) + 2;
+	char * result = (char *) malloc (length);
+	check_error (result == NULL, "failed to allocate class cache path");
+
+	snprintf (result, length, "%s/%s", dir_name, file_name);
+	return result;
+}
+
+
+static uint32_t
+__round_capacity (jint capacity) {
+	uint32_t result = CACHE_CAPACITY_MIN;
+	while (result < (uint32_t) capacity && result < CACHE_CAPACITY_MAX) {
+		result <<= 1;
+	}
+
+	return result;
+}
+
+
+static bool
+__read_fully (int fd, void * buf, size_t len, uint64_t offset) {
+	uint8_t * bytes = (uint8_t *) buf;
+	while (len > 0) {
+		ssize_t count = pread (fd, bytes, len, (off_t) offset);
+		if (count <= 0) {
+			return false;
+		}
+
+		bytes += count;
+		len -= count;
+		offset += count;
+	}
+
+	return true;
+}
+
+
+static bool
+__write_fully (int fd, const void * buf, size_t len, uint64_t offset) {
+	const uint8_t * bytes = (const uint8_t *) buf;
+	while (len > 0) {
+		ssize_t count = pwrite (fd, bytes, len, (off_t) offset);
+		if (count <= 0) {
+			return false;
+		}
+
+		bytes += count;
+		len -= count;
+		offset += count;
+	}
+
+	return true;
+}
+
+
+/**
+ * Reads bytes from the blobs file into a newly allocated buffer. Returns
+ * NULL if the bytes could not be read.
+ */
+static uint8_t *
+__read_blob (int fd, uint64_t offset, uint32_t size) {
+	uint8_t * result = (uint8_t *) malloc (size);
+	check_error (result == NULL, "failed to allocate class cache buffer");
+
+	if (!__read_fully (fd, result, size, offset)) {
+		free (result);
+		return NULL;
+	}
+
+	return result;
+}
+
+
+static inline bool
+__entry_has_key (
+	const struct cache_entry * entry, uint64_t hash,
+	jint code_flags, uint32_t original_size
+) {
+	return entry->hash == hash && entry->code_flags == code_flags
+		&& entry->original_size == original_size;
+}
+
+
+/**
+ * Copies the entries with the key of the given class into the given array
+ * and returns their number. The class bytes of the entries are not
+ * compared, so that the mutex is not held while reading the blobs file.
+ * Has to be called with the mutex held.
+ */
+static size_t
+__find_candidates (
+	uint64_t hash, jint code_flags, uint32_t original_size,
+	struct cache_entry * candidates
+) {
+	size_t count = 0;
+	uint32_t mask = cache.header->capacity - 1;
+	for (uint32_t index = (uint32_t) hash & mask; ; index = (index + 1) & mask) {
+		struct cache_entry * entry = &cache.entries [index];
+		if (entry->hash == 0 || count == LOOKUP_CANDIDATES_MAX) {
+			return count;
+		}
+
+		if (__entry_has_key (entry, hash, code_flags, original_size)) {
+			candidates [count++] = *entry;
+		}
+	}
+}
+
+
+/**
+ * Finds an entry with the key of the given class, or the unused entry
+ * where the class should be stored. The table is never full, so the
+ * probing always stops at an unused entry. Has to be called with the
+ * mutex held.
+ */
+static struct cache_entry *
+__find_slot (uint64_t hash, jint code_flags, uint32_t original_size) {
+	uint32_t mask = cache.header->capacity - 1;
+	for (uint32_t index = (uint32_t) hash & mask; ; index = (index + 1) & mask) {
+		struct cache_entry * entry = &cache.entries [index];
+		if (entry->hash == 0 || __entry_has_key (entry, hash, code_flags, original_size)) {
+			return entry;
+		}
+	}
+}
+
+
+/**
+ * Removes all entries from the cache and starts a new generation. Has to
+ * be called with the mutex held, or before the cache is enabled.
+ */
+static bool
+__clear_entries () {
+	struct cache_header * header = cache.header;
+	memset (cache.entries, 0, header->capacity * sizeof (struct cache_entry));
+
+	header->count = 0;
+	header->blobs_size = 0;
+	header->generation++;
+
+	return ftruncate (cache.blobs_fd, 0) == 0;
+}
+
+
+/**
+ * Returns TRUE if the cache is still enabled and was not cleared since
+ * the given generation. Has to be called with the mutex held.
+ */
+static inline bool
+__generation_valid (uint32_t generation) {
+	return cache.enabled && cache.header->generation == generation;
+}
+
+
+static bool
+__header_valid (
+	uint32_t capacity, const uint8_t * fingerprint, size_t fingerprint_size
+) {
+	struct cache_header * header = cache.header;
+	if (
+		header->magic != CACHE_MAGIC || header->version != CACHE_VERSION
+		|| header->capacity != capacity
+		|| header->fingerprint_size != fingerprint_size
+		|| memcmp (header->fingerprint, fingerprint, fingerprint_size) != 0
+	) {
+		return false;
+	}
+
+	struct stat blobs_stat;
+	if (fstat (cache.blobs_fd, &blobs_stat) != 0) {
+		return false;
+	}
+
+	return header->blobs_size <= (uint64_t) blobs_stat.st_size;
+}
+
+
+static void
+__close_files () {
+	if (cache.header != NULL) {
+		munmap (cache.header, cache.index_size);
+		cache.header = NULL;
+		cache.entries = NULL;
+	}
+
+	if (cache.blobs_fd >= 0) {
+		close (cache.blobs_fd);
+		cache.blobs_fd = -1;
+	}
+
+	if (cache.index_fd >= 0) {
+		// releases the lock as well
+		close (cache.index_fd);
+		cache.index_fd = -1;
+	}
+}
+
+
+static bool
+__open_files (
+	const char * dir_name, jint capacity,
+	const uint8_t * fingerprint, size_t fingerprint_size
+) {
+	if (mkdir (dir_name, 0777) != 0 && errno != EEXIST) {
+		warn ("failed to create class cache directory %s\n", dir_name);
+		return false;
+	}
+
+	char * index_name = __path (dir_name, CACHE_INDEX_FILE);
+	cache.index_fd = open (index_name, O_RDWR | O_CREAT, 0666);
+	free (index_name);
+
+	if (cache.index_fd < 0) {
+		warn ("failed to open class cache index in %s\n", dir_name);
+		return false;
+	}
+
+	//
+	// Only one JVM at a time may use the cache. Other JVMs
+	// using the same cache directory run without the cache.
+	//
+	struct flock lock = {
+		.l_type = F_WRLCK, .l_whence = SEEK_SET, .l_start = 0, .l_len = 0
+	};
+
+	if (fcntl (cache.index_fd, F_SETLK, &lock) != 0) {
+		warn ("class cache in %s is used by another process\n", dir_name);
+		return false;
+	}
+
+	char * blobs_name = __path (dir_name, CACHE_BLOBS_FILE);
+	cache.blobs_fd = open (blobs_name, O_RDWR | O_CREAT, 0666);
+	free (blobs_name);
+
+	if (cache.blobs_fd < 0) {
+		warn ("failed to open class cache blobs in %s\n", dir_name);
+		return false;
+	}
+
+	//
+	// Map the index and clear the cache if it was created for a different
+	// instrumentation or capacity, or if it is not consistent.
+	//
+	uint32_t rounded_capacity = __round_capacity (capacity);
+	cache.index_size = sizeof (struct cache_header)
+		+ rounded_capacity * sizeof (struct cache_entry);
+
+	if (ftruncate (cache.index_fd, cache.index_size) != 0) {
+		warn ("failed to resize class cache index in %s\n", dir_name);
+		return false;
+	}
+
+	void * index = mmap (
+		NULL, cache.index_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		cache.index_fd, 0
+	);
+
+	if (index == MAP_FAILED) {
+		warn ("failed to map class cache index in %s\n", dir_name);
+		return false;
+	}
+
+	cache.header = (struct cache_header *) index;
+	cache.entries = (struct cache_entry *) (cache.header + 1);
+
+	if (!__header_valid (rounded_capacity, fingerprint, fingerprint_size)) {
+		memset (index, 0, cache.index_size);
+
+		cache.header->magic = CACHE_MAGIC;
+		cache.header->version = CACHE_VERSION;
+		cache.header->capacity = rounded_capacity;
+		cache.header->fingerprint_size = fingerprint_size;
+		memcpy (cache.header->fingerprint, fingerprint, fingerprint_size);
+
+		if (!__clear_entries ()) {
+			warn ("failed to clear class cache blobs in %s\n", dir_name);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/**
+ * Opens the class cache in the given directory. The cache is only used
+ * with the instrumentation identified by the given fingerprint, and holds
+ * at most (approximately) the given number of classes. Returns FALSE if the
+ * cache could not be opened -- the agent then works without the cache.
+ */
+bool
+class_cache_open (
+	const char * dir_name, jint capacity,
+	const uint8_t * fingerprint, size_t fingerprint_size
+) {
+	assert (dir_name != NULL);
+	assert (fingerprint != NULL);
+
+	if (fingerprint_size == 0 || fingerprint_size > FINGERPRINT_SIZE_MAX) {
+		warn ("invalid instrumentation fingerprint, not using class cache\n");
+		return false;
+	}
+
+	cache.index_fd = -1;
+	cache.blobs_fd = -1;
+
+	if (!__open_files (dir_name, capacity, fingerprint, fingerprint_size)) {
+		__close_files ();
+		return false;
+	}
+
+	mutex_init (&cache.mutex);
+	cache.enabled = true;
+	return true;
+}
+
+
+/**
+ * Closes the class cache. Classes loaded afterwards are not cached.
+ */
+void
+class_cache_close () {
+	if (!cache.enabled) {
+		return;
+	}
+
+	mutex_lock (&cache.mutex);
+	{
+		cache.enabled = false;
+		__close_files ();
+	}
+	mutex_unlock (&cache.mutex);
+}
+
+
+/**
+ * Looks up the result of instrumenting the given class with the given code
+ * flags. Returns TRUE if the class was found. If the cached class was
+ * modified, the class definition structure is updated to refer to the
+ * instrumented class bytes, which have to be released by the caller.
+ */
+bool
+class_cache_lookup (
+	jint code_flags, jvmtiClassDefinition * class_def, bool * class_changed
+) {
+	assert (class_def != NULL);
+	assert (class_changed != NULL);
+
+	if (!cache.enabled) {
+		return false;
+	}
+
+	uint64_t hash = __class_hash (code_flags, class_def);
+	uint32_t original_size = class_def->class_byte_count;
+
+	//
+	// Copy the entries under the mutex, but read the class bytes outside
+	// of it, so that concurrent lookups do not wait for each other.
+	//
+	struct cache_entry candidates [LOOKUP_CANDIDATES_MAX];
+	size_t candidate_count = 0;
+	uint32_t generation = 0;
+	int blobs_fd = -1;
+
+	mutex_lock (&cache.mutex);
+	if (cache.enabled) {
+		generation = cache.header->generation;
+		blobs_fd = cache.blobs_fd;
+		candidate_count = __find_candidates (
+			hash, code_flags, original_size, candidates
+		);
+	}
+	mutex_unlock (&cache.mutex);
+
+	for (size_t i = 0; i < candidate_count; i++) {
+		const struct cache_entry * entry = &candidates [i];
+
+		//
+		// Read the original class bytes followed by the instrumented class
+		// bytes, and compare the original class bytes, so that a hash
+		// collision never returns a different class.
+		//
+		uint8_t * blob = __read_blob (
+			blobs_fd, entry->offset, entry->original_size + entry->class_size
+		);
+
+		if (blob == NULL) {
+			continue;
+		}
+
+		if (memcmp (blob, class_def->class_bytes, original_size) != 0) {
+			free (blob);
+			continue;
+		}
+
+		//
+		// The blobs may have been overwritten if the cache was cleared
+		// while reading them.
+		//
+		mutex_lock (&cache.mutex);
+		bool valid = __generation_valid (generation);
+		mutex_unlock (&cache.mutex);
+
+		if (!valid) {
+			free (blob);
+			return false;
+		}
+
+		if (entry->class_size == 0) {
+			free (blob);
+			*class_changed = false;
+
+		} else {
+			memmove (blob, blob + original_size, entry->class_size);
+
+			class_def->class_byte_count = entry->class_size;
+			class_def->class_bytes = blob;
+			*class_changed = true;
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+
+/**
+ * Stores the result of instrumenting the given original class with the
+ * given code flags. The class definition refers to the instrumented class,
+ * or is NULL if the class was not modified.
+ */
+void
+class_cache_store (
+	jint code_flags, const jvmtiClassDefinition * original_def,
+	const jvmtiClassDefinition * class_def
+) {
+	assert (original_def != NULL);
+
+	if (!cache.enabled) {
+		return;
+	}
+
+	uint64_t hash = __class_hash (code_flags, original_def);
+
+	mutex_lock (&cache.mutex);
+	if (cache.enabled) {
+		struct cache_header * header = cache.header;
+		uint32_t original_size = original_def->class_byte_count;
+		struct cache_entry * entry = __find_slot (hash, code_flags, original_size);
+
+		if (entry->hash != 0) {
+			//
+			// Cached by another thread in the meantime. On a hash
+			// collision, the class is just not cached.
+			//
+
+		} else {
+			//
+			// Keep the hash table sparse enough for probing. When it
+			// fills up, start over with a new generation, so that the
+			// classes loaded from now on are cached.
+			//
+			if (header->count >= header->capacity - header->capacity / 4) {
+				warn ("class cache is full, clearing it\n");
+				if (!__clear_entries ()) {
+					warn ("failed to truncate class cache blobs\n");
+				}
+
+				entry = __find_slot (hash, code_flags, original_size);
+			}
+
+			uint64_t offset = header->blobs_size;
+			uint32_t class_size = (class_def != NULL) ? class_def->class_byte_count : 0;
+
+			bool written = __write_fully (
+				cache.blobs_fd, original_def->class_bytes, original_size, offset
+			) && (class_def == NULL || __write_fully (
+				cache.blobs_fd, class_def->class_bytes, class_size,
+				offset + original_size
+			));
+
+			//
+			// Publish the entry only after the class bytes have been
+			// written, and set the hash last to mark the entry used.
+			//
+			if (written) {
+				header->blobs_size = offset + original_size + class_size;
+
+				entry->offset = offset;
+				entry->code_flags = code_flags;
+				entry->original_size = original_size;
+				entry->class_size = class_size;
+				entry->hash = hash;
+
+				header->count++;
+			}
+		}
+	}
+	mutex_unlock (&cache.mutex);
+}
+
+
+#else /* MINGW */
+
+
+bool
+class_cache_open (
+	const char * dir_name, jint capacity,
+	const uint8_t * fingerprint, size_t fingerprint_size
+) {
+	warn ("class cache is not supported on this platform\n");
+	return false;
+}
+
+
+void
+class_cache_close () {
+	// nothing to do
+}
+
+
+bool
+class_cache_lookup (
+	jint code_flags, jvmtiClassDefinition * class_def, bool * class_changed
+) {
+	return false;
+}
+
+
+void
+class_cache_store (
+	jint code_flags, const jvmtiClassDefinition * original_def,
+	const jvmtiClassDefinition * class_def
+) {
+	// nothing to do
+}
+
+#endif /* MINGW */
@@ -0,0 +1,27 @@
+#ifndef _CLASSCACHE_H_
+#define _CLASSCACHE_H_
+
+#include <stdint.h>
+
+#include <jvmti.h>
+
+#include "common.h"
+
+
+bool class_cache_open (
+	const char * dir_name, jint capacity,
+	const uint8_t * fingerprint, size_t fingerprint_size
+);
+
+void class_cache_close ();
+
+bool class_cache_lookup (
+	jint code_flags, jvmtiClassDefinition * class_def, bool * class_changed
+);
+
+void class_cache_store (
+	jint code_flags, const jvmtiClassDefinition * original_def,
+	const jvmtiClassDefinition * class_def
+);
+
+#endif /* _CLASSCACHE_H_ */
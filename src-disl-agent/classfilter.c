@@ -0,0 +1,383 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "classfilter.h"
+
+
+/**
+ * Version of the filter format produced by the server.
+ */
+#define FILTER_FORMAT_VERSION 1
+
+#define FILTER_FLAG_INCLUDE_ALL (1 << 0)
+
+/**
+ * Package name used by scopes for classes in the default package.
+ */
+#define DEFAULT_PACKAGE "[default]"
+
+
+enum pattern_kind {
+	PATTERN_EXACT = 0,
+	PATTERN_PREFIX = 1,
+	PATTERN_GLOB = 2,
+};
+
+
+/**
+ * Class name patterns by kind. Exact names are sorted for binary search.
+ */
+struct pattern_set {
+	char ** exact;
+	size_t exact_count;
+
+	char ** prefixes;
+	size_t prefix_count;
+
+	char ** globs;
+	size_t glob_count;
+};
+
+
+static struct {
+	bool enabled;
+	bool include_all;
+
+	struct pattern_set required;
+	struct pattern_set excluded;
+	struct pattern_set included;
+} filter;
+
+
+// ****************************************************************************
+// PATTERN MATCHING
+// ****************************************************************************
+
+static const char *
+__find (const char * text, const char * card, size_t card_length) {
+	size_t text_length = strlen (text);
+	for (size_t pos = 0; pos + card_length <= text_length; pos++) {
+		if (strncmp (text + pos, card, card_length) == 0) {
+			return text + pos;
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Matches the text against a pattern with "*" wild cards. Follows the
+ * WildCard class used by the server: the first and the last card have to
+ * match at the beginning and at the end of the text (unless preceded or
+ * followed by a wild card), and all cards have to appear in the text in
+ * order, each matched at its leftmost position.
+ */
+static bool
+__glob_matches (const char * text, const char * pattern) {
+	if (strcmp (pattern, "*") == 0) {
+		return true;
+	}
+
+	size_t pattern_length = strlen (pattern);
+	if (pattern_length == 0) {
+		return text [0] == '\0';
+	}
+
+	if (pattern [0] != '*') {
+		size_t first_length = strcspn (pattern, "*");
+		if (strncmp (text, pattern, first_length) != 0) {
+			return false;
+		}
+	}
+
+	if (pattern [pattern_length - 1] != '*') {
+		const char * last = strrchr (pattern, '*');
+		last = (last != NULL) ? last + 1 : pattern;
+
+		size_t last_length = strlen (last);
+		size_t text_length = strlen (text);
+		if (
+			last_length > text_length
+			|| strcmp (text + text_length - last_length, last) != 0
+		) {
+			return false;
+		}
+	}
+
+	const char * card = pattern;
+	while (*card != '\0') {
+		size_t card_length = strcspn (card, "*");
+		const char * found = __find (text, card, card_length);
+		if (found == NULL) {
+			return false;
+		}
+
+		text = found + card_length;
+		card += card_length;
+		if (*card == '*') {
+			card++;
+		}
+	}
+
+	return true;
+}
+
+
+static int
+__compare_names (const void * left, const void * right) {
+	return strcmp (* (char * const *) left, * (char * const *) right);
+}
+
+
+static bool
+__set_matches (const struct pattern_set * set, const char * name) {
+	if (set->exact_count > 0 && bsearch (
+		&name, set->exact, set->exact_count, sizeof (char *), __compare_names
+	) != NULL) {
+		return true;
+	}
+
+	for (size_t i = 0; i < set->prefix_count; i++) {
+		const char * prefix = set->prefixes [i];
+		if (strncmp (name, prefix, strlen (prefix)) == 0) {
+			return true;
+		}
+	}
+
+	for (size_t i = 0; i < set->glob_count; i++) {
+		if (__glob_matches (name, set->globs [i])) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+// ****************************************************************************
+// FILTER PARSING
+// ****************************************************************************
+
+struct reader {
+	const uint8_t * data;
+	size_t size;
+	size_t position;
+};
+
+
+static bool
+__read_bytes (struct reader * reader, void * dst, size_t length) {
+	if (reader->size - reader->position < length) {
+		return false;
+	}
+
+	memcpy (dst, reader->data + reader->position, length);
+	reader->position += length;
+	return true;
+}
+
+
+static bool
+__read_u8 (struct reader * reader, uint8_t * value) {
+	return __read_bytes (reader, value, sizeof (uint8_t));
+}
+
+
+static bool
+__read_u16 (struct reader * reader, uint16_t * value) {
+	uint8_t bytes [2];
+	if (!__read_bytes (reader, bytes, sizeof (bytes))) {
+		return false;
+	}
+
+	*value = (uint16_t) ((bytes [0] << 8) | bytes [1]);
+	return true;
+}
+
+
+static bool
+__read_u32 (struct reader * reader, uint32_t * value) {
+	uint8_t bytes [4];
+	if (!__read_bytes (reader, bytes, sizeof (bytes))) {
+		return false;
+	}
+
+	*value = ((uint32_t) bytes [0] << 24) | ((uint32_t) bytes [1] << 16)
+		| ((uint32_t) bytes [2] << 8) | (uint32_t) bytes [3];
+	return true;
+}
+
+
+/**
+ * Reads a string in the format produced by Java DataOutput.writeUTF().
+ * The string is (modified) UTF-8 encoded, the same as class names
+ * provided by JVMTI, so no conversion is needed.
+ */
+static char *
+__read_string (struct reader * reader) {
+	uint16_t length;
+	if (!__read_u16 (reader, &length)) {
+		return NULL;
+	}
+
+	char * result = (char *) malloc (length + 1);
+	check_error (result == NULL, "failed to allocate class filter pattern");
+
+	if (!__read_bytes (reader, result, length)) {
+		free (result);
+		return NULL;
+	}
+
+	result [length] = '\0';
+	return result;
+}
+
+
+static void
+__append (char *** names, size_t * count, char * name) {
+	*names = (char **) realloc (*names, (*count + 1) * sizeof (char *));
+	check_error (*names == NULL, "failed to allocate class filter patterns");
+
+	(*names) [(*count)++] = name;
+}
+
+
+static bool
+__read_pattern_set (struct reader * reader, struct pattern_set * set) {
+	uint32_t count;
+	if (!__read_u32 (reader, &count)) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint8_t kind;
+		if (!__read_u8 (reader, &kind)) {
+			return false;
+		}
+
+		char * pattern = __read_string (reader);
+		if (pattern == NULL) {
+			return false;
+		}
+
+		switch (kind) {
+		case PATTERN_EXACT:
+			__append (&set->exact, &set->exact_count, pattern);
+			break;
+
+		case PATTERN_PREFIX:
+			__append (&set->prefixes, &set->prefix_count, pattern);
+			break;
+
+		case PATTERN_GLOB:
+			__append (&set->globs, &set->glob_count, pattern);
+			break;
+
+		default:
+			free (pattern);
+			return false;
+		}
+	}
+
+	if (set->exact_count > 1) {
+		qsort (set->exact, set->exact_count, sizeof (char *), __compare_names);
+	}
+
+	return true;
+}
+
+
+/**
+ * Initializes the class filter from the data provided by the server.
+ * Returns FALSE if the data is malformed, in which case the filter
+ * accepts all classes.
+ */
+bool
+class_filter_init (const uint8_t * data, size_t size) {
+	assert (data != NULL || size == 0);
+
+	struct reader reader = { .data = data, .size = size, .position = 0 };
+
+	uint8_t version;
+	uint8_t flags;
+	if (
+		!__read_u8 (&reader, &version) || version != FILTER_FORMAT_VERSION
+		|| !__read_u8 (&reader, &flags)
+		|| !__read_pattern_set (&reader, &filter.required)
+		|| !__read_pattern_set (&reader, &filter.excluded)
+		|| !__read_pattern_set (&reader, &filter.included)
+	) {
+		warn ("invalid class filter received from server, not filtering classes\n");
+		return false;
+	}
+
+	filter.include_all = (flags & FILTER_FLAG_INCLUDE_ALL) != 0;
+	filter.enabled = true;
+	return true;
+}
+
+
+// ****************************************************************************
+// CLASS FILTERING
+// ****************************************************************************
+
+/**
+ * Converts an internal class name to the form used by scopes, i.e., with
+ * dots as package delimiters and with the default package made explicit.
+ * The caller is responsible for releasing the returned name.
+ */
+static char *
+__scope_class_name (const char * class_name) {
+	bool has_package = strchr (class_name, '/') != NULL;
+	size_t prefix_length = has_package ? 0 : strlen (DEFAULT_PACKAGE ".");
+
+	char * result = (char *) malloc (prefix_length + strlen (class_name) + 1);
+	check_error (result == NULL, "failed to allocate class name");
+
+	if (!has_package) {
+		strcpy (result, DEFAULT_PACKAGE ".");
+	}
+
+	char * dst = result + prefix_length;
+	for (const char * src = class_name; *src != '\0'; src++, dst++) {
+		*dst = (*src == '/') ? '.' : *src;
+	}
+
+	*dst = '\0';
+	return result;
+}
+
+
+/**
+ * Returns TRUE if the class with the given (internal) name may be modified
+ * by the server and needs to be sent for instrumentation. Returns FALSE only
+ * for classes the server would certainly leave unmodified.
+ */
+bool
+class_filter_accepts (const char * class_name) {
+	assert (class_name != NULL);
+
+	if (!filter.enabled) {
+		return true;
+	}
+
+	char * name = __scope_class_name (class_name);
+
+	bool result;
+	if (__set_matches (&filter.required, name)) {
+		result = true;
+
+	} else if (__set_matches (&filter.excluded, name)) {
+		result = false;
+
+	} else {
+		result = filter.include_all || __set_matches (&filter.included, name);
+	}
+
+	free (name);
+	return result;
+}
@@ -0,0 +1,13 @@
+#ifndef _CLASSFILTER_H_
+#define _CLASSFILTER_H_
+
+#include <stdint.h>
+
+#include "common.h"
+
+
+bool class_filter_init (const uint8_t * data, size_t size);
+
+bool class_filter_accepts (const char * class_name);
+
+#endif /* _CLASSFILTER_H_ */
@@ -15,6 +15,8 @@
 #include "msgchannel.h"
 #include "bytecode.h"
 #include "codeflags.h"
+#include "classcache.h"
+#include "classfilter.h"
 
 
 // ****************************************************************************
@@ -36,10 +38,30 @@
 #define DISL_CATCH_EXCEPTIONS "disl.excepthandler"
 #define DISL_CATCH_EXCEPTIONS_DEFAULT false
 
+#define DISL_CLASS_FILTER "disl.classfilter"
+#define DISL_CLASS_FILTER_DEFAULT true
+
+#define DISL_CACHE_DIR "disl.cache.dir"
+#define DISL_CACHE_DIR_DEFAULT NULL
+
+#define DISL_CACHE_ENTRIES "disl.cache.entries"
+#define DISL_CACHE_ENTRIES_DEFAULT "65536"
+
 #define DISL_DEBUG "debug"
 #define DISL_DEBUG_DEFAULT false
 
 
+/**
+ * Query for the fingerprint of the instrumentation used by the server.
+ */
+#define SERVER_QUERY_FINGERPRINT "fingerprint"
+
+/**
+ * Query for the filter of classes the server may instrument.
+ */
+#define SERVER_QUERY_FILTER "filter"
+
+
 /**
  * The instrumentation bypass mode.
  * NOTE: The ordering of the modes is important!
@@ -87,6 +109,11 @@ struct config {
 	bool split_methods;
 	bool catch_exceptions;
 
+	bool class_filter;
+
+	char * cache_dir;
+	jint cache_entries;
+
 	bool debug;
 };
 
@@ -144,6 +171,24 @@ __calc_code_flags (struct config * config, bool jvm_is_booting) {
 }
 
 
+/**
+ * Terminates the agent if the response from the server indicates an error.
+ * The control field of the response contains the error message.
+ */
+static void
+__check_server_error (struct message * response) {
+	if (response->control_size > 0) {
+		fprintf (
+			stderr,
+			"%sinstrumentation server error:\n%s\n",
+			ERROR_PREFIX, response->control
+		);
+
+		exit (ERROR_SERVER);
+	}
+}
+
+
 /**
  * Sends the given class to the remote server for instrumentation. If the
  * server modified the class, provided class definition structure is updated
@@ -182,17 +227,8 @@ __instrument_class (
 
 	//
 	// Check if error occurred on the server.
-	// The control field of the response contains the error message.
 	//
-	if (response.control_size > 0) {
-		fprintf (
-			stderr,
-			"%sinstrumentation server error:\n%s\n",
-			ERROR_PREFIX, response.control
-		);
-
-		exit (ERROR_SERVER);
-	}
+	__check_server_error (&response);
 
 	//
 	// Update the class definition and signal that the class has been
@@ -234,19 +270,41 @@ jvmti_callback_class_file_load (
 		return;
 	}
 
+	//
+	// Avoid sending classes the server would not modify anyway.
+	//
+	if (class_name != NULL && !class_filter_accepts (class_name)) {
+		rdprintf ("skipping class rejected by class filter (%s)\n", class_name);
+		return;
+	}
+
 
 	//
-	// Instrument the class and if changed by the server, provide the
-	// code to the JVM in its own memory.
+	// Look up the class in the class cache first. If not cached, instrument
+	// the class and cache the result. If changed by the cache or the server,
+	// provide the code to the JVM in its own memory.
 	//
-	jvmtiClassDefinition class_def = {
+	const jvmtiClassDefinition original_def = {
 		.class_byte_count = class_byte_count,
 		.class_bytes = class_bytes,
 	};
 
-	bool class_changed = __instrument_class (
-		agent_code_flags, class_name, &class_def
-	);
+	jvmtiClassDefinition class_def = original_def;
+	jint code_flags = agent_code_flags;
+
+	bool class_changed;
+	if (class_cache_lookup (code_flags, &class_def, &class_changed)) {
+		rdprintf ("class found in class cache\n");
+
+	} else {
+		class_changed = __instrument_class (
+			code_flags, class_name, &class_def
+		);
+
+		class_cache_store (
+			code_flags, &original_def, class_changed ? &class_def : NULL
+		);
+	}
 
 	if (class_changed) {
 		unsigned char * jvm_class_bytes = jvmti_alloc_copy (
@@ -308,8 +366,9 @@ jvmti_callback_vm_death (jvmtiEnv * jvmti, JNIEnv * jni) {
 	rdprintf ("the VM is shutting down, closing connections\n");
 
 	//
-	// Just close all the connections.
+	// Close the class cache and all the connections.
 	//
+	class_cache_close ();
 	network_fini ();
 }
 
@@ -350,6 +409,108 @@ __configure_from_properties (jvmtiEnv * jvmti, struct config * config) {
 	config->debug = jvmti_get_system_property_bool (
 		jvmti, DISL_DEBUG, DISL_DEBUG_DEFAULT
 	);
+
+	config->class_filter = jvmti_get_system_property_bool (
+		jvmti, DISL_CLASS_FILTER, DISL_CLASS_FILTER_DEFAULT
+	);
+
+	//
+	// Get class cache configuration
+	//
+	config->cache_dir = jvmti_get_system_property_string (
+		jvmti, DISL_CACHE_DIR, DISL_CACHE_DIR_DEFAULT
+	);
+
+	char * cache_entries = jvmti_get_system_property_string (
+		jvmti, DISL_CACHE_ENTRIES, DISL_CACHE_ENTRIES_DEFAULT
+	);
+
+	config->cache_entries = atoi (cache_entries);
+	check_error (
+		config->cache_entries <= 0,
+		"invalid number of class cache entries, check " DISL_CACHE_ENTRIES
+	);
+
+	free (cache_entries);
+}
+
+
+/**
+ * Sends a query to the remote server and receives the answer.
+ */
+static void
+__query_server (const char * query, struct message * response) {
+	//
+	// Queries are requests without class code. The control field of the
+	// request contains the query, the response contains the answer in
+	// place of the class code.
+	//
+	struct message request = {
+		.message_flags = 0,
+		.control_size = strlen (query),
+		.classcode_size = 0,
+		.control = (const uint8_t *) query,
+		.classcode = NULL,
+	};
+
+	struct connection * conn = network_acquire_connection ();
+	message_send (conn, &request);
+
+	message_recv (conn, response);
+	network_release_connection (conn);
+
+	__check_server_error (response);
+}
+
+
+/**
+ * Obtains the filter of classes that may be instrumented from the server,
+ * if enabled. Without the filter, all classes are sent to the server.
+ */
+static void
+__init_class_filter (struct config * config) {
+	if (!config->class_filter) {
+		return;
+	}
+
+	struct message response;
+	__query_server (SERVER_QUERY_FILTER, &response);
+
+	bool initialized = class_filter_init (
+		response.classcode, response.classcode_size
+	);
+
+	rdprintf ("class filter: %s\n", initialized ? "enabled" : "disabled");
+
+	free ((void *) response.classcode);
+}
+
+
+/**
+ * Opens the class cache, if configured. The cache is tied to the fingerprint
+ * of the instrumentation used by the server, so that classes instrumented
+ * by a different instrumentation are never used.
+ */
+static void
+__open_class_cache (struct config * config) {
+	if (config->cache_dir == NULL) {
+		return;
+	}
+
+	struct message response;
+	__query_server (SERVER_QUERY_FINGERPRINT, &response);
+
+	bool opened = class_cache_open (
+		config->cache_dir, config->cache_entries,
+		response.classcode, response.classcode_size
+	);
+
+	rdprintf (
+		"class cache %s: %s\n", config->cache_dir,
+		opened ? "opened" : "not used"
+	);
+
+	free ((void *) response.classcode);
 }
 
 
@@ -440,6 +601,8 @@ Agent_OnLoad (JavaVM * jvm, char * options, void * reserved) {
 
 	agent_code_flags = __calc_code_flags (&agent_config, true);
 	network_init (agent_config.server_host, agent_config.server_port);
+	__init_class_filter (&agent_config);
+	__open_class_cache (&agent_config);
 
 
 	// register callbacks
@@ -0,0 +1,386 @@
+/**
+ * Test of the persistent class cache. The test uses a cache in a temporary
+ * directory and checks the cache internals directly where the behavior
+ * cannot be observed through the interface.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+/**
+ * Hook called after the class cache reads the blobs file, outside of the
+ * cache mutex, to simulate another thread working with the cache while a
+ * lookup is in progress.
+ */
+static void (* read_hook) () = NULL;
+
+static ssize_t
+__hooked_pread (int fd, void * buf, size_t count, off_t offset) {
+	ssize_t result = pread (fd, buf, count, offset);
+	if (read_hook != NULL) {
+		read_hook ();
+	}
+
+	return result;
+}
+
+// the cache internals are needed to check collisions and generations
+#define pread __hooked_pread
+#include "../classcache.c"
+#undef pread
+
+
+#define CLASS_SIZE 64
+
+#define CODE_FLAGS 1
+
+// number of classes stored before a cache of the minimal capacity is full
+#define FULL_COUNT (CACHE_CAPACITY_MIN - CACHE_CAPACITY_MIN / 4)
+
+
+static int failures = 0;
+
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			fprintf (stderr, "%s:%d: ", __FILE__, __LINE__); \
+			fprintf (stderr, __VA_ARGS__); \
+			fprintf (stderr, "\n"); \
+			++failures; \
+		} \
+	} while (0)
+
+
+static const uint8_t FINGERPRINT [] = { 0xca, 0xfe, 0xba, 0xbe };
+static const uint8_t OTHER_FINGERPRINT [] = { 0xde, 0xad, 0xbe, 0xef };
+
+static char dir_name [] = "/tmp/classcache_test.XXXXXX";
+
+
+//
+
+/**
+ * Fills the given buffer with the bytes of a class identified by the
+ * given seed. Classes with different seeds have different bytes.
+ */
+static jvmtiClassDefinition
+__make_class (uint8_t * bytes, uint32_t seed) {
+	for (int i = 0; i < CLASS_SIZE; i++) {
+		bytes [i] = (uint8_t) (seed >> ((i % 4) * 8)) ^ (uint8_t) (i * 7);
+	}
+
+	return (jvmtiClassDefinition) {
+		.class_byte_count = CLASS_SIZE, .class_bytes = bytes
+	};
+}
+
+
+static bool
+__open (jint capacity, const uint8_t * fingerprint) {
+	return class_cache_open (dir_name, capacity, fingerprint, sizeof (FINGERPRINT));
+}
+
+
+/**
+ * Stores the class with the given seed, instrumented as the class with
+ * the seed incremented by one.
+ */
+static void
+__store (uint32_t seed) {
+	uint8_t original_bytes [CLASS_SIZE];
+	uint8_t class_bytes [CLASS_SIZE];
+	jvmtiClassDefinition original_def = __make_class (original_bytes, seed);
+	jvmtiClassDefinition class_def = __make_class (class_bytes, seed + 1);
+
+	class_cache_store (CODE_FLAGS, &original_def, &class_def);
+}
+
+
+/**
+ * Returns TRUE if the class with the given seed is found in the cache, and
+ * checks that its instrumented bytes are those stored by __store().
+ */
+static bool
+__lookup (uint32_t seed) {
+	uint8_t original_bytes [CLASS_SIZE];
+	jvmtiClassDefinition class_def = __make_class (original_bytes, seed);
+
+	bool class_changed = false;
+	if (!class_cache_lookup (CODE_FLAGS, &class_def, &class_changed)) {
+		return false;
+	}
+
+	uint8_t expected_bytes [CLASS_SIZE];
+	__make_class (expected_bytes, seed + 1);
+
+	CHECK (class_changed, "class %u: not changed", seed);
+	CHECK (
+		class_def.class_bytes != original_bytes
+		&& class_def.class_byte_count == CLASS_SIZE
+		&& memcmp (class_def.class_bytes, expected_bytes, CLASS_SIZE) == 0,
+		"class %u: wrong instrumented class", seed
+	);
+
+	if (class_def.class_bytes != original_bytes) {
+		free ((void *) class_def.class_bytes);
+	}
+
+	return true;
+}
+
+
+static void
+__remove_cache () {
+	const char * file_names [] = { CACHE_INDEX_FILE, CACHE_BLOBS_FILE };
+	for (size_t i = 0; i < sizeof (file_names) / sizeof (file_names [0]); i++) {
+		char * path = __path (dir_name, file_names [i]);
+		unlink (path);
+		free (path);
+	}
+}
+
+
+//
+
+static void
+test_store_lookup () {
+	CHECK (__open (0, FINGERPRINT), "cache not opened");
+
+	CHECK (!__lookup (1), "class found in an empty cache");
+
+	__store (1);
+	CHECK (__lookup (1), "stored class not found");
+	CHECK (__lookup (1), "class not found by a second lookup");
+	CHECK (!__lookup (2), "class found that was not stored");
+
+	// code flags are part of the key
+	uint8_t bytes [CLASS_SIZE];
+	jvmtiClassDefinition class_def = __make_class (bytes, 1);
+	bool class_changed = false;
+	CHECK (
+		!class_cache_lookup (CODE_FLAGS + 1, &class_def, &class_changed),
+		"class found with other code flags"
+	);
+
+	// classes that were not modified
+	class_def = __make_class (bytes, 3);
+	class_cache_store (CODE_FLAGS, &class_def, NULL);
+
+	class_changed = true;
+	CHECK (
+		class_cache_lookup (CODE_FLAGS, &class_def, &class_changed),
+		"unmodified class not found"
+	);
+	CHECK (!class_changed, "unmodified class changed");
+	CHECK (class_def.class_bytes == bytes, "unmodified class bytes replaced");
+
+	class_cache_close ();
+	CHECK (!__lookup (1), "class found in a closed cache");
+
+	__remove_cache ();
+}
+
+
+static void
+test_hash_collision () {
+	CHECK (__open (0, FINGERPRINT), "cache not opened");
+
+	//
+	// Add an entry with the key of one class referring to the bytes of
+	// another class of the same size, as if the hashes of their bytes
+	// collided.
+	//
+	__store (1);
+
+	uint8_t bytes [CLASS_SIZE];
+	jvmtiClassDefinition class_def = __make_class (bytes, 1);
+	struct cache_entry * entry = __find_slot (
+		__class_hash (CODE_FLAGS, &class_def), CODE_FLAGS, CLASS_SIZE
+	);
+	CHECK (entry->hash != 0, "entry of the stored class not found");
+
+	class_def = __make_class (bytes, 2);
+	uint64_t hash = __class_hash (CODE_FLAGS, &class_def);
+	struct cache_entry * colliding = __find_slot (hash, CODE_FLAGS, CLASS_SIZE);
+	CHECK (colliding->hash == 0, "class found that was not stored");
+
+	*colliding = *entry;
+	colliding->hash = hash;
+	cache.header->count++;
+
+	CHECK (!__lookup (2), "class with colliding hash found");
+	CHECK (__lookup (1), "class with the original hash not found");
+
+	// the colliding class does not replace the entry
+	__store (2);
+	CHECK (!__lookup (2), "class with colliding hash stored");
+	CHECK (cache.header->count == 2, "class with colliding hash counted");
+
+	class_cache_close ();
+	__remove_cache ();
+}
+
+
+static bool in_flight_cleared;
+
+static void
+__clear_in_flight () {
+	read_hook = NULL;
+
+	mutex_lock (&cache.mutex);
+	__clear_entries ();
+	mutex_unlock (&cache.mutex);
+
+	in_flight_cleared = true;
+}
+
+
+static void
+test_clear_when_full () {
+	CHECK (__open (0, FINGERPRINT), "cache not opened");
+	CHECK (cache.header->capacity == CACHE_CAPACITY_MIN, "unexpected capacity");
+
+	// classes with odd seeds are the instrumented classes
+	for (uint32_t seed = 0; seed < 2 * FULL_COUNT; seed += 2) {
+		__store (seed);
+	}
+
+	CHECK (cache.header->count == FULL_COUNT, "full cache not filled");
+	CHECK (__lookup (0), "first class not found in a full cache");
+
+	// the next class starts a new generation
+	uint32_t generation = cache.header->generation;
+	__store (2 * FULL_COUNT);
+
+	CHECK (cache.header->generation == generation + 1, "generation not started");
+	CHECK (cache.header->count == 1, "full cache not cleared");
+	CHECK (!__lookup (0), "class of the previous generation found");
+	CHECK (__lookup (2 * FULL_COUNT), "class of the new generation not found");
+
+	struct stat blobs_stat;
+	CHECK (
+		fstat (cache.blobs_fd, &blobs_stat) == 0
+		&& blobs_stat.st_size == (off_t) cache.header->blobs_size,
+		"blobs of the previous generation kept"
+	);
+
+	//
+	// Clear the cache while a lookup reads the class bytes, the lookup
+	// must not return the bytes it has read.
+	//
+	in_flight_cleared = false;
+	read_hook = __clear_in_flight;
+
+	CHECK (!__lookup (2 * FULL_COUNT), "lookup returned a cleared class");
+	CHECK (in_flight_cleared, "cache not cleared during the lookup");
+	CHECK (!__lookup (2 * FULL_COUNT), "cleared class found");
+
+	__store (2 * FULL_COUNT);
+	CHECK (__lookup (2 * FULL_COUNT), "class not found after the clear");
+
+	class_cache_close ();
+	__remove_cache ();
+}
+
+
+static void
+test_reopen () {
+	CHECK (__open (0, FINGERPRINT), "cache not opened");
+	__store (1);
+	class_cache_close ();
+
+	// the same instrumentation finds the classes
+	CHECK (__open (0, FINGERPRINT), "cache not reopened");
+	CHECK (__lookup (1), "class not found after reopening");
+	class_cache_close ();
+
+	// other instrumentation clears the cache
+	CHECK (__open (0, OTHER_FINGERPRINT), "cache not reopened");
+	CHECK (!__lookup (1), "class found with another fingerprint");
+	__store (1);
+	class_cache_close ();
+
+	// so does another capacity
+	CHECK (__open (2 * CACHE_CAPACITY_MIN, OTHER_FINGERPRINT), "cache not reopened");
+	CHECK (
+		cache.header->capacity == 2 * CACHE_CAPACITY_MIN,
+		"capacity not changed"
+	);
+	CHECK (!__lookup (1), "class found with another capacity");
+	class_cache_close ();
+
+	__remove_cache ();
+}
+
+
+static void
+test_locked () {
+	CHECK (__open (0, FINGERPRINT), "cache not opened");
+	__store (1);
+
+	//
+	// The lock is held by the process, so the cache has to be opened by
+	// another process to fail.
+	//
+	fflush (NULL);
+	pid_t pid = fork ();
+	if (pid == 0) {
+		exit (__open (0, FINGERPRINT) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
+	int status;
+	CHECK (pid > 0 && waitpid (pid, &status, 0) == pid, "process not forked");
+	CHECK (
+		WIFEXITED (status) && WEXITSTATUS (status) == EXIT_SUCCESS,
+		"cache opened by a second process"
+	);
+
+	// the cache of the first process is intact
+	CHECK (__lookup (1), "class not found after the second process");
+
+	class_cache_close ();
+
+	// and the lock is released on close
+	pid = fork ();
+	if (pid == 0) {
+		exit (__open (0, FINGERPRINT) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	CHECK (pid > 0 && waitpid (pid, &status, 0) == pid, "process not forked");
+	CHECK (
+		WIFEXITED (status) && WEXITSTATUS (status) == EXIT_SUCCESS,
+		"cache not opened after closing"
+	);
+
+	__remove_cache ();
+}
+
+
+int
+main () {
+	if (mkdtemp (dir_name) == NULL) {
+		fprintf (stderr, "cannot create %s\n", dir_name);
+		return EXIT_FAILURE;
+	}
+
+	test_store_lookup ();
+	test_hash_collision ();
+	test_clear_when_full ();
+	test_reopen ();
+	test_locked ();
+
+	rmdir (dir_name);
+
+	if (failures > 0) {
+		fprintf (stderr, "classcache_test: %d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf ("classcache_test: OK\n");
+	return EXIT_SUCCESS;
+}
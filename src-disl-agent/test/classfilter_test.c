@@ -0,0 +1,216 @@
+/**
+ * Test of the class name patterns of the class filter. The patterns are
+ * read from the table shared with ClassFilterTest, which matches them with
+ * the server side WildCard class.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the pattern matching is internal to the class filter
+#include "../classfilter.c"
+
+
+#define PATTERNS_FILE \
+	"../src-test/ch/usi/dag/disl/test/junit/glob-patterns.resource"
+
+#define LINE_LENGTH_MAX 1024
+
+
+static int failures = 0;
+
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			fprintf (stderr, "%s:%d: ", __FILE__, __LINE__); \
+			fprintf (stderr, __VA_ARGS__); \
+			fprintf (stderr, "\n"); \
+			++failures; \
+		} \
+	} while (0)
+
+
+//
+
+static void
+__write_u8 (uint8_t ** pos, uint8_t value) {
+	*(*pos)++ = value;
+}
+
+
+static void
+__write_u32 (uint8_t ** pos, uint32_t value) {
+	for (int shift = 24; shift >= 0; shift -= 8) {
+		__write_u8 (pos, (uint8_t) (value >> shift));
+	}
+}
+
+
+/**
+ * Serializes a filter including only classes matching the given pattern,
+ * the same way as ClassFilter.toByteArray() on the server.
+ */
+static size_t
+__serialize_filter (const char * pattern, uint8_t * data) {
+	uint8_t * pos = data;
+	__write_u8 (&pos, FILTER_FORMAT_VERSION);
+	__write_u8 (&pos, 0);
+
+	// no required and no excluded classes
+	__write_u32 (&pos, 0);
+	__write_u32 (&pos, 0);
+
+	// patterns with only a trailing wild card are sent as prefixes
+	__write_u32 (&pos, 1);
+
+	size_t length = strlen (pattern);
+	const char * wild_card = strchr (pattern, '*');
+	if (wild_card == NULL) {
+		__write_u8 (&pos, PATTERN_EXACT);
+
+	} else if (wild_card == pattern + length - 1) {
+		__write_u8 (&pos, PATTERN_PREFIX);
+		length--;
+
+	} else {
+		__write_u8 (&pos, PATTERN_GLOB);
+	}
+
+	__write_u8 (&pos, (uint8_t) (length >> 8));
+	__write_u8 (&pos, (uint8_t) length);
+	memcpy (pos, pattern, length);
+
+	return (pos - data) + length;
+}
+
+
+static void
+__free_names (char ** names, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		free (names [i]);
+	}
+
+	free (names);
+}
+
+
+static void
+__reset_filter () {
+	__free_names (filter.included.exact, filter.included.exact_count);
+	__free_names (filter.included.prefixes, filter.included.prefix_count);
+	__free_names (filter.included.globs, filter.included.glob_count);
+	memset (&filter, 0, sizeof (filter));
+}
+
+
+/**
+ * Converts a class name in the form used by scopes to the internal form
+ * provided by JVMTI. Returns NULL if the name has no internal form.
+ */
+static char *
+__internal_class_name (const char * name) {
+	const char * prefix = DEFAULT_PACKAGE ".";
+	if (strncmp (name, prefix, strlen (prefix)) == 0) {
+		name += strlen (prefix);
+	}
+
+	char * result = strdup (name);
+	for (char * c = result; *c != '\0'; c++) {
+		*c = (*c == '.') ? '/' : *c;
+	}
+
+	return result;
+}
+
+
+static void
+__check_pattern (bool expected, const char * pattern, const char * name) {
+	uint8_t data [LINE_LENGTH_MAX + 32];
+	size_t size = __serialize_filter (pattern, data);
+
+	__reset_filter ();
+	CHECK (class_filter_init (data, size), "pattern \"%s\": invalid filter", pattern);
+
+	bool matches = __set_matches (&filter.included, name);
+	CHECK (
+		matches == expected, "pattern \"%s\", class \"%s\": expected %s",
+		pattern, name, expected ? "match" : "no match"
+	);
+
+	//
+	// Check the whole filter as well, for names that have
+	// the same form after converting them back and forth.
+	//
+	char * internal_name = __internal_class_name (name);
+	char * scope_name = __scope_class_name (internal_name);
+	if (strcmp (scope_name, name) == 0) {
+		bool accepted = class_filter_accepts (internal_name);
+		CHECK (
+			accepted == expected, "pattern \"%s\", class \"%s\": expected %s",
+			pattern, internal_name, expected ? "accepted" : "rejected"
+		);
+	}
+
+	free (scope_name);
+	free (internal_name);
+}
+
+
+/**
+ * Reads the pattern table, each line holds the expected result, the
+ * pattern, and the class name, separated by "|". Returns the number of
+ * patterns checked.
+ */
+static int
+__check_patterns (const char * file_name) {
+	FILE * file = fopen (file_name, "r");
+	if (file == NULL) {
+		fprintf (stderr, "cannot open %s\n", file_name);
+		exit (EXIT_FAILURE);
+	}
+
+	int count = 0;
+	char line [LINE_LENGTH_MAX];
+	while (fgets (line, sizeof (line), file) != NULL) {
+		line [strcspn (line, "\r\n")] = '\0';
+		if (line [0] == '\0' || line [0] == '#') {
+			continue;
+		}
+
+		char * pattern = strchr (line, '|');
+		char * name = (pattern != NULL) ? strchr (pattern + 1, '|') : NULL;
+		if (name == NULL || strchr (name + 1, '|') != NULL) {
+			fprintf (stderr, "malformed pattern line: %s\n", line);
+			exit (EXIT_FAILURE);
+		}
+
+		*pattern++ = '\0';
+		*name++ = '\0';
+
+		__check_pattern (strcmp (line, "yes") == 0, pattern, name);
+		count++;
+	}
+
+	fclose (file);
+	return count;
+}
+
+
+int
+main (int argc, char * argv []) {
+	const char * file_name = (argc > 1) ? argv [1] : PATTERNS_FILE;
+
+	int count = __check_patterns (file_name);
+	CHECK (count > 0, "no patterns in %s", file_name);
+
+	__reset_filter ();
+
+	if (failures > 0) {
+		fprintf (stderr, "classfilter_test: %d failures\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf ("classfilter_test: OK\n");
+	return EXIT_SUCCESS;
+}
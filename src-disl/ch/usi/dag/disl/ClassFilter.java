@@ -0,0 +1,176 @@
+package ch.usi.dag.disl;
+
+import java.io.ByteArrayOutputStream;
+import java.io.DataOutputStream;
+import java.io.IOException;
+import java.util.Collection;
+import java.util.Collections;
+import java.util.List;
+import java.util.Set;
+import java.util.TreeSet;
+
+import org.objectweb.asm.Type;
+
+import ch.usi.dag.disl.exception.DiSLFatalException;
+import ch.usi.dag.disl.scope.Scope;
+import ch.usi.dag.disl.scope.ScopeImpl;
+import ch.usi.dag.disl.scope.WildCard;
+import ch.usi.dag.disl.snippet.Snippet;
+
+/**
+ * Filter of class names compiled from the exclusion set and the snippet
+ * scopes. Classes rejected by the filter are never modified by DiSL, so the
+ * agent does not need to send them for instrumentation.
+ * <p>
+ * The filter is conservative. A class is rejected only if the exclusion set
+ * excludes all of its methods, or if the class part of no snippet scope
+ * matches its name. Required classes are always accepted. Class names are
+ * matched in the form used by scopes, i.e., with dots as package delimiters
+ * and with classes in the default package prefixed with "[default].".
+ * <p>
+ * The filter is serialized as follows:
+ * <ul>
+ * <li>byte - format version</li>
+ * <li>byte - flags, bit 0 is set if all classes are included</li>
+ * <li>required, excluded, and included patterns, each preceded by an int
+ * count of the patterns</li>
+ * </ul>
+ * Each pattern consists of a byte kind (exact name, prefix, or glob) and a
+ * modified UTF-8 string. Prefixes are stored without the trailing "*". Globs
+ * follow the semantics of {@link WildCard}.
+ */
+public final class ClassFilter {
+
+    private static final byte FORMAT_VERSION = 1;
+
+    private static final byte FLAG_INCLUDE_ALL = 1 << 0;
+
+    private static final byte KIND_EXACT = 0;
+    private static final byte KIND_PREFIX = 1;
+    private static final byte KIND_GLOB = 2;
+
+    // DiSL adds thread local variables to the thread class
+    private static final String THREAD_CLASS_NAME =
+            Type.getType(Thread.class).getClassName();
+
+    //
+
+    private final Set<String> required;
+
+    private final Set<String> excluded;
+
+    // null if all classes are included
+    private final Set<String> included;
+
+    //
+
+    private ClassFilter(final Set<String> required,
+            final Set<String> excluded, final Set<String> included) {
+        this.required = required;
+        this.excluded = excluded;
+        this.included = included;
+    }
+
+    /**
+     * Returns a filter accepting all classes.
+     */
+    static ClassFilter acceptAll() {
+        final Set<String> none = Collections.emptySet();
+        return new ClassFilter(none, none, null);
+    }
+
+    /**
+     * Compiles a filter from the exclusion set and the snippet scopes.
+     * Scopes of unknown implementation are treated as matching all classes.
+     */
+    static ClassFilter compile(
+            final Set<Scope> exclusionSet, final List<Snippet> snippets) {
+
+        final Set<String> required = new TreeSet<String>();
+        required.add(THREAD_CLASS_NAME);
+
+        // classes excluded as a whole
+        final Set<String> excluded = new TreeSet<String>();
+        for (final Scope scope : exclusionSet) {
+            if (scope instanceof ScopeImpl) {
+                final ScopeImpl scopeImpl = (ScopeImpl) scope;
+                final String classWildCard = scopeImpl.getClassWildCard();
+                if (classWildCard != null && scopeImpl.matchesAllMethods()) {
+                    excluded.add(classWildCard);
+                }
+            }
+        }
+
+        // classes matched by snippet scopes
+        Set<String> included = new TreeSet<String>();
+        for (final Snippet snippet : snippets) {
+            final Scope scope = snippet.getScope();
+            final String classWildCard = (scope instanceof ScopeImpl)
+                    ? ((ScopeImpl) scope).getClassWildCard() : null;
+
+            if (classWildCard == null
+                    || WildCard.WILDCARD_STR.equals(classWildCard)) {
+                included = null;
+                break;
+            }
+
+            included.add(classWildCard);
+        }
+
+        return new ClassFilter(required, excluded, included);
+    }
+
+    //
+
+    /**
+     * Returns the serialized filter.
+     */
+    public byte[] toByteArray() {
+        try {
+            final ByteArrayOutputStream result = new ByteArrayOutputStream();
+            final DataOutputStream dos = new DataOutputStream(result);
+
+            dos.writeByte(FORMAT_VERSION);
+            dos.writeByte((included == null) ? FLAG_INCLUDE_ALL : 0);
+
+            __writePatterns(dos, required);
+            __writePatterns(dos, excluded);
+            __writePatterns(dos, (included != null)
+                    ? included : Collections.<String>emptySet());
+
+            dos.flush();
+            return result.toByteArray();
+
+        } catch (final IOException e) {
+            throw new DiSLFatalException("Failed to serialize class filter", e);
+        }
+    }
+
+    private static void __writePatterns(final DataOutputStream dos,
+            final Collection<String> patterns) throws IOException {
+
+        dos.writeInt(patterns.size());
+        for (final String pattern : patterns) {
+            final int wildCard = pattern.indexOf(WildCard.WILDCARD_STR);
+
+            if (wildCard < 0) {
+                dos.writeByte(KIND_EXACT);
+                dos.writeUTF(pattern);
+
+            } else if (wildCard == pattern.length() - 1) {
+                dos.writeByte(KIND_PREFIX);
+                dos.writeUTF(pattern.substring(0, wildCard));
+
+            } else {
+                dos.writeByte(KIND_GLOB);
+                dos.writeUTF(pattern);
+            }
+        }
+    }
+
+    @Override
+    public String toString() {
+        return String.format("required=%s excluded=%s included=%s",
+                required, excluded, (included != null) ? included : "*");
+    }
+}
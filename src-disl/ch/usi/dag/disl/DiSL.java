@@ -11,6 +11,8 @@ import java.util.LinkedList;
 import java.util.List;
 import java.util.Map;
 import java.util.Set;
+import java.util.concurrent.ForkJoinPool;
+import java.util.concurrent.RecursiveAction;
 
 import org.objectweb.asm.ClassReader;
 import org.objectweb.asm.ClassWriter;
@@ -23,6 +25,8 @@ import ch.usi.dag.disl.cbloader.ClassByteLoader;
 import ch.usi.dag.disl.cbloader.ManifestHelper;
 import ch.usi.dag.disl.cbloader.ManifestHelper.ManifestInfo;
 import ch.usi.dag.disl.classparser.ClassParser;
+import ch.usi.dag.disl.coderep.Code;
+import ch.usi.dag.disl.coderep.StaticContextMethod;
 import ch.usi.dag.disl.exception.DiSLException;
 import ch.usi.dag.disl.exception.DiSLIOException;
 import ch.usi.dag.disl.exception.DiSLInMethodException;
@@ -39,13 +43,16 @@ import ch.usi.dag.disl.guard.GuardHelper;
 import ch.usi.dag.disl.localvar.SyntheticLocalVar;
 import ch.usi.dag.disl.localvar.ThreadLocalVar;
 import ch.usi.dag.disl.processor.Proc;
+import ch.usi.dag.disl.processor.ProcMethod;
 import ch.usi.dag.disl.processor.generator.PIResolver;
 import ch.usi.dag.disl.processor.generator.ProcGenerator;
 import ch.usi.dag.disl.processor.generator.ProcInstance;
 import ch.usi.dag.disl.processor.generator.ProcMethodInstance;
 import ch.usi.dag.disl.scope.Scope;
+import ch.usi.dag.disl.snippet.ProcInvocation;
 import ch.usi.dag.disl.snippet.Shadow;
 import ch.usi.dag.disl.snippet.Snippet;
+import ch.usi.dag.disl.snippet.SnippetCode;
 import ch.usi.dag.disl.staticcontext.generator.SCGenerator;
 import ch.usi.dag.disl.transformer.Transformer;
 import ch.usi.dag.disl.weaver.Weaver;
@@ -73,6 +80,18 @@ public final class DiSL {
     private final boolean       splitLongMethods        =
                                                                 Boolean.getBoolean(PROP_SPLIT_LONG_METHODS);
 
+    // classes with at least this many methods have their methods
+    // instrumented in parallel, zero disables parallel instrumentation
+    private final String        PROP_PARALLEL_METHODS   = "disl.parallelmethods";
+    private final int           parallelMethods         =
+                                                                Integer.getInteger(PROP_PARALLEL_METHODS, 128);
+
+    // number of methods instrumented by one fork-join task
+    private static final int    METHODS_PER_TASK        = 16;
+
+    // shared by all instrumenting threads, workers are started on demand
+    private static final ForkJoinPool methodPool        = new ForkJoinPool();
+
     private final boolean       useDynamicBypass;
 
     private final Transformer   transformer;
@@ -83,6 +102,8 @@ public final class DiSL {
 
     private final List<Snippet> snippets;
 
+    private final ClassFilter   classFilter;
+
     /**
      * DiSL initialization.
      *
@@ -147,6 +168,16 @@ public final class DiSL {
         // - it serves as initialization flag
         snippets = parsedSnippets;
 
+        // *** compile class filter ***
+        // transformers may modify any class, and even rename it
+        if (transformer == null) {
+            classFilter = ClassFilter.compile(exclusionSet, snippets);
+        } else {
+            classFilter = ClassFilter.acceptAll();
+        }
+
+        __debug("DiSL: class filter: %s\n", classFilter);
+
         // TODO put checker here
         // like After should catch normal and abnormal execution
         // but if you are using After (AfterThrowing) with BasicBlockMarker
@@ -156,6 +187,58 @@ public final class DiSL {
         // specify this for InstructionMarker
     }
 
+    /**
+     * Returns the filter of classes that may be modified by DiSL.
+     */
+    public ClassFilter getClassFilter() {
+        return classFilter;
+    }
+
+    /**
+     * Determines whether the snippets, the argument processors they invoke,
+     * or their guards use a static context of the given type.
+     */
+    public boolean usesStaticContext(final Class<?> type) {
+        for (final Snippet snippet : snippets) {
+            final SnippetCode code = snippet.getCode();
+            if (__referencesStaticContext(code, type)) {
+                return true;
+            }
+
+            for (final ProcInvocation pi : code.getInvokedProcessors().values()) {
+                for (final ProcMethod pm : pi.getProcessor().getMethods()) {
+                    if (__referencesStaticContext(pm.getCode(), type)) {
+                        return true;
+                    }
+                }
+            }
+
+            // guards receive static contexts as method parameters
+            final Method guard = snippet.getGuard();
+            if (guard != null) {
+                for (final Class<?> paramType : guard.getParameterTypes()) {
+                    if (type.isAssignableFrom(paramType)) {
+                        return true;
+                    }
+                }
+            }
+        }
+
+        return false;
+    }
+
+    private static boolean __referencesStaticContext(
+        final Code code, final Class<?> type
+    ) {
+        for (final StaticContextMethod scm : code.getStaticContexts()) {
+            if (type.isAssignableFrom(scm.getReferencedClass())) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     /**
      * Finds transformer class in configuration and allocates it.
      *
@@ -408,22 +491,25 @@ public final class DiSL {
         final Set<String> changedMethods = new HashSet<String>();
 
         // instrument all methods in a class
-        for (final MethodNode methodNode : classNode.methods) {
+        final MethodNode[] methods =
+                classNode.methods.toArray(new MethodNode[0]);
 
-            boolean methodChanged = false;
+        final boolean[] methodsChanged;
+        if (parallelMethods > 0 && methods.length >= parallelMethods) {
+            methodsChanged = instrumentMethodsInParallel(classNode, methods);
 
-            // intercept all exceptions and add a method name
-            try {
-                methodChanged = instrumentMethod(classNode, methodNode);
-            } catch (final DiSLException e) {
-
-                throw new DiSLInMethodException(
-                        classNode.name + "." + methodNode.name, e);
+        } else {
+            methodsChanged = new boolean[methods.length];
+            for (int i = 0; i < methods.length; ++i) {
+                methodsChanged[i] = instrumentMethodOf(classNode, methods[i]);
             }
+        }
 
-            // add method to the set of changed methods
-            if (methodChanged) {
-                changedMethods.add(methodNode.name + methodNode.desc);
+        // add methods to the set of changed methods - in the method order,
+        // regardless of how the methods were instrumented
+        for (int i = 0; i < methods.length; ++i) {
+            if (methodsChanged[i]) {
+                changedMethods.add(methods[i].name + methods[i].desc);
                 classChanged = true;
             }
         }
@@ -468,18 +554,111 @@ public final class DiSL {
         return null;
     }
 
+    /**
+     * Instruments a method and adds the method name to all exceptions.
+     */
+    private boolean instrumentMethodOf(
+            final ClassNode classNode, final MethodNode methodNode
+            ) throws DiSLException {
+
+        // intercept all exceptions and add a method name
+        try {
+            return instrumentMethod(classNode, methodNode);
+        } catch (final DiSLException e) {
+
+            throw new DiSLInMethodException(
+                    classNode.name + "." + methodNode.name, e);
+        }
+    }
+
+    /**
+     * Instruments methods of a class on the fork-join pool. Each method is
+     * changed only by the task instrumenting it, the class node itself is
+     * only read.
+     *
+     * @return for each method, whether the method was changed
+     */
+    private boolean[] instrumentMethodsInParallel(
+            final ClassNode classNode, final MethodNode[] methods
+            ) throws DiSLException {
+
+        final boolean[] changed = new boolean[methods.length];
+        final DiSLException[] failures = new DiSLException[methods.length];
+
+        methodPool.invoke(new MethodInstrumentationTask(
+                classNode, methods, changed, failures, 0, methods.length));
+
+        // report the failure of the first method - same as if the methods
+        // were instrumented sequentially
+        for (final DiSLException failure : failures) {
+            if (failure != null) {
+                throw failure;
+            }
+        }
+
+        return changed;
+    }
+
+    /**
+     * Instruments a range of methods, splitting the range into subtasks.
+     */
+    private final class MethodInstrumentationTask extends RecursiveAction {
+
+        private static final long serialVersionUID = 3870287326587135341L;
+
+        private final ClassNode         classNode;
+        private final MethodNode[]      methods;
+        private final boolean[]         changed;
+        private final DiSLException[]   failures;
+        private final int               from;
+        private final int               to;
+
+        MethodInstrumentationTask(final ClassNode classNode,
+                final MethodNode[] methods, final boolean[] changed,
+                final DiSLException[] failures, final int from, final int to) {
+            this.classNode = classNode;
+            this.methods = methods;
+            this.changed = changed;
+            this.failures = failures;
+            this.from = from;
+            this.to = to;
+        }
+
+        @Override
+        protected void compute() {
+
+            if (to - from > METHODS_PER_TASK) {
+                final int middle = (from + to) >>> 1;
+                invokeAll(
+                        new MethodInstrumentationTask(classNode, methods,
+                                changed, failures, from, middle),
+                        new MethodInstrumentationTask(classNode, methods,
+                                changed, failures, middle, to));
+                return;
+            }
+
+            for (int i = from; i < to; ++i) {
+                try {
+                    changed[i] = instrumentMethodOf(classNode, methods[i]);
+                } catch (final DiSLException e) {
+                    failures[i] = e;
+                }
+            }
+        }
+    }
+
     /**
      * Instruments array of bytes representing a class.
      *
+     * Note: This method is thread safe. Classes can be instrumented by
+     * several threads at once - each thread evaluates static contexts using
+     * its own static context instances.
+     *
      * @param classAsBytes
      *            class as array of bytes
      * @return instrumented class as array of bytes
      */
-    // TODO ! current static context interface does not allow to have nice
-    // synchronization - it should be redesigned such as the staticContextData
-    // also invokes the required method and returns result - if this method
-    // (and static context class itself) will be synchronized, it should work
-    public synchronized byte[] instrument(
+    public byte[] instrument(
             byte[] classAsBytes
             ) throws DiSLException {
         // keep the currently processed class around in case of errors
@@ -488,9 +667,12 @@ public final class DiSL {
         }
 
         // apply transformer first
+        // user transformers are not required to be thread safe
         if (transformer != null) {
             try {
-                classAsBytes = transformer.transform(classAsBytes);
+                synchronized (transformer) {
+                    classAsBytes = transformer.transform(classAsBytes);
+                }
             } catch (final Exception e) {
                 throw new TransformerException("Transformer error", e);
             }
@@ -564,7 +746,7 @@ public final class DiSL {
         return cw.toByteArray();
     }
 
-    private void __dumpClassToFile(
+    private synchronized void __dumpClassToFile(
             final byte[] classBytes, final String fileName
             ) throws DiSLIOException {
         try {
@@ -6,7 +6,8 @@ import java.util.Set;
 public class GuardMethod {
 
     private Method method;
-    private Set<Class<?>> argTypes;
+    // set once validated - possibly by several threads at once
+    private volatile Set<Class<?>> argTypes;
 
     public GuardMethod(Method method) {
         super();
@@ -14,16 +14,25 @@ public class SCResolver {
     // NOTE: This is internal DiSL cache. For user static context cache see
     // ch.usi.dag.disl.staticcontext.cache.StaticContextCache
 
-    private static SCResolver instance;
+    private static final SCResolver instance = new SCResolver ();
 
-    // list of static context instances
+    // static context instances of the current thread
     // validity of an instance is for whole instrumentation run
     // instances are created lazily when needed
-    private Map <Class <?>, Object>
-        staticContextInstances = new HashMap <Class <?>, Object> ();
-
-
-    public synchronized StaticContext getStaticContextInstance (
+    //
+    // Static contexts keep the shadow they are evaluated for (and possibly
+    // other data) in their fields, so each instrumenting thread works with
+    // its own instances.
+    private final ThreadLocal <Map <Class <?>, Object>>
+        staticContextInstances = new ThreadLocal <Map <Class <?>, Object>> () {
+            @Override
+            protected Map <Class <?>, Object> initialValue () {
+                return new HashMap <Class <?>, Object> ();
+            }
+        };
+
+
+    public StaticContext getStaticContextInstance (
         final Class <?> staticContextClass, final Shadow shadow
     ) throws ReflectionException {
         //
@@ -31,10 +40,12 @@ public class SCResolver {
         // cache it for later use. Populate it with shadow data and return it
         // as StaticContext interface.
         //
-        Object sc = staticContextInstances.get (staticContextClass);
+        final Map <Class <?>, Object> instances = staticContextInstances.get ();
+
+        Object sc = instances.get (staticContextClass);
         if (sc == null) {
             sc = ReflectionHelper.createInstance (staticContextClass);
-            staticContextInstances.put (staticContextClass, sc);
+            instances.put (staticContextClass, sc);
         }
 
         final StaticContext result = (StaticContext) sc;
@@ -43,10 +54,7 @@ public class SCResolver {
     }
 
 
-    public static synchronized SCResolver getInstance () {
-        if (instance == null) {
-            instance = new SCResolver ();
-        }
+    public static SCResolver getInstance () {
         return instance;
     }
 
@@ -389,6 +389,25 @@ public class ScopeImpl implements Scope {
     }
 
 
+    /**
+     * Returns the wild card matching the names of classes (with dots as
+     * package delimiters), or {@code null} if the scope matches all classes.
+     */
+    public String getClassWildCard () {
+        return classWildCard;
+    }
+
+
+    /**
+     * Determines whether the scope matches all methods of the classes it
+     * matches, regardless of their names, parameters and return types.
+     */
+    public boolean matchesAllMethods () {
+        return WildCard.WILDCARD_STR.equals (methodWildCard)
+            && paramsWildCard == null && returnWildCard == null;
+    }
+
+
     @Override
     public String toString () {
         final StringBuilder params = new StringBuilder ();
@@ -2,6 +2,7 @@ package ch.usi.dag.disl.staticcontext.generator;
 
 import java.lang.reflect.Method;
 import java.util.HashMap;
+import java.util.HashSet;
 import java.util.List;
 import java.util.Map;
 import java.util.Set;
@@ -108,9 +109,11 @@ public class SCGenerator {
                 // static data for snippets and processors can be evaluated
                 // and stored together
 
+                // the snippet code is shared by all instrumenting threads,
+                // collect the static contexts into a private set
                 final SnippetCode snippetCode = snippet.getCode ();
-                Set <StaticContextMethod>
-                    scMethods = snippetCode.getStaticContexts ();
+                Set <StaticContextMethod> scMethods =
+                    new HashSet <StaticContextMethod> (snippetCode.getStaticContexts ());
 
                 // add static contexts from all processors
                 for (ProcInvocation pi : snippetCode.getInvokedProcessors ().values ()) {
@@ -33,11 +33,15 @@ public class UniqueMethodId extends AbstractUniqueId {
 				+ ")";
 	}
 	
-	protected synchronized AbstractUniqueId getSingleton() {
+	protected AbstractUniqueId getSingleton() {
 		
-		if (instance == null) {
-			instance = new UniqueMethodId(new RandomId(), "methodid.txt");
+		// static context instances are confined to instrumenting threads,
+		// the singleton is shared by all of them
+		synchronized (UniqueMethodId.class) {
+			if (instance == null) {
+				instance = new UniqueMethodId(new RandomId(), "methodid.txt");
+			}
+			return instance;
 		}
-		return instance;
 	}
 }
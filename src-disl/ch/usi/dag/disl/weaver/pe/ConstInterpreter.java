@@ -581,13 +581,10 @@ public class ConstInterpreter extends Interpreter<ConstValue> {
         return new ConstValue(Math.min(d.size, w.size));
     }
 
-    private static ConstInterpreter instance;
+    // stateless - shared by all instrumenting threads
+    private static final ConstInterpreter instance = new ConstInterpreter();
 
     public static ConstInterpreter getInstance() {
-        if (instance == null) {
-            instance = new ConstInterpreter();
-        }
-
         return instance;
     }
 }
@@ -119,26 +119,30 @@ public class InvocationInterpreter {
         return registeredMethods.contains(getMethodID(min));
     }
 
-    private static InvocationInterpreter instance;
+    // created eagerly - the registered methods are only read afterwards,
+    // so the instance can be shared by all instrumenting threads
+    private static final InvocationInterpreter instance =
+            createInstance();
+
+    private static InvocationInterpreter createInstance() {
+
+        InvocationInterpreter result = new InvocationInterpreter();
+
+        result.register(Boolean.class);
+        result.register(Byte.class);
+        result.register(Character.class);
+        result.register(Double.class);
+        result.register(Float.class);
+        result.register(Integer.class);
+        result.register(Long.class);
+        result.register(Short.class);
+        result.register(String.class);
+        result.register(StringBuilder.class);
+
+        return result;
+    }
 
     public static InvocationInterpreter getInstance() {
-
-        if (instance == null) {
-
-            instance = new InvocationInterpreter();
-
-            instance.register(Boolean.class);
-            instance.register(Byte.class);
-            instance.register(Character.class);
-            instance.register(Double.class);
-            instance.register(Float.class);
-            instance.register(Integer.class);
-            instance.register(Long.class);
-            instance.register(Short.class);
-            instance.register(String.class);
-            instance.register(StringBuilder.class);
-        }
-
         return instance;
     }
 }
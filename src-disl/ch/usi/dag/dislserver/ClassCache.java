@@ -0,0 +1,442 @@
+package ch.usi.dag.dislserver;
+
+import java.io.ByteArrayOutputStream;
+import java.io.DataOutputStream;
+import java.io.File;
+import java.io.IOException;
+import java.io.InputStream;
+import java.net.JarURLConnection;
+import java.net.URL;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.StandardCopyOption;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+import java.util.Iterator;
+import java.util.LinkedHashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.UUID;
+
+import ch.usi.dag.disl.cbloader.ClassByteLoader;
+import ch.usi.dag.disl.cbloader.ManifestHelper;
+import ch.usi.dag.disl.cbloader.ManifestHelper.ManifestInfo;
+import ch.usi.dag.disl.exception.DiSLException;
+import ch.usi.dag.disl.util.Logging;
+import ch.usi.dag.util.logging.Logger;
+
+
+/**
+ * Cache of instrumentation results, shared by all connections.
+ * <p>
+ * The results are keyed by a digest of the original class bytes, the code
+ * option flags of the request, and the fingerprint of the instrumentation.
+ * The fingerprint covers the instrumentation jar (or the DiSL classes, if
+ * not loaded from a jar) and the server properties affecting the woven code,
+ * so that entries stored on disk are not reused with a different
+ * instrumentation.
+ * <p>
+ * The memory tier holds the most recently used results up to a limit on
+ * their total size. The optional disk tier keeps all results, one file per
+ * result, and survives server restarts. Classes that were not modified are
+ * cached as well.
+ */
+final class ClassCache {
+
+    private static final Logger __log = Logging.getPackageInstance ();
+
+    //
+
+    private static final String PROP_CACHE = "dislserver.cache";
+    private static final boolean enabled = Boolean.parseBoolean (
+        System.getProperty (PROP_CACHE, "true")
+    );
+
+    private static final String PROP_CACHE_SIZE = "dislserver.cacheSize";
+    private static final int DEFAULT_CACHE_SIZE = 64;
+
+    private static final String PROP_CACHE_DIR = "dislserver.cacheDir";
+    private static final String cacheDir = System.getProperty (PROP_CACHE_DIR, null);
+
+    // exclusion list read by DiSL
+    private static final String PROP_EXCLUSION_LIST = "disl.exclusionList";
+
+    // server properties changing the instrumented code - the other
+    // properties read while instrumenting only control logging, dumping and
+    // parallelism, or name files digested on their own (DiSL classes,
+    // exclusion list)
+    private static final String [] __CODE_PROPERTIES__ = {
+        "dislserver.disablebypass", "disl.noexcepthandler", "disl.splitmethods",
+        "disl.parteval"
+    };
+
+    private static final String DIGEST_ALGORITHM = "SHA-256";
+
+    // generation of the unique ids assigned by this server run, the ids are
+    // not persisted, so every run starts a new generation
+    private static final UUID __idGeneration = UUID.randomUUID ();
+
+    // accounted for each entry in memory besides the class bytes, so that
+    // classes that were not modified are limited as well
+    private static final int ENTRY_OVERHEAD = 128;
+
+    private static final String ENTRY_EXT = ".class";
+    private static final String TEMP_EXT = ".tmp";
+
+    /**
+     * Result representing a class that was not modified.
+     */
+    static final byte [] NOT_MODIFIED = new byte [0];
+
+    //
+
+    private final byte [] __fingerprint;
+    private final long __maxBytes;
+    private final File __dir;
+
+    // guarded by "this"
+    private final Map <String, byte []> __entries;
+    private long __bytes;
+
+    private long __hits;
+    private long __diskHits;
+    private long __misses;
+
+    //
+
+    private ClassCache (
+        final byte [] fingerprint, final long maxBytes, final File dir
+    ) {
+        __fingerprint = fingerprint;
+        __maxBytes = maxBytes;
+        __dir = dir;
+
+        // access ordered, the eldest entry is the least recently used
+        __entries = new LinkedHashMap <String, byte []> (256, 0.75f, true);
+    }
+
+    //
+
+    /**
+     * Computes the cache key of a class.
+     */
+    String keyOf (final byte [] classBytes, final int flags) {
+        final MessageDigest digest = __newDigest ();
+        digest.update (__fingerprint);
+        digest.update (new byte [] {
+            (byte) (flags >>> 24), (byte) (flags >>> 16),
+            (byte) (flags >>> 8), (byte) flags
+        });
+
+        digest.update (classBytes);
+        return __toHex (digest.digest ());
+    }
+
+
+    /**
+     * Returns the cached result for the given key, {@link #NOT_MODIFIED} if
+     * the class was not modified, or {@code null} if the result is not
+     * cached.
+     */
+    byte [] get (final String key) {
+        synchronized (this) {
+            final byte [] result = __entries.get (key);
+            if (result != null) {
+                __hits++;
+                return result;
+            }
+        }
+
+        final byte [] result = __load (key);
+
+        synchronized (this) {
+            if (result != null) {
+                __diskHits++;
+                __put (key, result);
+            } else {
+                __misses++;
+            }
+        }
+
+        return result;
+    }
+
+
+    /**
+     * Caches the result of instrumenting a class.
+     *
+     * @param result
+     *      the instrumented class bytes, or {@link #NOT_MODIFIED}
+     */
+    void put (final String key, final byte [] result) {
+        synchronized (this) {
+            __put (key, result);
+        }
+
+        __store (key, result);
+    }
+
+
+    private void __put (final String key, final byte [] result) {
+        final byte [] previous = __entries.put (key, result);
+        if (previous != null) {
+            __bytes -= __sizeOf (previous);
+        }
+
+        __bytes += __sizeOf (result);
+
+        final Iterator <byte []> eldest = __entries.values ().iterator ();
+        while (__bytes > __maxBytes && eldest.hasNext ()) {
+            __bytes -= __sizeOf (eldest.next ());
+            eldest.remove ();
+        }
+    }
+
+
+    private static long __sizeOf (final byte [] result) {
+        return result.length + ENTRY_OVERHEAD;
+    }
+
+    //
+
+    private File __entryFile (final String key) {
+        // spread the entries over subdirectories
+        return new File (
+            new File (__dir, key.substring (0, 2)), key + ENTRY_EXT
+        );
+    }
+
+
+    private byte [] __load (final String key) {
+        if (__dir == null) {
+            return null;
+        }
+
+        final File file = __entryFile (key);
+        if (!file.isFile ()) {
+            return null;
+        }
+
+        try {
+            final byte [] result = Files.readAllBytes (file.toPath ());
+            return (result.length == 0) ? NOT_MODIFIED : result;
+
+        } catch (final IOException ioe) {
+            __log.warn ("failed to read cached class %s: %s", file, ioe.getMessage ());
+            return null;
+        }
+    }
+
+
+    private void __store (final String key, final byte [] result) {
+        if (__dir == null) {
+            return;
+        }
+
+        //
+        // Write the entry to a temporary file and move it in place, so that
+        // other connections (or servers) sharing the directory never see a
+        // partially written entry.
+        //
+        final File file = __entryFile (key);
+        final File parent = file.getParentFile ();
+        parent.mkdirs ();
+
+        try {
+            final Path temp = Files.createTempFile (parent.toPath (), key, TEMP_EXT);
+            try {
+                Files.write (temp, result);
+                Files.move (
+                    temp, file.toPath (),
+                    StandardCopyOption.REPLACE_EXISTING,
+                    StandardCopyOption.ATOMIC_MOVE
+                );
+
+            } finally {
+                Files.deleteIfExists (temp);
+            }
+
+        } catch (final IOException ioe) {
+            __log.warn ("failed to store cached class %s: %s", file, ioe.getMessage ());
+        }
+    }
+
+    //
+
+    synchronized void logStatistics () {
+        __log.debug (
+            "class cache: %d hits (%d from disk), %d misses, %d classes (%d bytes) in memory",
+            __hits + __diskHits, __diskHits, __misses, __entries.size (), __bytes
+        );
+    }
+
+    //
+
+    /**
+     * Creates a cache for the instrumentation with the given fingerprint.
+     * The disk tier is only used if the instrumented classes can be reused
+     * by another server run, i.e., if {@code persistent} is {@code true}.
+     *
+     * @return the cache, or {@code null} if caching is disabled.
+     */
+    static ClassCache newInstance (
+        final byte [] fingerprint, final boolean persistent
+    ) throws DiSLServerException {
+        if (!enabled) {
+            return null;
+        }
+
+        final long maxBytes = Math.max (
+            0, Integer.getInteger (PROP_CACHE_SIZE, DEFAULT_CACHE_SIZE)
+        ) * 1024L * 1024L;
+
+        File dir = null;
+        if (cacheDir != null && !persistent) {
+            __log.warn (
+                "class cache disk tier disabled, instrumentation uses run-specific ids"
+            );
+
+        } else if (cacheDir != null) {
+            dir = new File (cacheDir);
+            dir.mkdirs ();
+            if (!dir.isDirectory ()) {
+                throw new DiSLServerException (
+                    "cannot create class cache directory " + cacheDir
+                );
+            }
+        }
+
+        __log.debug (
+            "class cache enabled [%d MiB, %s], instrumentation %s",
+            maxBytes >>> 20, (dir != null) ? dir : "no disk tier",
+            __toHex (fingerprint)
+        );
+
+        return new ClassCache (fingerprint, maxBytes, dir);
+    }
+
+
+    /**
+     * Computes the fingerprint of the instrumentation used by the server.
+     * Results of instrumenting the same class are only reusable if the
+     * fingerprints match. The fingerprint of an instrumentation that is not
+     * {@code persistent} includes the id generation of this server run, so
+     * that classes instrumented by another run are never reused.
+     */
+    static byte [] instrumentationFingerprint (final boolean persistent)
+    throws DiSLServerException {
+        final MessageDigest digest = __newDigest ();
+
+        try {
+            //
+            // Digest the whole instrumentation jar if there is one, because
+            // besides the DiSL classes, it contains the markers, static
+            // contexts, guards and the transformer used by the classes.
+            // Otherwise digest the DiSL classes.
+            //
+            final File jar = __instrumentationJar ();
+            if (jar != null) {
+                digest.update (Files.readAllBytes (jar.toPath ()));
+
+            } else {
+                final List <InputStream> classes = ClassByteLoader.loadDiSLClasses ();
+                if (classes != null) {
+                    for (final InputStream is : classes) {
+                        __update (digest, is);
+                    }
+                }
+            }
+
+            final String exclusionList = System.getProperty (PROP_EXCLUSION_LIST);
+            if (exclusionList != null) {
+                digest.update (Files.readAllBytes (new File (exclusionList).toPath ()));
+            }
+
+            final ByteArrayOutputStream properties = new ByteArrayOutputStream ();
+            final DataOutputStream dos = new DataOutputStream (properties);
+            for (final String name : __CODE_PROPERTIES__) {
+                dos.writeUTF (name);
+                dos.writeUTF (String.valueOf (System.getProperty (name)));
+            }
+
+            if (!persistent) {
+                dos.writeLong (__idGeneration.getMostSignificantBits ());
+                dos.writeLong (__idGeneration.getLeastSignificantBits ());
+            }
+
+            digest.update (properties.toByteArray ());
+            return digest.digest ();
+
+        } catch (final IOException | DiSLException e) {
+            throw new DiSLServerException (
+                "failed to fingerprint instrumentation", e
+            );
+        }
+    }
+
+
+    private static File __instrumentationJar ()
+    throws IOException, DiSLException {
+        final ManifestInfo mi = ManifestHelper.getDiSLManifestInfo ();
+        if (mi == null) {
+            return null;
+        }
+
+        final URL resource = mi.getResource ();
+        if (!"jar".equals (resource.getProtocol ())) {
+            return null;
+        }
+
+        final URL jarUrl = ((JarURLConnection) resource.openConnection ()).getJarFileURL ();
+        if (!"file".equals (jarUrl.getProtocol ())) {
+            return null;
+        }
+
+        try {
+            return new File (jarUrl.toURI ());
+
+        } catch (final Exception e) {
+            return null;
+        }
+    }
+
+
+    private static void __update (
+        final MessageDigest digest, final InputStream is
+    ) throws IOException {
+        try {
+            final byte [] buffer = new byte [8192];
+            int count;
+            while ((count = is.read (buffer)) > 0) {
+                digest.update (buffer, 0, count);
+            }
+
+        } finally {
+            is.close ();
+        }
+    }
+
+
+    private static MessageDigest __newDigest () {
+        try {
+            return MessageDigest.getInstance (DIGEST_ALGORITHM);
+
+        } catch (final NoSuchAlgorithmException nsae) {
+            // every Java platform is required to support SHA-256
+            throw new AssertionError (nsae);
+        }
+    }
+
+
+    private static String __toHex (final byte [] bytes) {
+        final char [] digits = "0123456789abcdef".toCharArray ();
+        final char [] result = new char [bytes.length * 2];
+        for (int i = 0; i < bytes.length; i++) {
+            result [2 * i] = digits [(bytes [i] >>> 4) & 0xf];
+            result [2 * i + 1] = digits [bytes [i] & 0xf];
+        }
+
+        return new String (result);
+    }
+
+}
@@ -46,6 +46,15 @@ final class Message {
         return (__control.length == 0) && (__payload.length == 0);
     }
 
+
+    /**
+     * Determines whether the message is a query. Queries carry no class
+     * bytecode, the control part contains the name of the query.
+     */
+    public boolean isQuery () {
+        return (__control.length != 0) && (__payload.length == 0);
+    }
+
     //
 
     /**
@@ -74,6 +83,21 @@ final class Message {
         return new Message (0, __EMPTY_ARRAY__, __EMPTY_ARRAY__);
     }
 
+    /**
+     * Creates a message containing the answer to a query.
+     *
+     * @param answer
+     *      the answer to the query.
+     */
+    public static Message createQueryResponse (final byte [] answer) {
+        //
+        // The flags are all reset, the control part of the network message
+        // is empty, and the payload contains the answer.
+        //
+        return new Message (0, __EMPTY_ARRAY__, answer);
+    }
+
+
     /**
      * Creates a message indicating a server-side error.
      */
@@ -13,6 +13,7 @@ import java.util.UUID;
 import ch.usi.dag.disl.DiSL;
 import ch.usi.dag.disl.DiSL.CodeOption;
 import ch.usi.dag.disl.exception.DiSLException;
+import ch.usi.dag.disl.staticcontext.uid.AbstractUniqueId;
 import ch.usi.dag.disl.util.Constants;
 import ch.usi.dag.disl.util.Logging;
 import ch.usi.dag.util.Strings;
@@ -36,17 +37,38 @@ final class RequestProcessor {
 
     //
 
+    // answered with the fingerprint of the instrumentation
+    private static final String QUERY_FINGERPRINT = "fingerprint";
+
+    // answered with the filter of classes that may be instrumented
+    private static final String QUERY_FILTER = "filter";
+
+    //
+
     private final DiSL __disl;
 
+    private final byte [] __fingerprint;
+
+    // null if caching is disabled
+    private final ClassCache __cache;
+
     //
 
-    private RequestProcessor (final DiSL disl) {
+    private RequestProcessor (
+        final DiSL disl, final byte [] fingerprint, final ClassCache cache
+    ) {
         __disl = disl;
+        __fingerprint = fingerprint;
+        __cache = cache;
     }
 
     //
 
     public Message process (final Message request) throws DiSLServerException {
+        if (request.isQuery ()) {
+            return __answer (new String (request.control ()));
+        }
+
         final byte [] classBytes = request.payload ();
         final String className = __getClassName (request.control (), classBytes);
         final Set <CodeOption> options = CodeOption.setOf (request.flags ());
@@ -73,7 +95,7 @@ final class RequestProcessor {
             // TODO: instrument the bytecode according to given options
             // byte [] instrCode = disl.instrument (origCode, options);
 
-            final byte [] newClassBytes = __disl.instrument (classBytes);
+            final byte [] newClassBytes = __instrument (classBytes, request.flags ());
 
             if (newClassBytes != null) {
                 if (instrPath != null) {
@@ -98,6 +120,46 @@ final class RequestProcessor {
     }
 
 
+    private Message __answer (final String query) throws DiSLServerException {
+        __log.debug ("answering query %s", query);
+
+        if (QUERY_FINGERPRINT.equals (query)) {
+            return Message.createQueryResponse (__fingerprint);
+
+        } else if (QUERY_FILTER.equals (query)) {
+            return Message.createQueryResponse (
+                __disl.getClassFilter ().toByteArray ()
+            );
+
+        } else {
+            throw new DiSLServerException ("unknown query: " + query);
+        }
+    }
+
+
+    /**
+     * Instruments the class, or looks up the result of instrumenting the
+     * same class earlier. Failures are not cached.
+     */
+    private byte [] __instrument (
+        final byte [] classBytes, final int flags
+    ) throws DiSLException {
+        if (__cache == null) {
+            return __disl.instrument (classBytes);
+        }
+
+        final String key = __cache.keyOf (classBytes, flags);
+        final byte [] cachedBytes = __cache.get (key);
+        if (cachedBytes != null) {
+            return (cachedBytes != ClassCache.NOT_MODIFIED) ? cachedBytes : null;
+        }
+
+        final byte [] result = __disl.instrument (classBytes);
+        __cache.put (key, (result != null) ? result : ClassCache.NOT_MODIFIED);
+        return result;
+    }
+
+
     private static String __getFullMessage (final Throwable t) {
         final StringWriter result = new StringWriter ();
         t.printStackTrace (new PrintWriter (result));
@@ -243,6 +305,10 @@ final class RequestProcessor {
     //
 
     public void terminate () {
+        if (__cache != null) {
+            __cache.logStatistics ();
+        }
+
         __disl.terminate ();
     }
 
@@ -252,7 +318,13 @@ final class RequestProcessor {
         try {
             // TODO LB: Configure bypass on a per-request basis.
             final DiSL disl = new DiSL (bypass);
-            return new RequestProcessor (disl);
+
+            // unique ids are only valid in the run that assigned them
+            final boolean persistent = !disl.usesStaticContext (AbstractUniqueId.class);
+            final byte [] fingerprint = ClassCache.instrumentationFingerprint (persistent);
+            return new RequestProcessor (
+                disl, fingerprint, ClassCache.newInstance (fingerprint, persistent)
+            );
 
         } catch (final DiSLException de) {
             throw new DiSLServerException ("failed to initialize DiSL", de);
@@ -13,6 +13,7 @@
 
 #include "dislreagent.h"
 
+#include "shared/spinlock.h"
 #include "shared/threadlocal.h"
 
 #include "pbmanager.h"
@@ -22,6 +23,7 @@
 #include "globalbuffer.h"
 #include "tlocalbuffer.h"
 #include "freehandler.h"
+#include "netref.h"
 
 #include "../src-disl-agent/jvmtiutil.h"
 
@@ -101,6 +103,8 @@ void JNICALL jvmti_callback_vm_death_hook(jvmtiEnv *jvmti_env, JNIEnv* jni_env)
 
   pb_free();
 
+  sl_print_stats();
+
   // NOTE: If we clean up, and daemon thread will use the structures,
   // it will crash. It is then better to leave it all as is.
   // dealloc buffers
@@ -200,16 +204,17 @@ Agent_OnLoad(JavaVM *jvm, char *options, void *reserved) {
       JVMTI_EVENT_THREAD_END, NULL);
   check_jvmti_error(jvmti_env, error, "Cannot set thread end hook");
 
+  // net reference layout has to be known before anything is tagged
+  net_ref_init(jvmti_env);
+
   // init blocking queues
-  redispatcher_init(jvmti_env);
   glbuffer_init(jvmti_env);
-  tl_init(jvmti_env);
 
   fh_init(jvmti_env);
 
   pb_init();
   tagger_init(jvm, jvmti_env);
-  sender_init(options);
+  sender_init(jvmti_env, options);
 
   sender_connect();
 
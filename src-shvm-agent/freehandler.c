@@ -1,84 +1,183 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
 #include "freehandler.h"
 
 #include "shared/buffer.h"
-#include "shared/buffpack.h"
 #include "shared/messagetype.h"
+#include "shared/spinlock.h"
+#include "shared/threadlocal.h"
 
+#include "netref.h"
 #include "pbmanager.h"
 #include "sender.h"
 
 #include "../src-disl-agent/jvmtiutil.h"
 
-static jvmtiEnv * jvmti_env;
-static jrawMonitorID obj_free_lock;
-
 #define MAX_OBJ_FREE_EVENTS 4096
 
-static process_buffs * obj_free_buff = NULL;
-static jint obj_free_event_count = 0;
-static size_t obj_free_event_count_pos = 0;
+// Object free events are generated by the GC (possibly by several GC worker
+// threads at once), so the time spent here is added directly to GC pauses.
+// Every thread appends freed tags into its own chunk, without touching any
+// shared lock. When the chunk fills up, its tag array is swapped with a
+// spare one, and the message is created and queued for sending after the
+// chunk lock is released. The sent array then becomes the spare again.
+//
+// Threads are mapped to chunks on the first object free event. If there are
+// more threads than chunks, some threads share a chunk. The chunk lock is
+// then the only point of contention - it is otherwise acquired only by the
+// owner and by the flushing thread at VM death.
+
+typedef struct {
+  // held while the chunk is being filled or sealed
+  spin_lock lock;
+
+  jint event_count;
+  jlong * tags;
+
+  // array swapped in when the chunk fills up, NULL while it is being sent
+  jlong * spare;
+} __attribute__((aligned(64))) obj_free_chunk;
+
+static obj_free_chunk obj_free_chunks[OBJ_FREE_CHUNKS];
+
+// next chunk to be assigned to a thread
+static atomic_uint next_chunk = ATOMIC_VAR_INIT(0);
+
+static jlong * _tags_alloc() {
+  jlong * tags = malloc(MAX_OBJ_FREE_EVENTS * sizeof(jlong));
+  check_error(tags == NULL, "Cannot allocate object free chunk");
+  return tags;
+}
 
 void fh_init(jvmtiEnv *env) {
-  jvmti_env = env;
+  for (int i = 0; i < OBJ_FREE_CHUNKS; ++i) {
+    obj_free_chunk * chunk = &(obj_free_chunks[i]);
 
-  jvmtiError error = (*jvmti_env)->CreateRawMonitor(jvmti_env, "obj free",
-      &obj_free_lock);
-  check_jvmti_error(jvmti_env, error, "Cannot create raw monitor");
+    sl_create(&(chunk->lock), env, "object free chunk");
+    chunk->event_count = 0;
+    chunk->tags = _tags_alloc();
+    chunk->spare = _tags_alloc();
+  }
 }
 
-void fh_object_free(jlong tag) {
-  enter_critical_section(jvmti_env, obj_free_lock);
+static inline void _chunk_lock(obj_free_chunk * chunk) {
+  sl_enter(&(chunk->lock));
+}
+
+static inline void _chunk_unlock(obj_free_chunk * chunk) {
+  sl_exit(&(chunk->lock));
+}
+
+static obj_free_chunk * _chunk_for_thread() {
+  tldata * tld = tld_get();
+
+  if (tld->obj_free_chunk == INVALID_CHUNK_ID) {
+    unsigned int chunk_id = atomic_fetch_add_explicit(&next_chunk, 1,
+        memory_order_relaxed);
+    tld->obj_free_chunk = chunk_id % OBJ_FREE_CHUNKS;
+  }
+
+  return &(obj_free_chunks[tld->obj_free_chunk]);
+}
+
+// chunk has to be locked, moves the freed tags out of the chunk
+static jlong * _chunk_take(obj_free_chunk * chunk, jint * count) {
+  jlong * tags = chunk->tags;
+  *count = chunk->event_count;
+
+  // the spare is only missing if the chunk filled up again while it was
+  // being sent by another thread mapped to the chunk
+  chunk->tags = (chunk->spare != NULL) ? chunk->spare : _tags_alloc();
+  chunk->spare = NULL;
+
+  chunk->event_count = 0;
+  return tags;
+}
+
+// returns the sent tag array to the chunk as its spare
+static void _chunk_recycle(obj_free_chunk * chunk, jlong * tags) {
+  _chunk_lock(chunk);
   {
-    // allocate new obj free buffer
-    if (obj_free_buff == NULL) {
-      // obtain buffer
-      obj_free_buff = pb_utility_get();
-      // reset number of events in the buffer
-      obj_free_event_count = 0;
-      // get pointer to the location where count of requests will stored
-      obj_free_event_count_pos = messager_objfree_header(
-          obj_free_buff->analysis_buff);
+    if (chunk->spare == NULL) {
+      chunk->spare = tags;
+      tags = NULL;
     }
+  }
+  _chunk_unlock(chunk);
 
-    // obtain message buffer
-    buffer * buff = obj_free_buff->analysis_buff;
-    messager_objfree_item(buff, tag);
-
-    // update the number of free events
-    ++obj_free_event_count;
-    buff_put_int(buff, obj_free_event_count_pos, obj_free_event_count);
-
-    if (obj_free_event_count >= MAX_OBJ_FREE_EVENTS) {
-      // NOTE: We can queue buffer to the sending queue. This is because
-      // object tagging thread is first sending the objects and then
-      // deallocating the global references. We cannot have here objects
-      // that weren't send already
-
-      // NOTE2: It is mandatory to submit to the sending queue directly
-      // because gc (that is generating these events) will block the
-      // tagging thread. And with not working tagging thread, we can
-      // run out of buffers.
-      sender_enqueue(obj_free_buff);
-
-      // cleanup
-      obj_free_buff = NULL;
-      obj_free_event_count = 0;
-      obj_free_event_count_pos = 0;
-    }
+  free(tags);
+}
 
+// Sends the freed tags. Called without holding the chunk lock, because
+// obtaining a buffer (and queuing it) may block until the sending threads
+// catch up, and other threads mapped to the same chunk would otherwise
+// stall in the GC callback as well.
+static void _send_tags(jlong * tags, jint count) {
+  // obtain buffer
+  process_buffs * pb = pb_utility_get();
+
+  messager_objfree_header(pb->analysis_buff, count);
+  messager_objfree_tags(pb->analysis_buff, tags, count);
+
+  // NOTE: We can queue buffer to the sending queue. This is because
+  // object tagging thread is first sending the objects and then
+  // deallocating the global references. We cannot have here objects
+  // that weren't send already
+
+  // NOTE2: It is mandatory to submit to the sending queue directly
+  // because gc (that is generating these events) will block the
+  // tagging thread. And with not working tagging thread, we can
+  // run out of buffers.
+  sender_enqueue(pb);
+
+  // class ids of unloaded classes can be reused once the free event is queued
+  for (jint i = 0; i < count; ++i) {
+    net_ref_class_freed(tags[i]);
   }
-  exit_critical_section(jvmti_env, obj_free_lock);
 }
 
-void fh_send_buffer() {
-  // send object free buffer - with lock
-  enter_critical_section(jvmti_env, obj_free_lock);
+void fh_object_free(jlong tag) {
+  obj_free_chunk * chunk = _chunk_for_thread();
+
+  // filled chunk is moved here and sent after unlocking
+  jlong * sealed = NULL;
+  jint sealed_count = 0;
+
+  _chunk_lock(chunk);
   {
-    if (obj_free_buff != NULL) {
-      sender_enqueue(obj_free_buff);
-      obj_free_buff = NULL;
+    chunk->tags[chunk->event_count] = tag;
+
+    if (++(chunk->event_count) >= MAX_OBJ_FREE_EVENTS) {
+      sealed = _chunk_take(chunk, &sealed_count);
     }
   }
-  exit_critical_section(jvmti_env, obj_free_lock);
+  _chunk_unlock(chunk);
+
+  if (sealed != NULL) {
+    _send_tags(sealed, sealed_count);
+    _chunk_recycle(chunk, sealed);
+  }
 }
 
+void fh_send_buffer() {
+  // seal and send all partially filled chunks
+  for (int i = 0; i < OBJ_FREE_CHUNKS; ++i) {
+    obj_free_chunk * chunk = &(obj_free_chunks[i]);
+
+    jlong * sealed = NULL;
+    jint sealed_count = 0;
+
+    _chunk_lock(chunk);
+    if (chunk->event_count > 0) {
+      sealed = _chunk_take(chunk, &sealed_count);
+    }
+    _chunk_unlock(chunk);
+
+    if (sealed != NULL) {
+      _send_tags(sealed, sealed_count);
+      _chunk_recycle(chunk, sealed);
+    }
+  }
+}
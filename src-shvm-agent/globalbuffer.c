@@ -3,6 +3,7 @@
 #include "shared/threadlocal.h"
 #include "shared/buffpack.h"
 #include "shared/messagetype.h"
+#include "shared/spinlock.h"
 
 #include "pbmanager.h"
 #include "tagger.h"
@@ -14,17 +15,15 @@
 
 #define TO_BUFFER_COUNT (TO_BUFFER_MAX_ID + 1) // +1 for buffer id 0
 
-static jrawMonitorID to_buff_lock;
+static spin_lock to_buff_lock;
 static to_buff_struct to_buff_array[TO_BUFFER_COUNT];
 
 static jvmtiEnv *jvmti_env;
 
 void glbuffer_init(jvmtiEnv *env) {
   jvmti_env = env;
-  jvmtiError error;
 
-  error = (*jvmti_env)->CreateRawMonitor(jvmti_env, "buffids", &to_buff_lock);
-  check_jvmti_error(jvmti_env, error, "Cannot create raw monitor");
+  sl_create(&to_buff_lock, jvmti_env, "buffids");
 
   // initialize total ordering buff array
   for (int i = 0; i < TO_BUFFER_COUNT; ++i) {
@@ -63,7 +62,7 @@ static void correct_cmd_buff_pos(buffer * cmd_buff, size_t shift) {
 void glbuffer_commit() {
   tldata * tld = tld_get();
 
-  enter_critical_section(jvmti_env, to_buff_lock);
+  sl_enter(&to_buff_lock);
   {
     // pointer to the total order buffer structure
     to_buff_struct * tobs = &(to_buff_array[tld->to_buff_id]);
@@ -111,12 +110,12 @@ void glbuffer_commit() {
       tobs->pb = NULL;
     }
   }
-  exit_critical_section(jvmti_env, to_buff_lock);
+  sl_exit(&to_buff_lock);
 }
 
 void glbuffer_sendall() {
   // send all total ordering buffers - with lock
-  enter_critical_section(jvmti_env, to_buff_lock);
+  sl_enter(&to_buff_lock);
   {
     for (int i = 0; i < TO_BUFFER_COUNT; ++i) {
       // send all buffers for occupied ids
@@ -128,5 +127,5 @@ void glbuffer_sendall() {
       }
     }
   }
-  exit_critical_section(jvmti_env, to_buff_lock);
+  sl_exit(&to_buff_lock);
 }
@@ -4,38 +4,70 @@
 #include "netref.h"
 
 #include "shared/buffpack.h"
+#include "shared/idalloc.h"
 #include "shared/messagetype.h"
+#include "shared/threadlocal.h"
 
 #include "../src-disl-agent/jvmtiutil.h"
 
+// number of object ids reserved by a thread at once - the first block of a
+// thread is small and the following ones grow up to the maximum
+#define OBJECT_ID_BLOCK_MIN 16
+#define OBJECT_ID_BLOCK_MAX 1024
+
 // first available object id
-static volatile jlong avail_object_id = 1;
+static id_counter object_ids = ID_COUNTER_INIT(1);
+
+// object ids left unused by ended threads
+static id_ranges returned_object_ids;
 
 // first available class id
-static volatile jint avail_class_id = 1;
+static id_counter class_ids = ID_COUNTER_INIT(1);
+
+// class ids of unloaded classes - can be assigned again
+static id_pool released_class_ids;
+
+// number of released class ids kept aside before reusing them - gives the
+// server time to process the class unloading
+#define RELEASED_CLASS_IDS_KEPT 1024
 
 // ******************* Net reference get/set routines *******************
 
 // should be in sync with NetReference on the server
 
 // format of net reference looks like this (from HIGHEST)
-// 1 bit data trans., 1 bit class instance, 23 bits class id, 40 bits object id
+// 1 bit data trans., 1 bit class instance, 22 bits class id, 40 bits object id
 // bit field not used because there is no guarantee of alignment
 
+// The split between class id and object id bits is negotiated with the server
+// at connect time (see messager_netref_layout_header). The extended layout
+// trades object id bits for class id bits - the net reference stays 64 bits.
+
 // TODO rename SPEC
 // SPEC flag is used to indicate if some additional data for this object where
 // transfered to the server
 
 #define OBJECT_ID_POS       (uint8_t)0
-#define CLASS_ID_POS        (uint8_t)40
 #define CLASS_INSTANCE_POS  (uint8_t)62
 #define SPEC_POS            (uint8_t)63
 
-#define OBJECT_ID_MASK      0xFFFFFFFFFFL
-#define CLASS_ID_MASK       0x3FFFFFL
 #define CLASS_INSTANCE_MASK 0x1L
 #define SPEC_MASK           0x1L
 
+// class id bits in the standard and in the extended layout
+#define CLASS_ID_BITS          22
+#define CLASS_ID_BITS_EXTENDED 30
+
+// system property selecting the extended layout
+#define NET_REF_EXTENDED          "dislre.netref.extended"
+#define NET_REF_EXTENDED_DEFAULT  false
+
+static uint8_t class_id_bits = CLASS_ID_BITS;
+
+static uint8_t CLASS_ID_POS = CLASS_INSTANCE_POS - CLASS_ID_BITS;
+static uint64_t OBJECT_ID_MASK = (1ULL << (CLASS_INSTANCE_POS - CLASS_ID_BITS)) - 1;
+static uint64_t CLASS_ID_MASK = (1ULL << CLASS_ID_BITS) - 1;
+
 // get bits from "from" with pattern "bit_mask" lowest bit starting on position
 // "low_start" (from 0)
 static inline uint64_t get_bits(uint64_t from, uint64_t bit_mask,
@@ -61,12 +93,12 @@ static inline void set_bits(uint64_t * to, uint64_t bits,
 	*to |= bits_pos;
 }
 
-inline jlong net_ref_get_object_id(jlong net_ref) {
+static inline jlong net_ref_get_object_id(jlong net_ref) {
 
 	return get_bits(net_ref, OBJECT_ID_MASK, OBJECT_ID_POS);
 }
 
-inline jint net_ref_get_class_id(jlong net_ref) {
+static inline jint net_ref_get_class_id(jlong net_ref) {
 
 	return get_bits(net_ref, CLASS_ID_MASK, CLASS_ID_POS);
 }
@@ -76,22 +108,22 @@ unsigned char net_ref_get_spec(jlong net_ref) {
 	return get_bits(net_ref, SPEC_MASK, SPEC_POS);
 }
 
-inline unsigned char net_ref_get_class_instance_bit(jlong net_ref) {
+static inline unsigned char net_ref_get_class_instance_bit(jlong net_ref) {
 
 	return get_bits(net_ref, CLASS_INSTANCE_MASK, CLASS_INSTANCE_POS);
 }
 
-inline void net_ref_set_object_id(jlong * net_ref, jlong object_id) {
+static inline void net_ref_set_object_id(jlong * net_ref, jlong object_id) {
 
 	set_bits((uint64_t *)net_ref, object_id, OBJECT_ID_MASK, OBJECT_ID_POS);
 }
 
-inline void net_ref_set_class_id(jlong * net_ref, jint class_id) {
+static inline void net_ref_set_class_id(jlong * net_ref, jint class_id) {
 
 	set_bits((uint64_t *)net_ref, class_id, CLASS_ID_MASK, CLASS_ID_POS);
 }
 
-inline void net_ref_set_class_instance(jlong * net_ref, unsigned char cibit) {
+static inline void net_ref_set_class_instance(jlong * net_ref, unsigned char cibit) {
 
 	set_bits((uint64_t *)net_ref, cibit, CLASS_INSTANCE_MASK, CLASS_INSTANCE_POS);
 }
@@ -101,6 +133,64 @@ void net_ref_set_spec(jlong * net_ref, unsigned char spec) {
 	set_bits((uint64_t *)net_ref, spec, SPEC_MASK, SPEC_POS);
 }
 
+void net_ref_init(jvmtiEnv * jvmti_env) {
+
+	bool extended = jvmti_get_system_property_bool(jvmti_env,
+			NET_REF_EXTENDED, NET_REF_EXTENDED_DEFAULT);
+
+	class_id_bits = extended ? CLASS_ID_BITS_EXTENDED : CLASS_ID_BITS;
+
+	CLASS_ID_POS = CLASS_INSTANCE_POS - class_id_bits;
+	OBJECT_ID_MASK = (1ULL << CLASS_ID_POS) - 1;
+	CLASS_ID_MASK = (1ULL << class_id_bits) - 1;
+
+	id_pool_create(&released_class_ids, RELEASED_CLASS_IDS_KEPT);
+	id_ranges_create(&returned_object_ids);
+}
+
+unsigned char net_ref_get_class_id_bits() {
+
+	return class_id_bits;
+}
+
+// ******************* Id allocation routines *******************
+
+// NOTE: ids are allocated without any lock - tagging lock is not required
+
+static jlong _next_object_id() {
+	jlong object_id = id_next_from_block(&object_ids, &returned_object_ids,
+			&(tld_get()->object_ids), OBJECT_ID_BLOCK_MIN, OBJECT_ID_BLOCK_MAX);
+	check_error((uint64_t) object_id > OBJECT_ID_MASK,
+			"Object id space exhausted");
+
+	return object_id;
+}
+
+static jint _next_class_id() {
+	jlong class_id = id_next_reused(&class_ids, &released_class_ids);
+	check_error((uint64_t) class_id > CLASS_ID_MASK, "Class id space exhausted");
+
+	return (jint) class_id;
+}
+
+// Object ids reserved by the thread but not used are handed out again, so
+// that thread churn does not exhaust the object id space (the extended
+// layout leaves only 32 bits for object ids).
+void net_ref_thread_end() {
+
+	id_block_release(&returned_object_ids, &(tld_get()->object_ids));
+}
+
+// The class id of an unloaded class can be reused only after the object free
+// message for its class object has been queued for sending. The server then
+// knows the class id is released before it sees the class info reusing it.
+void net_ref_class_freed(jlong net_ref) {
+
+	if (net_ref_get_class_instance_bit(net_ref)) {
+		id_pool_release(&released_class_ids, net_ref_get_class_id(net_ref));
+	}
+}
+
 // ******************* Net reference routines *******************
 
 // TODO comment
@@ -179,13 +269,7 @@ static jlong _set_net_reference_for_class(JNIEnv * jni_env,
 
 	// assign new net reference - set spec to 1 (binding send over network)
 	jlong net_ref = _set_net_reference(jvmti_env, klass,
-			avail_object_id, avail_class_id, 1, 1);
-
-	// increment object id counter
-	++avail_object_id;
-
-	// increment class id counter
-	++avail_class_id;
+			_next_object_id(), _next_class_id(), 1, 1);
 
 	// *** pack class info into buffer ***
 
@@ -264,10 +348,7 @@ static jlong _set_net_reference_for_object(JNIEnv * jni_env,
 
 	// assign new net reference
 	jlong net_ref =
-			_set_net_reference(jvmti_env, obj, avail_object_id, class_id, 0, 0);
-
-	// increment object id counter
-	++avail_object_id;
+			_set_net_reference(jvmti_env, obj, _next_object_id(), class_id, 0, 0);
 
 	return net_ref;
 }
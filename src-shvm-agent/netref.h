@@ -10,10 +10,22 @@
 
 // ******************* Net reference routines *******************
 
+// selects net reference layout - has to be called before any tagging
+void net_ref_init(jvmtiEnv * jvmti_env);
+
+unsigned char net_ref_get_class_id_bits();
+
 unsigned char net_ref_get_spec(jlong net_ref);
 
 void net_ref_set_spec(jlong * net_ref, unsigned char spec);
 
+// returns object ids reserved by the current thread - called at thread end
+void net_ref_thread_end();
+
+// announces that the object with the given net reference was freed and
+// its object free event was queued for sending
+void net_ref_class_freed(jlong net_ref);
+
 // only retrieves object tag data
 jlong get_tag(jvmtiEnv * jvmti_env, jobject obj);
 
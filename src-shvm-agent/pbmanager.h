@@ -18,10 +18,13 @@
 //    sum of all constants here
 
 //    buffer for case 1)                     1
-//    object free message                    1
+//    object free message (sealed chunks)    OBJ_FREE_CHUNKS
 //    new class info message                 1
 //    just to be sure (parallelism for 1)    3
-#define BQ_UTILITY 6
+#define BQ_UTILITY (5 + OBJ_FREE_CHUNKS)
+
+// number of per-thread chunks collecting object free events
+#define OBJ_FREE_CHUNKS 8
 
 // number of all buffers - used for analysis with some exceptions
 #define BQ_BUFFERS 32
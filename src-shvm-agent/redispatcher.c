@@ -1,6 +1,7 @@
 #include "redispatcher.h"
 
 #include "shared/buffpack.h"
+#include "shared/idalloc.h"
 #include "shared/messagetype.h"
 #include "shared/threadlocal.h"
 
@@ -46,26 +47,15 @@ static void pack_object(JNIEnv * jni_env, buffer * buff, buffer * cmd_buff,
 
 // ******************* analysis helper methods *******************
 
-static jvmtiEnv * jvmti_env;
-
 // first available id for new messages
-static volatile jshort avail_analysis_id = 1;
-
-static jrawMonitorID analysisID_lock;
+static id_counter analysis_ids = ID_COUNTER_INIT(1);
 
 static jshort next_analysis_id() {
   // get id for this method string
-  // this could use different lock then tagging but it should not be a problem
-  // and it will be used rarely - bit unoptimized
-
-  jshort result = -1;
-  enter_critical_section(jvmti_env, analysisID_lock);
-  {
-    result = avail_analysis_id++;
-  }
-  exit_critical_section(jvmti_env, analysisID_lock);
+  jlong result = id_next(&analysis_ids);
+  check_error(result > INT16_MAX, "Too many analysis methods registered");
 
-  return result;
+  return (jshort) result;
 }
 
 static jshort register_method(JNIEnv * jni_env, jstring analysis_method_desc,
@@ -192,14 +182,6 @@ static JNINativeMethod redispatchMethods[] = {
     {"sendObjectPlusData", "(Ljava/lang/Object;)V", (void *)&Java_ch_usi_dag_dislre_REDispatch_sendObjectPlusData},
 };
 
-void redispatcher_init(jvmtiEnv *env) {
-  jvmti_env = env;
-
-  jvmtiError error = (*jvmti_env)->CreateRawMonitor(jvmti_env, "obj free",
-      &analysisID_lock);
-  check_jvmti_error(jvmti_env, error, "Cannot create raw monitor");
-}
-
 void redispatcher_register_natives(JNIEnv * jni_env, jclass klass) {
   (*jni_env)->RegisterNatives(jni_env, klass, redispatchMethods,
       sizeof(redispatchMethods) / sizeof(redispatchMethods[0]));
@@ -211,6 +193,7 @@ void redispatcher_object_free(jlong tag) {
 
 void redispatcher_thread_end() {
   tl_thread_end();
+  net_ref_thread_end();
 }
 
 void redispatcher_vm_death() {
@@ -1,14 +1,17 @@
 #include <stdlib.h>
 #include <pthread.h>
+#include <time.h>
 
 #include <netdb.h>
 #include <unistd.h>
+#include <arpa/inet.h>
 
 #include "sender.h"
 
 #include "shared/blockingqueue.h"
 #include "shared/messagetype.h"
 
+#include "netref.h"
 #include "pbmanager.h"
 
 #include "../src-disl-agent/jvmtiutil.h"
@@ -19,21 +22,53 @@
 static const char * DEFAULT_HOST = "localhost";
 static const char * DEFAULT_PORT = "11218";
 
-// port and name of the instrumentation server
-static char host_name[1024];
-static char port_number[6]; // including final 0
+// The agent can send the analysis data to several shadow VMs (shards). The
+// endpoints are given as a comma separated list of host:port pairs. Analysis
+// buffers are routed to a shard by their ordering id, so that all events of
+// a thread (or of a total ordering buffer) are analyzed by the same shard.
+// All other messages (new classes, class, string and thread info, analysis
+// registrations, object frees) are broadcast - any shard may receive an
+// object or a class in its analysis data, and a shard ignores frees of
+// objects it has not seen. Each shard reports the results of its analyses
+// at exit on its own; the results are not merged.
 
-static void parse_agent_options(char *options) {
+#define MAX_SHARDS      16
+#define ENDPOINT_DELIM  ","
+
+typedef struct {
+  // port and name of the shadow VM
+  char host_name[1024];
+  char port_number[6]; // including final 0
+
+  int sockfd;
+
+  // NOTE: credits and spill state are accessed only by the sender thread
+  jlong credits;
+
+  // partially received credit grant
+  unsigned char grant_buff[sizeof(uint32_t)];
+  size_t grant_received;
+
+  FILE * spill_file;
+  long spill_read_pos;
+  long spill_write_pos;
+  size_t spill_count;
+} shard;
+
+static shard shards[MAX_SHARDS];
+static int shard_count = 0;
+
+static void parse_endpoint(shard * s, char * endpoint) {
   // assign defaults
-  strcpy(host_name, DEFAULT_HOST);
-  strcpy(port_number, DEFAULT_PORT);
+  strcpy(s->host_name, DEFAULT_HOST);
+  strcpy(s->port_number, DEFAULT_PORT);
 
   // no options found
-  if (options == NULL) {
+  if (endpoint == NULL) {
     return;
   }
 
-  char * port_start = strchr(options, ':');
+  char * port_start = strchr(endpoint, ':');
 
   // process port number
   if (port_start != NULL) {
@@ -44,36 +79,74 @@ static void parse_agent_options(char *options) {
     ++port_start;
 
     // convert number
-    int fitsP = strlen(port_start) < sizeof(port_number);
+    int fitsP = strlen(port_start) < sizeof(s->port_number);
     check_error(!fitsP, "Port number is too long");
 
-    strcpy(port_number, port_start);
+    strcpy(s->port_number, port_start);
+  }
+
+  // empty host name keeps the default
+  if (strlen(endpoint) == 0) {
+    return;
   }
 
   // check if host_name is big enough
-  int fitsH = strlen(options) < sizeof(host_name);
+  int fitsH = strlen(endpoint) < sizeof(s->host_name);
   check_error(!fitsH, "Host name is too long");
 
-  strcpy(host_name, options);
+  strcpy(s->host_name, endpoint);
 }
 
-static void send_data(int sockfd, buffer * b) {
-  // send data
-  // NOTE: normally access the buffer using methods
+static void parse_agent_options(char *options) {
+  // no options found - single shard with defaults
+  if (options == NULL || options[0] == '\0') {
+    parse_endpoint(&shards[shard_count++], NULL);
+    return;
+  }
+
+  char * saveptr;
+  char * endpoint = strtok_r(options, ENDPOINT_DELIM, &saveptr);
+
+  while (endpoint != NULL) {
+    check_error(shard_count == MAX_SHARDS, "Too many shadow VM endpoints");
+
+    parse_endpoint(&shards[shard_count++], endpoint);
+    endpoint = strtok_r(NULL, ENDPOINT_DELIM, &saveptr);
+  }
+
+  check_error(shard_count == 0, "No shadow VM endpoint given");
+}
+
+static void send_bytes(int sockfd, const void * data, size_t size) {
   size_t sent = 0;
 
-  while (sent != b->occupied) {
-    int res = send(sockfd, ((unsigned char *) b->buff) + sent,
-        (b->occupied - sent), 0);
+  while (sent != size) {
+    int res = send(sockfd, ((const unsigned char *) data) + sent,
+        (size - sent), 0);
     check_std_error(res == -1, "Error while sending data to server");
     sent += res;
   }
 }
 
-static int open_connection() {
+// each buffer is sent as a frame prefixed with its length so that the server
+// can read it whole and decode it independently of other buffers
+static void send_frame(int sockfd, buffer * b) {
+  // nothing to frame
+  if (b->occupied == 0) {
+    return;
+  }
+
+  uint32_t length = htonl((uint32_t) b->occupied);
+  send_bytes(sockfd, &length, sizeof(length));
+
+  // NOTE: normally access the buffer using methods
+  send_bytes(sockfd, b->buff, b->occupied);
+}
+
+static int open_connection(shard * s) {
   // get host address
   struct addrinfo * addr;
-  int gai_res = getaddrinfo(host_name, port_number, NULL, &addr);
+  int gai_res = getaddrinfo(s->host_name, s->port_number, NULL, &addr);
   check_error(gai_res != 0, gai_strerror(gai_res));
 
   // create stream socket
@@ -89,14 +162,379 @@ static int open_connection() {
   return sockfd;
 }
 
-static void close_connection(int sockfd) {
+// ******************* Routing *******************
+
+// Ordering ids are mapped to shards by consistent hashing. Every shard owns
+// several points on a hash ring, derived from its endpoint, and an ordering
+// id belongs to the shard owning the first point following the hash of the
+// id. Adding or removing an endpoint thus moves only the ordering ids of
+// that endpoint, and the mapping does not depend on the endpoint order.
+
+#define RING_POINTS_PER_SHARD 64
+
+typedef struct {
+  uint64_t hash;
+  int shard_id;
+} ring_point;
+
+static ring_point ring[MAX_SHARDS * RING_POINTS_PER_SHARD];
+static size_t ring_size = 0;
+
+// 64-bit finalizer of MurmurHash3
+static uint64_t mix_hash(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+// FNV-1a
+static uint64_t string_hash(uint64_t h, const char * str) {
+  for (; *str != '\0'; ++str) {
+    h ^= (unsigned char) *str;
+    h *= 0x100000001b3ULL;
+  }
+
+  return h;
+}
+
+static int _compare_points(const void * a, const void * b) {
+  uint64_t first = ((const ring_point *) a)->hash;
+  uint64_t second = ((const ring_point *) b)->hash;
+  return (first > second) - (first < second);
+}
+
+static void ring_init() {
+  for (int i = 0; i < shard_count; ++i) {
+    uint64_t endpoint_hash = string_hash(0xcbf29ce484222325ULL,
+        shards[i].host_name);
+    endpoint_hash = string_hash(endpoint_hash, ":");
+    endpoint_hash = string_hash(endpoint_hash, shards[i].port_number);
+
+    for (int point = 0; point < RING_POINTS_PER_SHARD; ++point) {
+      ring[ring_size].hash = mix_hash(endpoint_hash + point);
+      ring[ring_size].shard_id = i;
+      ++ring_size;
+    }
+  }
+
+  qsort(ring, ring_size, sizeof(ring_point), _compare_points);
+}
+
+static shard * shard_for(jlong ordering_id) {
+  if (shard_count == 1) {
+    return &shards[0];
+  }
+
+  uint64_t hash = mix_hash((uint64_t) ordering_id);
+
+  // first point not below the hash
+  size_t low = 0;
+  size_t high = ring_size;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (ring[mid].hash < hash) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  // wrap around the ring
+  return &shards[ring[low % ring_size].shard_id];
+}
+
+// ******************* Flow control *******************
+
+// The server grants credits for analysis buffers, one credit per buffer, as
+// it finishes processing them. Other buffers (commands, object frees, ...)
+// are not limited. When the sender runs out of credits, the policy decides
+// whether it waits for the server, spills the buffers to a file (and sends
+// them when credits arrive) or drops the analysis data. Each shard has its
+// own credits and spill file.
+
+#define FLOW_CONTROL          "dislre.flowcontrol"
+#define FLOW_CONTROL_DEFAULT  "block"
+
+#define FLOW_STATS            "dislre.flowcontrol.stats"
+#define FLOW_STATS_DEFAULT    false
+
+typedef enum { FC_BLOCK, FC_SPILL, FC_DROP } fc_policy;
+
+static fc_policy policy;
+static bool print_stats;
+
+// spilled frames - each stored as spill_header followed by frame data
+typedef struct {
+  uint32_t length;
+  uint8_t credited;
+} spill_header;
+
+// NOTE: shared by all shards - used only by the sender thread
+static unsigned char * spill_data = NULL;
+static size_t spill_data_size = 0;
+
+// statistics
+static jlong stat_stalls = 0;
+static jlong stat_stall_ns = 0;
+static jlong stat_spilled = 0;
+static jlong stat_dropped = 0;
+static size_t stat_max_queue = 0;
+
+static void flow_control_init(jvmtiEnv * jvmti_env) {
+  char * value = jvmti_get_system_property_string(jvmti_env,
+      FLOW_CONTROL, FLOW_CONTROL_DEFAULT);
+
+  if (strcmp(value, "block") == 0) {
+    policy = FC_BLOCK;
+  } else if (strcmp(value, "spill") == 0) {
+    policy = FC_SPILL;
+  } else if (strcmp(value, "drop") == 0) {
+    policy = FC_DROP;
+  } else {
+    check_error(true, "Unknown flow control policy (block, spill or drop)");
+  }
+
+  free(value);
+
+  print_stats = jvmti_get_system_property_bool(jvmti_env,
+      FLOW_STATS, FLOW_STATS_DEFAULT);
+}
+
+static jlong now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (jlong) ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// reads all credit grants available on the socket
+// if wait is set, blocks until at least one grant is received
+static void receive_credits(shard * s, bool wait) {
+  while (true) {
+    int res = recv(s->sockfd, s->grant_buff + s->grant_received,
+        sizeof(s->grant_buff) - s->grant_received, wait ? 0 : MSG_DONTWAIT);
+
+    if (res == -1 && !wait && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+
+    check_std_error(res == -1, "Error while receiving credits from server");
+    check_error(res == 0, "Server closed the connection");
+
+    s->grant_received += res;
+    if (s->grant_received == sizeof(s->grant_buff)) {
+      uint32_t grant;
+      memcpy(&grant, s->grant_buff, sizeof(grant));
+
+      s->credits += ntohl(grant);
+      s->grant_received = 0;
+
+      // no need to wait anymore, just drain the rest
+      wait = false;
+    }
+  }
+}
+
+static void wait_for_credit(shard * s) {
+  receive_credits(s, false);
+  if (s->credits > 0) {
+    return;
+  }
+
+  ++stat_stalls;
+  jlong stall_start = now_ns();
+
+  while (s->credits == 0) {
+    receive_credits(s, true);
+  }
+
+  stat_stall_ns += now_ns() - stall_start;
+}
+
+static void spill_frame(shard * s, buffer * b, bool credited) {
+  if (b->occupied == 0) {
+    return;
+  }
+
+  if (s->spill_file == NULL) {
+    s->spill_file = tmpfile();
+    check_std_error(s->spill_file == NULL, "Cannot create spill file");
+  }
+
+  spill_header header = { .length = b->occupied, .credited = credited };
+
+  int res = fseek(s->spill_file, s->spill_write_pos, SEEK_SET);
+  check_std_error(res != 0, "Cannot seek in spill file");
+
+  size_t written = fwrite(&header, sizeof(header), 1, s->spill_file);
+  written += fwrite(b->buff, b->occupied, 1, s->spill_file);
+  check_std_error(written != 2, "Cannot write to spill file");
+
+  s->spill_write_pos = ftell(s->spill_file);
+  ++s->spill_count;
+}
+
+// sends spilled frames in order as long as there are credits for them
+// if wait is set, waits for credits until all frames are sent
+static void spill_drain(shard * s, bool wait) {
+  while (s->spill_count > 0) {
+    int res = fseek(s->spill_file, s->spill_read_pos, SEEK_SET);
+    check_std_error(res != 0, "Cannot seek in spill file");
+
+    spill_header header;
+    size_t read = fread(&header, sizeof(header), 1, s->spill_file);
+    check_std_error(read != 1, "Cannot read from spill file");
+
+    if (header.credited) {
+      receive_credits(s, false);
+      if (s->credits == 0) {
+        if (!wait) {
+          return;
+        }
+
+        wait_for_credit(s);
+      }
+
+      --s->credits;
+    }
+
+    if (header.length > spill_data_size) {
+      spill_data = realloc(spill_data, header.length);
+      check_error(spill_data == NULL, "Cannot allocate spill buffer");
+      spill_data_size = header.length;
+    }
+
+    read = fread(spill_data, header.length, 1, s->spill_file);
+    check_std_error(read != 1, "Cannot read from spill file");
+
+    uint32_t length = htonl(header.length);
+    send_bytes(s->sockfd, &length, sizeof(length));
+    send_bytes(s->sockfd, spill_data, header.length);
+
+    s->spill_read_pos += sizeof(header) + header.length;
+    --s->spill_count;
+  }
+
+  // everything sent - start over
+  s->spill_read_pos = 0;
+  s->spill_write_pos = 0;
+}
+
+static void send_to_shard(shard * s, buffer * b, bool credited) {
+  if (b->occupied == 0) {
+    return;
+  }
+
+  // spilled frames go first to keep the order
+  if (s->spill_count > 0) {
+    spill_drain(s, false);
+  }
+
+  if (s->spill_count > 0) {
+    spill_frame(s, b, credited);
+    stat_spilled += credited;
+    return;
+  }
+
+  if (credited) {
+    receive_credits(s, false);
+
+    if (s->credits == 0) {
+      switch (policy) {
+      case FC_SPILL:
+        spill_frame(s, b, true);
+        ++stat_spilled;
+        return;
+
+      case FC_DROP:
+        ++stat_dropped;
+        return;
+
+      case FC_BLOCK:
+        wait_for_credit(s);
+        break;
+      }
+    }
+
+    --s->credits;
+  }
+
+  send_frame(s->sockfd, b);
+}
+
+static void broadcast(buffer * b) {
+  for (int i = 0; i < shard_count; ++i) {
+    send_to_shard(&shards[i], b, false);
+  }
+}
+
+static void send_buffers(process_buffs * pb) {
+  // first send command buffer - contains new class or object ids,...
+  // the command buffer describes objects other buffers may refer to, so it
+  // is sent to all shards and never dropped
+  broadcast(pb->command_buff);
+
+  // utility buffers hold only broadcast messages
+  jlong ordering_id = (pb->owner_id == PB_UTILITY) ?
+      -1 : messager_ordering_id(pb->analysis_buff);
+
+  if (ordering_id < 0) {
+    broadcast(pb->analysis_buff);
+    return;
+  }
+
+  // only buffers with analysis data need a credit
+  bool credited = messager_is_analyze(pb->analysis_buff);
+  send_to_shard(shard_for(ordering_id), pb->analysis_buff, credited);
+}
+
+static void print_flow_stats() {
+  if (stat_spilled > 0 || stat_dropped > 0) {
+    fprintf(stderr, "Warning: Server was not keeping up, %" PRId64
+        " analysis buffers were spilled and %" PRId64 " dropped.\n",
+        (int64_t) stat_spilled, (int64_t) stat_dropped);
+  }
+
+  if (print_stats) {
+    fprintf(stderr, "Flow control: %" PRId64 " credit stalls (%" PRId64
+        " ms), max send queue length %zu\n", (int64_t) stat_stalls,
+        (int64_t) (stat_stall_ns / 1000000), stat_max_queue);
+  }
+}
+
+static void open_connections() {
   process_buffs * pb = pb_normal_get(0);
 
+  // the server has to know the net reference layout before anything else
+  messager_netref_layout_header(pb->command_buff, net_ref_get_class_id_bits());
+
+  for (int i = 0; i < shard_count; ++i) {
+    shard * s = &shards[i];
+
+    s->sockfd = open_connection(s);
+    send_frame(s->sockfd, pb->command_buff);
+  }
+
+  pb_normal_release(pb);
+}
+
+static void close_connections() {
+  process_buffs * pb = pb_normal_get(0);
   messager_close_header(pb->command_buff);
-  send_data(sockfd, pb->command_buff);
+
+  for (int i = 0; i < shard_count; ++i) {
+    shard * s = &shards[i];
+
+    // nothing may be left behind
+    spill_drain(s, true);
+
+    send_frame(s->sockfd, pb->command_buff);
+    close(s->sockfd);
+  }
 
   pb_normal_release(pb);
-  close(sockfd);
 }
 
 // ******************* Sender routines *******************
@@ -107,7 +545,7 @@ static blocking_queue send_q;
 static volatile int no_sending_work = 0;
 
 static void *sender_loop(void * obj) {
-  int sockfd = open_connection();
+  open_connections();
 
   // exit when the jvm is terminated and there are no msg to process
   while (!(no_sending_work && bq_length(&send_q) == 0)) {
@@ -115,13 +553,15 @@ static void *sender_loop(void * obj) {
     // TODO thread could timeout here with timeout about 5 sec and check
     // if all of the buffers are allocated by the application threads
     // and all application threads are waiting on free buffer - deadlock
+    size_t queue_length = bq_length(&send_q);
+    if (queue_length > stat_max_queue) {
+      stat_max_queue = queue_length;
+    }
+
     process_buffs * pb;
     bq_pop(&send_q, &pb);
 
-    // first send command buffer - contains new class or object ids,...
-    send_data(sockfd, pb->command_buff);
-    // send analysis buffer
-    send_data(sockfd, pb->analysis_buff);
+    send_buffers(pb);
 
     // release (enqueue) buffer according to the type
     if (pb->owner_id == PB_UTILITY) {
@@ -133,12 +573,14 @@ static void *sender_loop(void * obj) {
     }
   }
 
-  close_connection(sockfd);
+  close_connections();
   return NULL;
 }
 
-void sender_init(char *options) {
+void sender_init(jvmtiEnv * jvmti_env, char *options) {
   parse_agent_options(options);
+  ring_init();
+  flow_control_init(jvmti_env);
 
   bq_create(&send_q, BQ_BUFFERS + BQ_UTILITY, sizeof(process_buffs *));
 }
@@ -162,6 +604,8 @@ void sender_disconnect() {
   // wait for thread end
   int res = pthread_join(sender, NULL);
   check_error(res != 0, "Cannot join sending thread.");
+
+  print_flow_stats();
 }
 
 void sender_enqueue(process_buffs * pb) {
@@ -1,9 +1,11 @@
 #ifndef _SENDER_H_
 #define _SENDER_H_
 
+#include <jvmti.h>
+
 #include "shared/buffer.h"
 
-void sender_init(char *options);
+void sender_init(jvmtiEnv * jvmti_env, char *options);
 void sender_connect();
 void sender_disconnect();
 void sender_enqueue(process_buffs * buffs);
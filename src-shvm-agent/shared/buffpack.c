@@ -44,6 +44,22 @@ void pack_double(buffer * buff, jdouble to_send) {
 	pack_long(buff, convert.l);
 }
 
+void pack_varlong(buffer * buff, jlong to_send) {
+	// unsigned LEB128 - 7 bits per byte, lowest group first,
+	// highest bit set on all bytes except the last one
+	unsigned char bytes[10];
+	uint64_t value = (uint64_t) to_send;
+	size_t length = 0;
+
+	do {
+		unsigned char group = value & 0x7F;
+		value >>= 7;
+		bytes[length++] = (value != 0) ? (group | 0x80) : group;
+	} while (value != 0);
+
+	buffer_fill(buff, bytes, length);
+}
+
 void pack_string_utf8(buffer * buff, const void * string_utf8,
 		uint16_t size_in_bytes) {
 
@@ -45,6 +45,7 @@ void pack_int(buffer * buff, jint to_send);
 void pack_long(buffer * buff, jlong to_send);
 void pack_float(buffer * buff, jfloat to_send);
 void pack_double(buffer * buff, jdouble to_send);
+void pack_varlong(buffer * buff, jlong to_send);
 
 void pack_string_utf8(buffer * buff, const void * string_utf8,
 		uint16_t size_in_bytes);
@@ -0,0 +1,142 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "idalloc.h"
+
+#include "../../src-disl-agent/jvmtiutil.h"
+
+// initial capacity of the released id pool
+#define INIT_POOL_CAPACITY 64
+
+void id_ranges_create(id_ranges * spare) {
+  atomic_init(&(spare->count), 0);
+  spare->ranges = NULL;
+  spare->capacity = 0;
+
+  int pmi = pthread_mutex_init(&(spare->mutex), NULL);
+  check_std_error(pmi != 0, "Cannot create pthread mutex");
+}
+
+void id_block_release(id_ranges * spare, id_block * block) {
+  if (block->next == block->end) {
+    return;
+  }
+
+  pthread_mutex_lock(&(spare->mutex));
+  {
+    size_t count = atomic_load_explicit(&(spare->count), memory_order_relaxed);
+
+    // not enough free space - extend ranges
+    if (count == spare->capacity) {
+      size_t new_capacity = (spare->capacity == 0) ? INIT_POOL_CAPACITY
+          : 2 * spare->capacity;
+
+      id_block * new_ranges = realloc(spare->ranges,
+          new_capacity * sizeof(id_block));
+      check_error(new_ranges == NULL, "Cannot extend returned id ranges");
+
+      spare->ranges = new_ranges;
+      spare->capacity = new_capacity;
+    }
+
+    spare->ranges[count] = *block;
+    atomic_store_explicit(&(spare->count), count + 1, memory_order_relaxed);
+  }
+  pthread_mutex_unlock(&(spare->mutex));
+
+  block->next = block->end;
+}
+
+void id_block_refill(id_counter * counter, id_ranges * spare, id_block * block,
+    jlong min_block_size, jlong max_block_size) {
+
+  // reuse the range returned by an ended thread
+  if (atomic_load_explicit(&(spare->count), memory_order_relaxed) > 0) {
+    bool reused = false;
+
+    pthread_mutex_lock(&(spare->mutex));
+    {
+      size_t count = atomic_load_explicit(&(spare->count),
+          memory_order_relaxed);
+
+      if (count > 0) {
+        id_block * range = &(spare->ranges[count - 1]);
+        block->next = range->next;
+        block->end = range->end;
+
+        atomic_store_explicit(&(spare->count), count - 1,
+            memory_order_relaxed);
+        reused = true;
+      }
+    }
+    pthread_mutex_unlock(&(spare->mutex));
+
+    if (reused) {
+      return;
+    }
+  }
+
+  // double the block size up to the maximum
+  block->size = (block->size == 0) ? min_block_size
+      : ((2 * block->size < max_block_size) ? 2 * block->size : max_block_size);
+
+  block->next = atomic_fetch_add_explicit(&(counter->next), block->size,
+      memory_order_relaxed);
+  block->end = block->next + block->size;
+}
+
+void id_pool_create(id_pool * pool, size_t kept) {
+  pool->ids = NULL;
+  pool->first = 0;
+  pool->count = 0;
+  pool->capacity = 0;
+  pool->kept = kept;
+
+  int pmi = pthread_mutex_init(&(pool->mutex), NULL);
+  check_std_error(pmi != 0, "Cannot create pthread mutex");
+}
+
+void id_pool_release(id_pool * pool, jlong id) {
+  pthread_mutex_lock(&(pool->mutex));
+  {
+    // not enough free space - extend pool
+    if (pool->count == pool->capacity) {
+      size_t new_capacity = (pool->capacity == 0) ? INIT_POOL_CAPACITY
+          : 2 * pool->capacity;
+
+      jlong * new_ids = malloc(new_capacity * sizeof(jlong));
+      check_error(new_ids == NULL, "Cannot extend released id pool");
+
+      // unwrap the ring
+      for (size_t i = 0; i < pool->count; ++i) {
+        new_ids[i] = pool->ids[(pool->first + i) % pool->capacity];
+      }
+
+      free(pool->ids);
+      pool->ids = new_ids;
+      pool->first = 0;
+      pool->capacity = new_capacity;
+    }
+
+    pool->ids[(pool->first + pool->count) % pool->capacity] = id;
+    ++(pool->count);
+  }
+  pthread_mutex_unlock(&(pool->mutex));
+}
+
+jlong id_next_reused(id_counter * counter, id_pool * pool) {
+  jlong result = -1;
+
+  pthread_mutex_lock(&(pool->mutex));
+  {
+    // the oldest released id
+    if (pool->count > pool->kept) {
+      result = pool->ids[pool->first];
+      pool->first = (pool->first + 1) % pool->capacity;
+      --(pool->count);
+    }
+  }
+  pthread_mutex_unlock(&(pool->mutex));
+
+  return (result != -1) ? result : id_next(counter);
+}
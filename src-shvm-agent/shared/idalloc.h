@@ -0,0 +1,91 @@
+#ifndef _IDALLOC_H
+#define	_IDALLOC_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include <jvmti.h>
+
+// *** Lock-free id allocation ***
+
+// Counter handing out unique ids. Safe to use from any thread, without
+// holding any lock.
+typedef struct {
+  atomic_llong next;
+} id_counter;
+
+// Block of ids reserved by a single thread. Ids from the block are handed
+// out without any synchronization - the block has to be thread-local.
+// Threads start with small blocks and double the size with each new block,
+// so that short-lived threads do not waste large parts of the id space.
+typedef struct {
+  jlong next;
+  jlong end;
+  jlong size;
+} id_block;
+
+// Unused ranges of blocks returned by ended threads. The ranges are handed
+// out again before new blocks are reserved from the counter. Threads end
+// rarely, so the ranges are simply guarded by a mutex, and the count is
+// checked first to keep the mutex off the common path.
+typedef struct {
+  pthread_mutex_t mutex;
+  atomic_size_t count;
+  id_block * ranges;
+  size_t capacity;
+} id_ranges;
+
+// Pool of released ids that can be handed out again. Ids are released and
+// reused rarely (class unloading), so the pool is simply guarded by a mutex.
+// Ids are reused in the order of release, and only when more than "kept"
+// ids are waiting - a released id is not handed out again right away.
+typedef struct {
+  pthread_mutex_t mutex;
+  jlong * ids;
+  size_t first;
+  size_t count;
+  size_t capacity;
+  size_t kept;
+} id_pool;
+
+#define ID_COUNTER_INIT(first) { ATOMIC_VAR_INIT(first) }
+
+#define ID_BLOCK_INIT { .next = 0, .end = 0, .size = 0 }
+
+// returns next available id
+static inline jlong id_next(id_counter * counter) {
+  return atomic_fetch_add_explicit(&(counter->next), 1, memory_order_relaxed);
+}
+
+// reserves a new block for the thread - a returned range if there is one,
+// otherwise a block of up to "max_block_size" ids from the counter
+void id_block_refill(id_counter * counter, id_ranges * spare, id_block * block,
+    jlong min_block_size, jlong max_block_size);
+
+// returns next id from the thread-local block - reserves new block when the
+// block is exhausted
+static inline jlong id_next_from_block(id_counter * counter, id_ranges * spare,
+    id_block * block, jlong min_block_size, jlong max_block_size) {
+
+  if (block->next == block->end) {
+    id_block_refill(counter, spare, block, min_block_size, max_block_size);
+  }
+
+  return block->next++;
+}
+
+void id_ranges_create(id_ranges * spare);
+
+// returns the unused rest of the thread-local block, called when the thread
+// ends - the block is left empty
+void id_block_release(id_ranges * spare, id_block * block);
+
+void id_pool_create(id_pool * pool, size_t kept);
+
+// adds released id to the pool
+void id_pool_release(id_pool * pool, jlong id);
+
+// returns released id from the pool or next available id from the counter
+jlong id_next_reused(id_counter * counter, id_pool * pool);
+
+#endif	/* _IDALLOC_H */
@@ -1,3 +1,5 @@
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "messagetype.h"
@@ -13,6 +15,7 @@
 #define MSG_REG_ANALYSIS  6   // sending registration for analysis method
 #define MSG_THREAD_INFO   7   // sending thread info
 #define MSG_THREAD_END    8   // sending thread end message
+#define MSG_NETREF_LAYOUT 9   // sending net reference layout
 
 void messager_close_header(buffer *buff) {
   pack_byte(buff, MSG_CLOSE);
@@ -39,17 +42,47 @@ size_t messager_analyze_item(buffer *buff, jshort analysis_id) {
   return pos;
 }
 
-size_t messager_objfree_header(buffer *buff) {
+void messager_objfree_header(buffer *buff, jint free_count) {
   pack_byte(buff, MSG_OBJ_FREE);
-  // get pointer to the location where count of requests will stored
-  size_t pos = buffer_filled(buff);
-  // request count space initialization
-  pack_int(buff, 0xBAADF00D);
-  return pos;
+  // number of freed net references (not runs)
+  pack_int(buff, free_count);
+}
+
+// net references are compared as unsigned - same as on the server
+static int _compare_net_refs(const void * a, const void * b) {
+  uint64_t first = *(const uint64_t *) a;
+  uint64_t second = *(const uint64_t *) b;
+  return (first > second) - (first < second);
 }
 
-void messager_objfree_item(buffer *buff, jlong tag) {
-  pack_long(buff, tag);
+// Freed net references are highly clustered, so they are sorted and sent as
+// runs of consecutive net references. Each run is packed as a delta from the
+// end of the previous run and the number of references following the first
+// one. The tags are sorted in place.
+void messager_objfree_tags(buffer *buff, jlong *tags, jint count) {
+  qsort(tags, count, sizeof(jlong), _compare_net_refs);
+
+  uint64_t last = 0;
+  jint i = 0;
+
+  while (i < count) {
+    uint64_t first = (uint64_t) tags[i];
+    jint run_length = 0;
+
+    // extend run while the references are consecutive
+    while (i + run_length + 1 < count
+        && (uint64_t) tags[i + run_length + 1] == first + run_length + 1) {
+      ++run_length;
+    }
+
+    // distance from the last net reference of the previous run
+    pack_varlong(buff, first - last);
+    // number of consecutive net references following the first one
+    pack_varlong(buff, run_length);
+
+    last = first + run_length;
+    i += run_length + 1;
+  }
 }
 
 void messager_newclass_header(buffer *buff, const char* name, jlong loader_tag,
@@ -111,3 +144,33 @@ void messager_threadend_header(buffer *buff, jlong thread_id) {
   pack_byte(buff, MSG_THREAD_END);
   pack_long(buff, thread_id);
 }
+
+void messager_netref_layout_header(buffer *buff, jbyte class_id_bits) {
+  pack_byte(buff, MSG_NETREF_LAYOUT);
+  pack_byte(buff, class_id_bits);
+}
+
+jboolean messager_is_analyze(buffer *buff) {
+  return buffer_filled(buff) > 0 && buff->buff[0] == MSG_ANALYZE;
+}
+
+// returns the ordering id of an analysis message or the thread id of a thread
+// end message, -1 for all other messages
+jlong messager_ordering_id(buffer *buff) {
+  if (buffer_filled(buff) < 1 + sizeof(jlong)) {
+    return -1;
+  }
+
+  unsigned char type = buff->buff[0];
+  if (type != MSG_ANALYZE && type != MSG_THREAD_END) {
+    return -1;
+  }
+
+  // both messages start with the id packed as a big endian long
+  uint64_t id = 0;
+  for (size_t i = 1; i <= sizeof(jlong); ++i) {
+    id = (id << 8) | buff->buff[i];
+  }
+
+  return (jlong) id;
+}
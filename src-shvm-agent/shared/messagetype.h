@@ -7,11 +7,17 @@
 
 void messager_close_header(buffer *buff);
 
+void messager_netref_layout_header(buffer *buff, jbyte class_id_bits);
+
+// inspection of the message at the start of a filled buffer
+jboolean messager_is_analyze(buffer *buff);
+jlong messager_ordering_id(buffer *buff);
+
 size_t messager_analyze_header(buffer *buff, jlong ordering_id);
 size_t messager_analyze_item(buffer *buff, jshort analysis_id);
 
-size_t messager_objfree_header(buffer *buff);
-void messager_objfree_item(buffer *buff, jlong tag);
+void messager_objfree_header(buffer *buff, jint free_count);
+void messager_objfree_tags(buffer *buff, jlong *tags, jint count);
 
 void messager_newclass_header(buffer *buff, const char* name, jlong loader_id,
     jint class_data_len, const unsigned char* class_data);
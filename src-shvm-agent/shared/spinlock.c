@@ -0,0 +1,197 @@
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "spinlock.h"
+
+#include "../../src-disl-agent/jvmtiutil.h"
+
+// number of attempts to acquire the lock before going to sleep
+#define SPIN_COUNT 128
+
+#define SL_FREE      0
+#define SL_LOCKED    1
+#define SL_CONTENDED 2
+
+// ******************* Statistics *******************
+
+#ifdef LOCK_STATS
+
+#define MAX_STATS_LOCKS 64
+
+static spin_lock * stats_locks[MAX_STATS_LOCKS];
+static atomic_int stats_lock_count = ATOMIC_VAR_INIT(0);
+
+static void _stats_register(spin_lock * lock) {
+  atomic_init(&(lock->acquired), 0);
+  atomic_init(&(lock->contended), 0);
+  atomic_init(&(lock->wait_ns), 0);
+
+  int index = atomic_fetch_add(&stats_lock_count, 1);
+  if (index < MAX_STATS_LOCKS) {
+    stats_locks[index] = lock;
+  }
+}
+
+static jlong _now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (jlong) ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+#define STATS_ACQUIRED(lock) \
+  atomic_fetch_add_explicit(&((lock)->acquired), 1, memory_order_relaxed)
+
+#define STATS_WAIT_START(lock) \
+  atomic_fetch_add_explicit(&((lock)->contended), 1, memory_order_relaxed); \
+  jlong wait_start = _now_ns()
+
+#define STATS_WAIT_END(lock) \
+  atomic_fetch_add_explicit(&((lock)->wait_ns), _now_ns() - wait_start, \
+      memory_order_relaxed)
+
+#else
+
+#define STATS_ACQUIRED(lock)
+#define STATS_WAIT_START(lock)
+#define STATS_WAIT_END(lock)
+
+#endif
+
+void sl_print_stats() {
+#ifdef LOCK_STATS
+  int count = atomic_load(&stats_lock_count);
+  if (count > MAX_STATS_LOCKS) {
+    count = MAX_STATS_LOCKS;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    spin_lock * lock = stats_locks[i];
+
+    fprintf(stderr, "Lock \"%s\": acquired %lld, contended %lld, "
+        "waited %lld us\n", lock->name,
+        (long long) atomic_load(&(lock->acquired)),
+        (long long) atomic_load(&(lock->contended)),
+        (long long) atomic_load(&(lock->wait_ns)) / 1000);
+  }
+#endif
+}
+
+#ifdef RAW_MONITOR_LOCKS
+
+// ******************* Raw monitor implementation *******************
+
+void sl_create(spin_lock * lock, jvmtiEnv * jvmti_env, const char * name) {
+  lock->name = name;
+  lock->jvmti_env = jvmti_env;
+
+  jvmtiError error = (*jvmti_env)->CreateRawMonitor(jvmti_env, name,
+      &(lock->monitor));
+  check_jvmti_error(jvmti_env, error, "Cannot create raw monitor");
+
+#ifdef LOCK_STATS
+  _stats_register(lock);
+#endif
+}
+
+void sl_enter(spin_lock * lock) {
+  // raw monitor does not tell if it was contended - count all as contended
+  STATS_WAIT_START(lock);
+  enter_critical_section(lock->jvmti_env, lock->monitor);
+  STATS_WAIT_END(lock);
+  STATS_ACQUIRED(lock);
+}
+
+void sl_exit(spin_lock * lock) {
+  exit_critical_section(lock->jvmti_env, lock->monitor);
+}
+
+#else
+
+// ******************* Spin-then-futex implementation *******************
+
+static inline void _cpu_relax() {
+#if defined (__x86_64__) || defined (__i386__)
+  __asm__ __volatile__ ("pause" ::: "memory");
+#else
+  atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+static inline void _futex_wait(atomic_int * addr, int value) {
+#ifdef __linux__
+  // returns immediately if the value already changed
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+#else
+  sched_yield();
+#endif
+}
+
+static inline void _futex_wake(atomic_int * addr) {
+#ifdef __linux__
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#endif
+}
+
+static inline int _try_lock(spin_lock * lock) {
+  int expected = SL_FREE;
+  return atomic_compare_exchange_strong_explicit(&(lock->state), &expected,
+      SL_LOCKED, memory_order_acquire, memory_order_relaxed);
+}
+
+void sl_create(spin_lock * lock, jvmtiEnv * jvmti_env, const char * name) {
+  lock->name = name;
+  atomic_init(&(lock->state), SL_FREE);
+
+#ifdef LOCK_STATS
+  _stats_register(lock);
+#endif
+}
+
+void sl_enter(spin_lock * lock) {
+  // fast path - no contention
+  if (_try_lock(lock)) {
+    STATS_ACQUIRED(lock);
+    return;
+  }
+
+  STATS_WAIT_START(lock);
+
+  // critical sections are short - the holder will likely leave soon
+  for (int i = 0; i < SPIN_COUNT; ++i) {
+    _cpu_relax();
+
+    if (atomic_load_explicit(&(lock->state), memory_order_relaxed) == SL_FREE
+        && _try_lock(lock)) {
+      STATS_WAIT_END(lock);
+      STATS_ACQUIRED(lock);
+      return;
+    }
+  }
+
+  // announce the sleeping thread and sleep until the lock is free
+  // NOTE: the lock stays marked as contended until the next exit even if
+  // nobody else waits - costs one spurious wake call at most
+  while (atomic_exchange_explicit(&(lock->state), SL_CONTENDED,
+      memory_order_acquire) != SL_FREE) {
+    _futex_wait(&(lock->state), SL_CONTENDED);
+  }
+
+  STATS_WAIT_END(lock);
+  STATS_ACQUIRED(lock);
+}
+
+void sl_exit(spin_lock * lock) {
+  if (atomic_exchange_explicit(&(lock->state), SL_FREE,
+      memory_order_release) == SL_CONTENDED) {
+    _futex_wake(&(lock->state));
+  }
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef _SPINLOCK_H
+#define	_SPINLOCK_H
+
+#include <stdatomic.h>
+
+#include <jvmti.h>
+
+// *** Agent-internal locks ***
+
+// Lock guarding critical sections that are private to the agent. Acquiring
+// a JVMTI raw monitor always goes through the VM, so the lock first spins
+// in user space and only then sleeps on a futex.
+//
+// When built with RAW_MONITOR_LOCKS, the lock is backed by a JVMTI raw
+// monitor instead - used to compare both implementations.
+//
+// When built with LOCK_STATS, the lock counts acquisitions, contended
+// acquisitions and time spent waiting. The counters of all created locks
+// are printed by sl_print_stats().
+
+typedef struct {
+  const char * name;
+
+#ifdef RAW_MONITOR_LOCKS
+  jvmtiEnv * jvmti_env;
+  jrawMonitorID monitor;
+#else
+  // 0 - free, 1 - locked, 2 - locked and some thread may sleep on futex
+  atomic_int state;
+#endif
+
+#ifdef LOCK_STATS
+  atomic_llong acquired;
+  atomic_llong contended;
+  atomic_llong wait_ns;
+#endif
+} spin_lock;
+
+void sl_create(spin_lock * lock, jvmtiEnv * jvmti_env, const char * name);
+
+void sl_enter(spin_lock * lock);
+
+void sl_exit(spin_lock * lock);
+
+// prints statistics of all locks - does nothing without LOCK_STATS
+void sl_print_stats();
+
+#endif	/* _SPINLOCK_H */
@@ -27,6 +27,8 @@ static tldata * tld_init(tldata * tld) {
   tld->analysis_buff = NULL;
   tld->analysis_count = 0;
   tld->analysis_count_pos = 0;
+  tld->obj_free_chunk = INVALID_CHUNK_ID;
+  tld->object_ids = (id_block) ID_BLOCK_INIT;
 
   return tld;
 }
@@ -63,6 +65,8 @@ static __thread tldata tld = {
   .command_buff = NULL,
   .analysis_count = 0,
   .analysis_count_pos = 0,
+  .obj_free_chunk = INVALID_CHUNK_ID,
+  .object_ids = ID_BLOCK_INIT,
 };
 
 tldata * tld_get () {
@@ -2,6 +2,7 @@
 #define	_THREADLOCAL_H
 
 #include "buffer.h"
+#include "idalloc.h"
 
 // *** Thread locals ***
 
@@ -10,6 +11,7 @@
 
 #define INVALID_BUFF_ID -1
 #define INVALID_THREAD_ID -1
+#define INVALID_CHUNK_ID -1
 
 typedef struct {
   jlong id;
@@ -21,6 +23,8 @@ typedef struct {
   jint analysis_count;
   size_t analysis_count_pos;
   size_t args_length_pos;
+  jint obj_free_chunk;
+  id_block object_ids;
 } tldata;
 
 void tls_init();
@@ -6,6 +6,7 @@
 #include "shared/blockingqueue.h"
 #include "shared/buffpack.h"
 #include "shared/messagetype.h"
+#include "shared/spinlock.h"
 
 #include "netref.h"
 #include "pbmanager.h"
@@ -23,7 +24,7 @@ static volatile int no_tagging_work = 0;
 
 static int jvm_started = 0;
 
-static jrawMonitorID tagging_lock;
+static spin_lock tagging_lock;
 
 static pthread_t objtag_thread;
 
@@ -186,7 +187,7 @@ static void * tagger_loop(void * obj) {
     bq_pop(&objtag_q, &pb);
 
     // tag the objects - with lock
-    enter_critical_section(jvmti_env, tagging_lock);
+    sl_enter(&tagging_lock);
     {
       // tag objcects from buffer
       // note that analysis buffer is not required
@@ -209,7 +210,7 @@ static void * tagger_loop(void * obj) {
       buffer_clean(old_cmd_buff);
       new_obj_buff = old_cmd_buff;
     }
-    exit_critical_section(jvmti_env, tagging_lock);
+    sl_exit(&tagging_lock);
   }
 
   buffer_free(new_obj_buff);
@@ -223,9 +224,7 @@ void tagger_init(JavaVM * jvm, jvmtiEnv * env) {
   java_vm = jvm;
   jvmti_env = env;
 
-  jvmtiError error = (*jvmti_env)->CreateRawMonitor(jvmti_env, "object tags",
-      &tagging_lock);
-  check_jvmti_error(jvmti_env, error, "Cannot create raw monitor");
+  sl_create(&tagging_lock, jvmti_env, "object tags");
 
   bq_create(&objtag_q, BQ_BUFFERS, sizeof(process_buffs *));
 }
@@ -258,7 +257,7 @@ void tagger_jvmstart() {
 void tagger_newclass(JNIEnv* jni_env, jvmtiEnv *jvmti_env, jobject loader,
     const char* name, jint class_data_len, const unsigned char* class_data) {
   // tag the class loader - with lock
-  enter_critical_section(jvmti_env, tagging_lock);
+  sl_enter(&tagging_lock);
   {
     // retrieve class loader net ref
     jlong loader_id = NULL_NET_REF;
@@ -281,5 +280,5 @@ void tagger_newclass(JNIEnv* jni_env, jvmtiEnv *jvmti_env, jobject loader,
     // send message
     sender_enqueue(buffs);
   }
-  exit_critical_section(jvmti_env, tagging_lock);
+  sl_exit(&tagging_lock);
 }
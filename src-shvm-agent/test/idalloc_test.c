@@ -0,0 +1,118 @@
+// Test of the thread-local id blocks - growing block sizes and reuse of the
+// ranges returned by ended threads.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../shared/idalloc.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__); \
+      fprintf(stderr, "\n"); \
+      ++failures; \
+    } \
+  } while (0)
+
+#define BLOCK_MIN 16
+#define BLOCK_MAX 1024
+
+static void test_growing_blocks() {
+  id_counter counter = ID_COUNTER_INIT(1);
+  id_ranges spare;
+  id_ranges_create(&spare);
+
+  id_block block = ID_BLOCK_INIT;
+  jlong expected_size = BLOCK_MIN;
+  jlong id = 1;
+
+  // each block is twice the size of the previous one, up to the maximum
+  for (int i = 0; i < 10; ++i) {
+    for (jlong j = 0; j < expected_size; ++j, ++id) {
+      jlong next = id_next_from_block(&counter, &spare, &block, BLOCK_MIN,
+          BLOCK_MAX);
+      CHECK(next == id, "expected id %lld, got %lld", (long long) id,
+          (long long) next);
+    }
+
+    CHECK(block.size == expected_size, "expected block of %lld, got %lld",
+        (long long) expected_size, (long long) block.size);
+
+    expected_size = (2 * expected_size < BLOCK_MAX) ? 2 * expected_size
+        : BLOCK_MAX;
+  }
+}
+
+static void test_thread_churn() {
+  id_counter counter = ID_COUNTER_INIT(1);
+  id_ranges spare;
+  id_ranges_create(&spare);
+
+  // many threads, each allocating a single id and ending
+  enum { THREADS = 100000 };
+  jlong max_id = 0;
+  for (int i = 0; i < THREADS; ++i) {
+    id_block block = ID_BLOCK_INIT;
+    jlong id = id_next_from_block(&counter, &spare, &block, BLOCK_MIN,
+        BLOCK_MAX);
+    max_id = (id > max_id) ? id : max_id;
+
+    id_block_release(&spare, &block);
+    CHECK(block.next == block.end, "released block is not empty");
+  }
+
+  // the unused rest of each block is reused - no id is wasted
+  CHECK(max_id == THREADS, "expected highest id %d, got %lld", THREADS,
+      (long long) max_id);
+}
+
+static void test_unique_ids() {
+  id_counter counter = ID_COUNTER_INIT(1);
+  id_ranges spare;
+  id_ranges_create(&spare);
+
+  enum { IDS = 50000 };
+  char * seen = calloc(IDS + 4 * BLOCK_MAX + 1, 1);
+
+  // threads allocating different numbers of ids, some of them still running
+  id_block running[4] = { ID_BLOCK_INIT, ID_BLOCK_INIT, ID_BLOCK_INIT,
+      ID_BLOCK_INIT };
+  for (int i = 0; i < IDS; ++i) {
+    id_block * block = &(running[i % 4]);
+    jlong id = id_next_from_block(&counter, &spare, block, BLOCK_MIN,
+        BLOCK_MAX);
+
+    CHECK(id > 0 && id <= IDS + 4 * BLOCK_MAX, "id %lld out of range",
+        (long long) id);
+    if (id > 0 && id <= IDS + 4 * BLOCK_MAX) {
+      CHECK(!seen[id], "id %lld handed out twice", (long long) id);
+      seen[id] = 1;
+    }
+
+    // a thread ends and another one takes its place
+    if (i % 37 == 0) {
+      id_block_release(&spare, block);
+      *block = (id_block) ID_BLOCK_INIT;
+    }
+  }
+
+  free(seen);
+}
+
+int main() {
+  test_growing_blocks();
+  test_thread_churn();
+  test_unique_ids();
+
+  if (failures > 0) {
+    fprintf(stderr, "idalloc_test: %d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("idalloc_test: OK\n");
+  return EXIT_SUCCESS;
+}
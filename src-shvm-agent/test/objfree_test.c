@@ -0,0 +1,171 @@
+// Round-trip test of the object free message encoding. The expected bytes
+// of the fixed message are shared with ObjectFreeEncodingTest, which checks
+// the server side decoder.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../shared/buffer.h"
+#include "../shared/messagetype.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__); \
+      fprintf(stderr, "\n"); \
+      ++failures; \
+    } \
+  } while (0)
+
+// object free message type
+#define MSG_OBJ_FREE 2
+
+static const unsigned char expected_bytes[] = {
+  0x00, 0x00, 0x00, 0x06, 0x05, 0x02, 0xa5, 0x02, 0x00, 0xd4, 0xfd, 0xff,
+  0xff, 0xff, 0x1f, 0x00, 0x81, 0x80, 0x80, 0x80, 0x80, 0xe0, 0xff, 0xff,
+  0x7f, 0x00
+};
+
+static uint64_t _read_varlong(const unsigned char * data, size_t * pos) {
+  uint64_t result = 0;
+  int shift = 0;
+  unsigned char group;
+
+  do {
+    group = data[(*pos)++];
+    result |= (uint64_t) (group & 0x7F) << shift;
+    shift += 7;
+  } while ((group & 0x80) != 0 && shift < 64);
+
+  return result;
+}
+
+// decodes the message the same way as the server, returns the count
+static jint _decode(buffer * buff, jlong * tags) {
+  const unsigned char * data = buff->buff;
+  size_t pos = 0;
+
+  CHECK(data[pos++] == MSG_OBJ_FREE, "wrong message type %d", data[0]);
+
+  jint count = (jint) (((uint32_t) data[1] << 24) | ((uint32_t) data[2] << 16)
+      | ((uint32_t) data[3] << 8) | (uint32_t) data[4]);
+  pos += sizeof(jint);
+
+  uint64_t last = 0;
+  jint filled = 0;
+  while (filled < count && pos < buff->occupied) {
+    uint64_t first = last + _read_varlong(data, &pos);
+    uint64_t run_length = _read_varlong(data, &pos);
+
+    CHECK(run_length < (uint64_t) (count - filled),
+        "run length %llu exceeds count", (unsigned long long) run_length);
+    if (run_length >= (uint64_t) (count - filled)) {
+      break;
+    }
+
+    for (uint64_t i = 0; i <= run_length; ++i) {
+      tags[filled++] = (jlong) (first + i);
+    }
+
+    last = first + run_length;
+  }
+
+  CHECK(pos == buff->occupied, "%zu trailing bytes", buff->occupied - pos);
+  return filled;
+}
+
+static int _compare_unsigned(const void * a, const void * b) {
+  uint64_t first = *(const uint64_t *) a;
+  uint64_t second = *(const uint64_t *) b;
+  return (first > second) - (first < second);
+}
+
+static void _round_trip(const char * name, jlong * tags, jint count) {
+  jlong * expected = malloc(count * sizeof(jlong));
+  jlong * decoded = malloc(count * sizeof(jlong));
+  memcpy(expected, tags, count * sizeof(jlong));
+  qsort(expected, count, sizeof(jlong), _compare_unsigned);
+
+  buffer buff;
+  buffer_alloc(&buff);
+  messager_objfree_header(&buff, count);
+  messager_objfree_tags(&buff, tags, count);
+
+  jint decoded_count = _decode(&buff, decoded);
+  CHECK(decoded_count == count, "%s: decoded %d of %d tags", name,
+      decoded_count, count);
+  CHECK(decoded_count != count
+      || memcmp(decoded, expected, count * sizeof(jlong)) == 0,
+      "%s: decoded tags differ", name);
+
+  buffer_free(&buff);
+  free(decoded);
+  free(expected);
+}
+
+static void test_expected_bytes() {
+  jlong tags[] = { 7, 5, 6, 300, (jlong) 1 << 40,
+      (jlong) 0x8000000000000001ULL };
+  jint count = sizeof(tags) / sizeof(tags[0]);
+
+  buffer buff;
+  buffer_alloc(&buff);
+  messager_objfree_header(&buff, count);
+  messager_objfree_tags(&buff, tags, count);
+
+  CHECK(buff.occupied == 1 + sizeof(expected_bytes),
+      "expected %zu bytes, got %zu", 1 + sizeof(expected_bytes),
+      buff.occupied);
+  CHECK(buff.occupied != 1 + sizeof(expected_bytes)
+      || memcmp(buff.buff + 1, expected_bytes, sizeof(expected_bytes)) == 0,
+      "encoded bytes differ from the expected bytes");
+
+  buffer_free(&buff);
+}
+
+static void test_round_trip() {
+  jlong single[] = { 42 };
+  _round_trip("single", single, 1);
+
+  jlong mixed[] = { 3, 1, 2, 10, 12, 11, -1, -2, INT64_MIN };
+  _round_trip("mixed", mixed, sizeof(mixed) / sizeof(jlong));
+
+  // clustered tags, as produced by per-thread object id blocks
+  enum { COUNT = 4096 };
+  jlong * clustered = malloc(COUNT * sizeof(jlong));
+  srand(1);
+  jlong next = 1;
+  for (jint i = 0; i < COUNT; ++i) {
+    next += (rand() % 8 == 0) ? (rand() % 100000) + 2 : 1;
+    clustered[i] = next;
+  }
+
+  // shuffle, the chunk holds the tags in the order they were freed
+  for (jint i = COUNT - 1; i > 0; --i) {
+    jint j = rand() % (i + 1);
+    jlong tmp = clustered[i];
+    clustered[i] = clustered[j];
+    clustered[j] = tmp;
+  }
+
+  _round_trip("clustered", clustered, COUNT);
+  free(clustered);
+}
+
+int main() {
+  test_expected_bytes();
+  test_round_trip();
+
+  if (failures > 0) {
+    fprintf(stderr, "objfree_test: %d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("objfree_test: OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,344 @@
+// Test of the routing and flow control of the sender with several shards.
+// Each shard is a fake shadow VM on a local socket, which grants credits
+// only for analysis buffers. The test checks that every shard receives every
+// object free, that all buffers of an ordering id go to the same shard, and
+// that the credits of each shard balance.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+// the routing and flow control are internal to the sender
+#include "../sender.c"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__); \
+      fprintf(stderr, "\n"); \
+      ++failures; \
+    } \
+  } while (0)
+
+// message types
+#define MSG_CLOSE       0
+#define MSG_ANALYZE     1
+#define MSG_OBJ_FREE    2
+#define MSG_THREAD_END  8
+
+#define SHARDS      3
+#define IDS         100
+#define ROUNDS      3
+#define WINDOW      8
+
+// ******************* Stubs of the agent *******************
+
+static buffer stub_command;
+static buffer stub_analysis;
+static process_buffs stub_pb = { &stub_command, &stub_analysis, 0 };
+
+process_buffs * pb_normal_get(jlong thread_id) {
+  buffer_clean(&stub_command);
+  buffer_clean(&stub_analysis);
+  stub_pb.owner_id = thread_id;
+  return &stub_pb;
+}
+
+void pb_normal_release(process_buffs * buffs) {
+}
+
+void pb_utility_release(process_buffs * buffs) {
+}
+
+unsigned char net_ref_get_class_id_bits() {
+  return 22;
+}
+
+bool jvmti_get_system_property_bool(jvmtiEnv * jvmti, const char * name,
+    bool dflval) {
+  return dflval;
+}
+
+char * jvmti_get_system_property_string(jvmtiEnv * jvmti, const char * name,
+    const char * dflval) {
+  return strdup(dflval);
+}
+
+// ******************* Fake shadow VM *******************
+
+typedef struct {
+  int listen_fd;
+  int fd;
+  pthread_t thread;
+
+  // NOTE: updated by the server thread, read after it ends or under lock
+  pthread_mutex_t lock;
+  int analyze_frames;
+  int objfree_frames;
+  int thread_end_frames;
+  int close_frames;
+  jlong granted;
+  bool credit_exceeded;
+
+  int id_frames[IDS + 1];
+  int id_thread_ends[IDS + 1];
+} fake_server;
+
+static fake_server servers[SHARDS];
+
+static bool _read_fully(int fd, void * data, size_t size) {
+  size_t received = 0;
+  while (received < size) {
+    ssize_t res = recv(fd, (unsigned char *) data + received,
+        size - received, 0);
+    if (res <= 0) {
+      return false;
+    }
+
+    received += res;
+  }
+
+  return true;
+}
+
+static void _grant(fake_server * fs, uint32_t credits) {
+  uint32_t grant = htonl(credits);
+  send_bytes(fs->fd, &grant, sizeof(grant));
+  fs->granted += credits;
+}
+
+static jlong _frame_id(const unsigned char * frame) {
+  uint64_t id = 0;
+  for (size_t i = 1; i <= sizeof(jlong); ++i) {
+    id = (id << 8) | frame[i];
+  }
+
+  return (jlong) id;
+}
+
+static void * _server_loop(void * arg) {
+  fake_server * fs = arg;
+
+  fs->fd = accept(fs->listen_fd, NULL, NULL);
+  check_std_error(fs->fd == -1, "Cannot accept connection");
+
+  pthread_mutex_lock(&fs->lock);
+  _grant(fs, WINDOW);
+  pthread_mutex_unlock(&fs->lock);
+
+  // credits are returned in batches, like the server does
+  int ungranted = 0;
+  unsigned char frame[4096];
+
+  while (true) {
+    uint32_t length;
+    if (!_read_fully(fs->fd, &length, sizeof(length))) {
+      break;
+    }
+
+    length = ntohl(length);
+    check_error(length > sizeof(frame), "Frame too long");
+    check_error(!_read_fully(fs->fd, frame, length), "Truncated frame");
+
+    pthread_mutex_lock(&fs->lock);
+
+    switch (frame[0]) {
+    case MSG_ANALYZE:
+      ++fs->analyze_frames;
+      ++fs->id_frames[_frame_id(frame)];
+      fs->credit_exceeded |= (fs->analyze_frames > fs->granted);
+
+      if (++ungranted == WINDOW / 2) {
+        _grant(fs, ungranted);
+        ungranted = 0;
+      }
+      break;
+
+    case MSG_THREAD_END:
+      ++fs->thread_end_frames;
+      ++fs->id_thread_ends[_frame_id(frame)];
+      break;
+
+    case MSG_OBJ_FREE:
+      ++fs->objfree_frames;
+      break;
+
+    case MSG_CLOSE:
+      ++fs->close_frames;
+      break;
+    }
+
+    pthread_mutex_unlock(&fs->lock);
+  }
+
+  close(fs->fd);
+  return NULL;
+}
+
+static void _start_servers(char * endpoints, size_t size) {
+  endpoints[0] = '\0';
+
+  for (int i = 0; i < SHARDS; ++i) {
+    fake_server * fs = &servers[i];
+    memset(fs, 0, sizeof(*fs));
+    pthread_mutex_init(&fs->lock, NULL);
+
+    fs->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    check_std_error(fs->listen_fd == -1, "Cannot create socket");
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t addr_len = sizeof(addr);
+    check_std_error(bind(fs->listen_fd, (struct sockaddr *) &addr, addr_len)
+        == -1, "Cannot bind socket");
+    check_std_error(listen(fs->listen_fd, 1) == -1, "Cannot listen");
+    getsockname(fs->listen_fd, (struct sockaddr *) &addr, &addr_len);
+
+    size_t used = strlen(endpoints);
+    snprintf(endpoints + used, size - used, "%s127.0.0.1:%d",
+        (i > 0) ? ENDPOINT_DELIM : "", ntohs(addr.sin_port));
+
+    pthread_create(&fs->thread, NULL, _server_loop, fs);
+  }
+}
+
+// ******************* Agent side *******************
+
+static void _send_analysis(jlong ordering_id) {
+  process_buffs * pb = pb_normal_get(ordering_id);
+  messager_analyze_header(pb->analysis_buff, ordering_id);
+  send_buffers(pb);
+}
+
+static void _send_thread_end(jlong thread_id) {
+  process_buffs * pb = pb_normal_get(thread_id);
+  messager_threadend_header(pb->analysis_buff, thread_id);
+  send_buffers(pb);
+}
+
+static void _send_object_free(jlong first_tag) {
+  process_buffs * pb = pb_normal_get(0);
+  pb->owner_id = PB_UTILITY;
+
+  jlong tags[] = { first_tag, first_tag + 1, first_tag + 2 };
+  messager_objfree_header(pb->analysis_buff, 3);
+  messager_objfree_tags(pb->analysis_buff, tags, 3);
+  send_buffers(pb);
+}
+
+// waits until the agent has received all credits granted by the server
+static void _await_grants(shard * s, fake_server * fs, int expected_frames) {
+  for (int wait_ms = 0; wait_ms < 5000; ++wait_ms) {
+    pthread_mutex_lock(&fs->lock);
+    bool received_all = fs->analyze_frames == expected_frames;
+    jlong outstanding = fs->granted - fs->analyze_frames;
+    pthread_mutex_unlock(&fs->lock);
+
+    receive_credits(s, false);
+    if (received_all && s->credits == outstanding) {
+      return;
+    }
+
+    usleep(1000);
+  }
+}
+
+int main() {
+  // a credit charged for other than analysis buffers stalls the sender
+  alarm(60);
+
+  buffer_alloc(&stub_command);
+  buffer_alloc(&stub_analysis);
+
+  char endpoints[256];
+  _start_servers(endpoints, sizeof(endpoints));
+
+  parse_agent_options(endpoints);
+  ring_init();
+  policy = FC_BLOCK;
+
+  for (int i = 0; i < shard_count; ++i) {
+    shards[i].sockfd = open_connection(&shards[i]);
+  }
+
+  for (int round = 0; round < ROUNDS; ++round) {
+    for (jlong id = 1; id <= IDS; ++id) {
+      _send_analysis(id);
+    }
+
+    _send_object_free(round * 1000 + 1);
+  }
+
+  // more thread ends than credits in the window
+  for (jlong id = 1; id <= IDS; ++id) {
+    _send_thread_end(id);
+  }
+
+  // expected number of analysis buffers per shard
+  int expected_frames[SHARDS] = { 0 };
+  for (jlong id = 1; id <= IDS; ++id) {
+    expected_frames[shard_for(id) - shards] += ROUNDS;
+  }
+
+  for (int i = 0; i < SHARDS; ++i) {
+    _await_grants(&shards[i], &servers[i], expected_frames[i]);
+
+    jlong outstanding = servers[i].granted - expected_frames[i];
+    CHECK(shards[i].credits == outstanding,
+        "shard %d: agent has %lld credits, server granted %lld unused", i,
+        (long long) shards[i].credits, (long long) outstanding);
+  }
+
+  close_connections();
+
+  int used_shards = 0;
+  for (int i = 0; i < SHARDS; ++i) {
+    fake_server * fs = &servers[i];
+    pthread_join(fs->thread, NULL);
+    close(fs->listen_fd);
+
+    CHECK(fs->objfree_frames == ROUNDS, "shard %d: %d of %d object frees", i,
+        fs->objfree_frames, ROUNDS);
+    CHECK(fs->close_frames == 1, "shard %d: %d close messages", i,
+        fs->close_frames);
+    CHECK(!fs->credit_exceeded, "shard %d: more buffers than credits", i);
+    CHECK(fs->analyze_frames == expected_frames[i],
+        "shard %d: %d of %d analysis buffers", i, fs->analyze_frames,
+        expected_frames[i]);
+
+    for (jlong id = 1; id <= IDS; ++id) {
+      bool owner = shard_for(id) == &shards[i];
+      CHECK(fs->id_frames[id] == (owner ? ROUNDS : 0),
+          "shard %d: %d analysis buffers of ordering id %lld", i,
+          fs->id_frames[id], (long long) id);
+      CHECK(fs->id_thread_ends[id] == (owner ? 1 : 0),
+          "shard %d: %d thread ends of thread %lld", i,
+          fs->id_thread_ends[id], (long long) id);
+    }
+
+    used_shards += (fs->analyze_frames > 0);
+  }
+
+  CHECK(used_shards > 1, "all ordering ids routed to one shard");
+
+  buffer_free(&stub_command);
+  buffer_free(&stub_analysis);
+
+  if (failures > 0) {
+    fprintf(stderr, "sender_test: %d failures\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("sender_test: OK\n");
+  return EXIT_SUCCESS;
+}
@@ -1,5 +1,6 @@
 #include "tlocalbuffer.h"
 
+#include "shared/idalloc.h"
 #include "shared/threadlocal.h"
 #include "shared/messagetype.h"
 #include "shared/buffpack.h"
@@ -14,29 +15,11 @@
 #define ANALYSIS_COUNT 16384
 
 // initial ids are reserved for total ordering buffers
-static volatile jlong avail_thread_id = STARTING_THREAD_ID;
-
-static jvmtiEnv * jvmti_env;
-static jrawMonitorID threadID_lock;
+static id_counter thread_ids = ID_COUNTER_INIT(STARTING_THREAD_ID);
 
 static jlong next_thread_id() {
-  // mark the thread - with lock
-  // TODO replace total ordering lock with private lock - perf. issue
-  jlong result = -1;
-  enter_critical_section(jvmti_env, threadID_lock);
-  {
-    result = avail_thread_id++;
-  }
-  exit_critical_section(jvmti_env, threadID_lock);
-  return result;
-}
-
-void tl_init(jvmtiEnv * env) {
-  jvmti_env = env;
-
-  jvmtiError error = (*jvmti_env)->CreateRawMonitor(jvmti_env, "thread id",
-      &threadID_lock);
-  check_jvmti_error(jvmti_env, error, "Cannot create raw monitor");
+  // mark the thread
+  return id_next(&thread_ids);
 }
 
 void tl_insert_analysis_item(jshort analysis_method_id) {
@@ -5,8 +5,6 @@
 
 #include "shared/buffer.h"
 
-void tl_init(jvmtiEnv * env);
-
 void tl_insert_analysis_item(jshort analysis_method_id);
 void tl_insert_analysis_item_ordering(jshort analysis_method_id,
     jbyte ordering_id);
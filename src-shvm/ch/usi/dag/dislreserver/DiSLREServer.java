@@ -1,23 +1,21 @@
 package ch.usi.dag.dislreserver;
 
-import java.io.BufferedInputStream;
 import java.io.BufferedOutputStream;
 import java.io.Closeable;
-import java.io.DataInputStream;
 import java.io.DataOutputStream;
 import java.io.File;
 import java.io.IOException;
 import java.io.PrintWriter;
 import java.io.StringWriter;
 import java.net.InetSocketAddress;
-import java.net.Socket;
 import java.net.SocketAddress;
 import java.net.StandardSocketOptions;
+import java.nio.channels.Channels;
 import java.nio.channels.ClosedByInterruptException;
 import java.nio.channels.ServerSocketChannel;
 import java.nio.channels.SocketChannel;
 
-import ch.usi.dag.dislreserver.reqdispatch.RequestDispatcher;
+import ch.usi.dag.dislreserver.reqdispatch.RequestPipeline;
 import ch.usi.dag.dislreserver.util.Logging;
 import ch.usi.dag.util.logging.Logger;
 
@@ -34,6 +32,9 @@ public abstract class DiSLREServer {
     private static final String PROP_PORT = "dislreserver.port";
     private static final int DEFAULT_PORT = 11218;
 
+    // serve any number of agents at once, each in its own session
+    private static final String PROP_MULTI_TENANT = "dislreserver.multiTenant";
+
     //
 
     private static final String __PID_FILE__ = "server.pid.file";
@@ -67,13 +68,21 @@ public abstract class DiSLREServer {
 
     private static void run (final ServerSocketChannel socket) {
         try {
+            if (Boolean.getBoolean (PROP_MULTI_TENANT)) {
+                Session.enableMultiTenancy ();
+
+                while (true) {
+                    __startSession (socket.accept ());
+                }
+            }
+
             final SocketChannel clientSocket = socket.accept ();
 
             __log.debug (
                 "connection from %s", clientSocket.getRemoteAddress ()
             );
 
-            processRequests (clientSocket.socket ());
+            processRequests (clientSocket);
             clientSocket.close ();
 
         } catch (final ClosedByInterruptException cbie) {
@@ -94,19 +103,44 @@ public abstract class DiSLREServer {
     }
 
 
-    private static void processRequests (final Socket sock) {
-        try {
-            final DataInputStream is = new DataInputStream (
-                new BufferedInputStream (sock.getInputStream ()));
-            final DataOutputStream os = new DataOutputStream (
-                new BufferedOutputStream (sock.getOutputStream ()));
+    private static void __startSession (final SocketChannel clientSocket)
+    throws IOException {
+        final Session session = Session.open ();
+
+        __log.debug (
+            "session %d: connection from %s",
+            session.getId (), clientSocket.getRemoteAddress ()
+        );
 
-            REQUEST_LOOP: while (true) {
-                final byte requestNo = is.readByte ();
-                if (RequestDispatcher.dispatch (requestNo, is, os, debug)) {
-                    break REQUEST_LOOP;
+        final Thread thread = new Thread ("DiSL-RE session " + session.getId ()) {
+            @Override
+            public void run () {
+                session.bind ();
+
+                try {
+                    processRequests (clientSocket);
+
+                } finally {
+                    __closeSocket (clientSocket);
+                    session.close ();
+                    Session.unbind ();
+
+                    __log.debug ("session %d: finished", session.getId ());
                 }
             }
+        };
+
+        thread.setDaemon (true);
+        thread.start ();
+    }
+
+
+    private static void processRequests (final SocketChannel channel) {
+        try {
+            final DataOutputStream os = new DataOutputStream (
+                new BufferedOutputStream (Channels.newOutputStream (channel)));
+
+            new RequestPipeline (channel, os, debug).run ();
 
         } catch (final Exception e) {
             __logError (e);
@@ -0,0 +1,194 @@
+package ch.usi.dag.dislreserver;
+
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.Collections;
+import java.util.List;
+import java.util.concurrent.atomic.AtomicInteger;
+
+
+/**
+ * State of the shadow VM serving one observed JVM.
+ * <p>
+ * Components keep their per-agent state in a session under a {@link Key} and
+ * look it up through {@link #current()}. By default, the server serves a
+ * single agent and all threads share the default session. In the
+ * multi-tenant mode, every connection has its own session and the threads
+ * working for a connection have to {@link #bind()} its session first.
+ */
+public final class Session {
+
+    /**
+     * Identifies a component state kept in sessions. Keys are expected to be
+     * held in static fields of the components.
+     */
+    public static abstract class Key <T> {
+
+        private final int index = __keyCount.getAndIncrement ();
+
+        /**
+         * Creates the state of the component on its first use in a session.
+         */
+        protected abstract T create (Session session);
+
+        /**
+         * Releases the state of the component when the session is closed.
+         */
+        protected void close (final T value) {
+            // nothing to release by default
+        }
+
+        @SuppressWarnings ("unchecked")
+        private void __close (final Object value) {
+            close ((T) value);
+        }
+    }
+
+    //
+
+    private static final AtomicInteger __keyCount = new AtomicInteger ();
+
+    private static final AtomicInteger __sessionCount = new AtomicInteger ();
+
+    private static final ThreadLocal <Session> __boundSession = new ThreadLocal <Session> ();
+
+    private static volatile boolean __multiTenant = false;
+
+    private static final Session __defaultSession = new Session (0);
+
+    //
+
+    private final int id;
+
+    // component states indexed by key index - guarded by "this" for updates
+    private volatile Object [] values = new Object [0];
+
+    // keys of the created states in the order of creation - guarded by "this"
+    private final List <Key <?>> createdKeys = new ArrayList <Key <?>> ();
+
+    //
+
+    private Session (final int id) {
+        this.id = id;
+    }
+
+
+    /**
+     * Switches the server to the multi-tenant mode. Must be called before
+     * any session is used.
+     */
+    public static void enableMultiTenancy () {
+        __multiTenant = true;
+    }
+
+
+    public static boolean isMultiTenant () {
+        return __multiTenant;
+    }
+
+
+    /**
+     * Creates a new session for a connection in the multi-tenant mode.
+     */
+    public static Session open () {
+        return new Session (__sessionCount.incrementAndGet ());
+    }
+
+
+    /**
+     * Returns the session of the current thread.
+     */
+    public static Session current () {
+        if (!__multiTenant) {
+            return __defaultSession;
+        }
+
+        final Session result = __boundSession.get ();
+        if (result == null) {
+            throw new DiSLREServerFatalException (
+                "No session bound to thread " + Thread.currentThread ().getName ()
+            );
+        }
+
+        return result;
+    }
+
+
+    /**
+     * Binds the session to the current thread.
+     */
+    public void bind () {
+        if (__multiTenant) {
+            __boundSession.set (this);
+        }
+    }
+
+
+    /**
+     * Removes the session binding of the current thread.
+     */
+    public static void unbind () {
+        if (__multiTenant) {
+            __boundSession.remove ();
+        }
+    }
+
+    //
+
+    public int getId () {
+        return id;
+    }
+
+
+    public <T> T get (final Key <T> key) {
+        final Object [] current = values;
+        if (key.index < current.length && current [key.index] != null) {
+            @SuppressWarnings ("unchecked")
+            final T result = (T) current [key.index];
+            return result;
+        }
+
+        return __create (key);
+    }
+
+
+    private synchronized <T> T __create (final Key <T> key) {
+        Object [] current = values;
+        if (key.index < current.length && current [key.index] != null) {
+            // created in the meantime
+            @SuppressWarnings ("unchecked")
+            final T result = (T) current [key.index];
+            return result;
+        }
+
+        final T result = key.create (this);
+
+        // the creation may have added states of other components
+        current = values;
+        current = Arrays.copyOf (current, Math.max (current.length, key.index + 1));
+        current [key.index] = result;
+        values = current;
+
+        createdKeys.add (key);
+
+        return result;
+    }
+
+
+    /**
+     * Releases the states of all components of the session.
+     */
+    public synchronized void close () {
+        // components created later may depend on those created earlier
+        Collections.reverse (createdKeys);
+
+        final Object [] current = values;
+        for (final Key <?> key : createdKeys) {
+            key.__close (current [key.index]);
+        }
+
+        createdKeys.clear ();
+        values = new Object [0];
+    }
+
+}
@@ -2,17 +2,18 @@ package ch.usi.dag.dislreserver.msg.analyze;
 
 import java.io.DataInputStream;
 import java.io.DataOutputStream;
-import java.io.IOException;
 import java.lang.reflect.Method;
+import java.nio.BufferUnderflowException;
+import java.nio.ByteBuffer;
+import java.util.IdentityHashMap;
 import java.util.LinkedList;
 import java.util.List;
+import java.util.Map;
 
 import ch.usi.dag.dislreserver.DiSLREServerException;
 import ch.usi.dag.dislreserver.msg.analyze.AnalysisResolver.AnalysisMethodHolder;
 import ch.usi.dag.dislreserver.msg.analyze.mtdispatch.AnalysisDispatcher;
 import ch.usi.dag.dislreserver.reqdispatch.RequestHandler;
-import ch.usi.dag.dislreserver.shadow.ShadowObject;
-import ch.usi.dag.dislreserver.shadow.ShadowObjectTable;
 
 
 public final class AnalysisHandler implements RequestHandler {
@@ -23,16 +24,33 @@ public final class AnalysisHandler implements RequestHandler {
         return dispatcher;
     }
 
+    /**
+     * Analysis requests are decoded from whole request frames, see
+     * {@link #handle(ByteBuffer, boolean)}.
+     */
     public void handle (
         final DataInputStream is, final DataOutputStream os, final boolean debug
     ) throws DiSLREServerException {
+        throw new DiSLREServerException (
+            "analysis requests can only be decoded from request frames"
+        );
+    }
+
 
+    /**
+     * Decodes an analysis request (without the request id) from the buffer
+     * and enqueues the invocations for the ordering id of the request. Can be
+     * called concurrently for different ordering ids.
+     */
+    public void handle (
+        final ByteBuffer buffer, final boolean debug
+    ) throws DiSLREServerException {
         try {
             // get net reference for the thread
-            long orderingID = is.readLong ();
+            final long orderingID = buffer.getLong ();
 
             // read and create method invocations
-            final int invocationCount = is.readInt ();
+            final int invocationCount = buffer.getInt ();
             if (invocationCount < 0) {
                 throw new DiSLREServerException (String.format (
                     "invalid number of analysis invocation requests: %d",
@@ -40,159 +58,142 @@ public final class AnalysisHandler implements RequestHandler {
                 ));
             }
 
-            List <AnalysisInvocation> invocations = __unmarshalInvocations (
-                invocationCount, is, debug
+            final List <AnalysisInvocation> invocations = __unmarshalInvocations (
+                orderingID, invocationCount, buffer, debug
             );
 
             dispatcher.addTask (orderingID, invocations);
 
-        } catch (final IOException ioe) {
-            throw new DiSLREServerException(ioe);
+        } catch (final BufferUnderflowException bue) {
+            throw new DiSLREServerException ("truncated analysis request");
         }
     }
 
 
     private List <AnalysisInvocation> __unmarshalInvocations (
-        final int invocationCount, final DataInputStream is, final boolean debug
+        final long orderingID, final int invocationCount,
+        final ByteBuffer buffer, final boolean debug
     ) throws DiSLREServerException {
         final List <AnalysisInvocation> result =
             new LinkedList <AnalysisInvocation> ();
 
-        for (int i = 0; i < invocationCount; ++i) {
-            result.add (__unmarshalInvocation (is, debug));
-        }
-
-        return result;
-    }
+        // consecutive events of a batch method are collected into a single
+        // invocation - an event of another method closes the batch, so that
+        // the events stay in order
+        AnalysisMethodHolder batchMethod = null;
+        AnalysisInvocation batch = null;
 
+        // instances of thread-confined analyses for the ordering id
+        final Map <ConfinedInstances, Object> confined =
+            new IdentityHashMap <ConfinedInstances, Object> ();
 
-    private AnalysisInvocation __unmarshalInvocation (
-        final DataInputStream is, final boolean debug
-    ) throws DiSLREServerException {
-        try {
-            // *** retrieve method ***
+        for (int i = 0; i < invocationCount; ++i) {
+            final AnalysisMethodHolder amh = __unmarshalMethod (buffer, debug);
 
-            // read method id from network and retrieve method
-            final short methodId = is.readShort ();
-            AnalysisMethodHolder amh = AnalysisResolver.getMethod (methodId);
+            if (amh.isBatch ()) {
+                // append argument values to the batch of the method
+                if (amh != batchMethod) {
+                    batch = amh.newBatch (__getAnalysis (amh, orderingID, confined));
+                    batchMethod = amh;
+                    result.add (batch);
+                }
 
-            // *** retrieve method argument values ***
+                batch.unmarshal (buffer);
 
-            final Method method = amh.getAnalysisMethod ();
+            } else {
+                batchMethod = null;
+                batch = null;
 
-            // read the length of argument data in the request
-            final short argsLength = is.readShort ();
-            if (argsLength < 0) {
-                throw new DiSLREServerException (String.format (
-                    "invalid value of marshalled argument data length for analysis method %d (%s.%s): %d",
-                    methodId, method.getDeclaringClass ().getName (),
-                    method.getName (), argsLength
+                result.add (__unmarshalInvocation (
+                    amh, orderingID, buffer, confined
                 ));
             }
+        }
 
-            // read argument values data according to argument types
-            int readLength = 0;
-            final List <Object> args = new LinkedList <Object> ();
-            for (Class <?> argClass : method.getParameterTypes ()) {
-                readLength += unmarshalAndCollectArgument (
-                    is, argClass, method, args
-                );
-            }
-
-            if (readLength != argsLength) {
-                throw new DiSLREServerException (String.format (
-                    "received %d, but unmarshalled %d bytes of argument data for analysis method %d (%s.%s)",
-                    argsLength, readLength, methodId, method.getDeclaringClass ().getName (),
-                    method.getName ()
-                ));
-            }
+        return result;
+    }
 
-            // *** create analysis invocation ***
 
-            if(debug) {
-                System.out.printf (
-                    "DiSL-RE: dispatching analysis method (%d) to %s.%s()\n",
-                    methodId, amh.getAnalysisInstance().getClass().getSimpleName (),
-                    method.getName()
-                );
-            }
-            return new AnalysisInvocation (
-                method, amh.getAnalysisInstance (), args
-            );
+    // reads the method id and the length of the argument data
+    private AnalysisMethodHolder __unmarshalMethod (
+        final ByteBuffer buffer, final boolean debug
+    ) throws DiSLREServerException {
+        // *** retrieve method ***
 
-        } catch (final IOException ioe) {
-            throw new DiSLREServerException (ioe);
-        } catch (final IllegalArgumentException iae) {
-            throw new DiSLREServerException (iae);
-        }
-    }
+        // read method id from network and retrieve method
+        final short methodId = buffer.getShort ();
+        AnalysisMethodHolder amh = AnalysisResolver.getMethod (methodId);
 
+        // *** retrieve method argument values ***
 
-    private int unmarshalAndCollectArgument (
-        final DataInputStream is, final Class <?> argClass,
-        final Method analysisMethod, List <Object> args
-    ) throws IOException, DiSLREServerException {
+        final Method method = amh.getAnalysisMethod ();
 
-        if (argClass.equals (boolean.class)) {
-            args.add (is.readBoolean ());
-            return Byte.SIZE / Byte.SIZE;
+        // read the length of argument data in the request
+        final short argsLength = buffer.getShort ();
+        if (argsLength < 0) {
+            throw new DiSLREServerException (String.format (
+                "invalid value of marshalled argument data length for analysis method %d (%s.%s): %d",
+                methodId, method.getDeclaringClass ().getName (),
+                method.getName (), argsLength
+            ));
         }
 
-        if (argClass.equals (char.class)) {
-            args.add (is.readChar ());
-            return Character.SIZE / Byte.SIZE;
+        // argument data length is given by the argument types
+        if (argsLength != amh.getArgumentsLength ()) {
+            throw new DiSLREServerException (String.format (
+                "received %d, but expected %d bytes of argument data for analysis method %d (%s.%s)",
+                argsLength, amh.getArgumentsLength (), methodId,
+                method.getDeclaringClass ().getName (), method.getName ()
+            ));
         }
 
-        if (argClass.equals (byte.class)) {
-            args.add (is.readByte ());
-            return Byte.SIZE / Byte.SIZE;
+        if(debug) {
+            System.out.printf (
+                "DiSL-RE: dispatching analysis method (%d) to %s.%s()\n",
+                methodId, amh.getAnalysisInstance().getClass().getSimpleName (),
+                method.getName()
+            );
         }
 
-        if (argClass.equals (short.class)) {
-            args.add (is.readShort ());
-            return Short.SIZE / Byte.SIZE;
-        }
+        return amh;
+    }
 
-        if (argClass.equals (int.class)) {
-            args.add (is.readInt ());
-            return Integer.SIZE / Byte.SIZE;
-        }
 
-        if (argClass.equals (long.class)) {
-            args.add (is.readLong ());
-            return Long.SIZE / Byte.SIZE;
-        }
+    private AnalysisInvocation __unmarshalInvocation (
+        final AnalysisMethodHolder amh, final long orderingID,
+        final ByteBuffer buffer, final Map <ConfinedInstances, Object> confined
+    ) throws DiSLREServerException {
+        // read argument values using the generated invocation
+        final AnalysisInvocation result =
+            amh.getInvocationPrototype ().unmarshal (buffer);
 
-        if (argClass.equals (float.class)) {
-            args.add (is.readFloat ());
-            return Float.SIZE / Byte.SIZE;
+        if (amh.getConfinedInstances () != null) {
+            result.bindAnalysis (__getAnalysis (amh, orderingID, confined));
         }
 
-        if (argClass.equals (double.class)) {
-            args.add (is.readDouble ());
-            return Double.SIZE / Byte.SIZE;
-        }
+        return result;
+    }
 
-        if (ShadowObject.class.isAssignableFrom(argClass)) {
-            long net_ref = is.readLong();
 
-            // null handling
-            if (net_ref == 0) {
-                args.add(null);
-            } else {
-                args.add(ShadowObjectTable.get(net_ref));
-            }
+    private Object __getAnalysis (
+        final AnalysisMethodHolder amh, final long orderingID,
+        final Map <ConfinedInstances, Object> confined
+    ) throws DiSLREServerException {
+        final ConfinedInstances instances = amh.getConfinedInstances ();
+        if (instances == null) {
+            return amh.getAnalysisInstance ();
+        }
 
-            return Long.SIZE / Byte.SIZE;
+        Object result = confined.get (instances);
+        if (result == null) {
+            result = instances.get (orderingID);
+            confined.put (instances, result);
         }
 
-        throw new DiSLREServerException (String.format (
-            "Unsupported data type %s in analysis method %s.%s",
-            argClass.getName (), analysisMethod.getDeclaringClass ().getName (),
-            analysisMethod.getName ()
-        ));
+        return result;
     }
 
+
     public void threadEnded(long threadId) {
         dispatcher.threadEndedEvent(threadId);
     }
@@ -1,39 +1,73 @@
 package ch.usi.dag.dislreserver.msg.analyze;
 
 import java.lang.reflect.Method;
-import java.util.List;
+import java.nio.ByteBuffer;
 
-public class AnalysisInvocation {
+/**
+ * Invocation of an analysis method together with its argument values.
+ * <p>
+ * Subclasses are generated for each registered analysis method by
+ * {@link AnalysisInvocationGenerator}. They keep the argument values in
+ * typed fields and call the analysis method directly, without boxing or
+ * reflection. An instance without arguments serves as a prototype that
+ * unmarshals the invocations of its method.
+ */
+public abstract class AnalysisInvocation {
 
-    private Method analysisMethod;
-    private Object analysisInstance;
-    private List<Object> args;
+    private final Method analysisMethod;
 
-    public AnalysisInvocation (
-        Method analysisMethod, Object analysisInstance,
-        List<Object> args
+    // analysis instance the method is invoked on
+    protected Object analysis;
+
+    protected AnalysisInvocation (
+        final Method analysisMethod, final Object analysis
     ) {
-        super();
         this.analysisMethod = analysisMethod;
-        this.analysisInstance = analysisInstance;
-        this.args = args;
+        this.analysis = analysis;
+    }
+
+    public Method getAnalysisMethod () {
+        return analysisMethod;
     }
 
+    // rebinds an unmarshalled invocation to a thread-confined instance
+    void bindAnalysis (final Object analysis) {
+        this.analysis = analysis;
+    }
+
+    /**
+     * Reads the argument values from the request buffer and creates a new
+     * invocation of the same analysis method. Batch invocations append the
+     * values to the batch and return themselves.
+     *
+     * @throws java.nio.BufferUnderflowException
+     *         if the buffer does not contain all argument values
+     */
+    public abstract AnalysisInvocation unmarshal (ByteBuffer buffer);
+
+
+    /**
+     * Reads a boolean argument value, used by the generated invocations.
+     */
+    public static boolean getBoolean (final ByteBuffer buffer) {
+        return buffer.get () != 0;
+    }
+
+    protected abstract void invokeAnalysis () throws Throwable;
+
     public void invoke () {
         try {
-            analysisMethod.invoke (analysisInstance, args.toArray());
+            invokeAnalysis ();
 
-        } catch (final Exception e) {
+        } catch (final Throwable t) {
             // report error during analysis invocation
-            final Throwable cause = e.getCause ();
-
             System.err.format (
                 "DiSL-RE: exception in analysis %s.%s(): ",
                 analysisMethod.getDeclaringClass ().getName (),
                 analysisMethod.getName ()
             );
 
-            cause.printStackTrace();
+            t.printStackTrace();
         }
     }
 }
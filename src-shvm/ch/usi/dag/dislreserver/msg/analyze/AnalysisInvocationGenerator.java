@@ -0,0 +1,432 @@
+package ch.usi.dag.dislreserver.msg.analyze;
+
+import java.lang.reflect.Constructor;
+import java.lang.reflect.Method;
+import java.lang.reflect.Modifier;
+import java.nio.ByteBuffer;
+import java.util.HashMap;
+import java.util.Map;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ConcurrentMap;
+
+import org.objectweb.asm.ClassWriter;
+import org.objectweb.asm.MethodVisitor;
+import org.objectweb.asm.Opcodes;
+import org.objectweb.asm.Type;
+
+import ch.usi.dag.dislreserver.DiSLREServerException;
+import ch.usi.dag.dislreserver.remoteanalysis.RemoteAnalysis;
+import ch.usi.dag.dislreserver.shadow.ShadowObject;
+import ch.usi.dag.dislreserver.shadow.ShadowObjectTable;
+import ch.usi.dag.dislreserver.shadow.ShadowReference;
+
+/**
+ * Generates an {@link AnalysisInvocation} subclass for an analysis method.
+ * The generated class reads the arguments directly from the request buffer
+ * into typed fields and invokes the analysis method, using invokestatic for
+ * static analysis methods and invokevirtual on the analysis instance
+ * otherwise.
+ */
+final class AnalysisInvocationGenerator {
+
+    private static final String GENERATED_PACKAGE =
+        "ch/usi/dag/dislreserver/msg/analyze/generated/";
+
+    private static final String ANALYSIS_FIELD = "analysis";
+    private static final String ARGUMENT_FIELD = "arg";
+
+    private static final String INVOCATION_NAME =
+        Type.getInternalName (AnalysisInvocation.class);
+    private static final String INPUT_NAME =
+        Type.getInternalName (ByteBuffer.class);
+    private static final String OBJECT_TABLE_NAME =
+        Type.getInternalName (ShadowObjectTable.class);
+
+    private static final String OBJECT_DESC =
+        Type.getDescriptor (Object.class);
+    private static final String SHADOW_OBJECT_DESC =
+        Type.getDescriptor (ShadowObject.class);
+    private static final String SHADOW_REFERENCE_NAME =
+        Type.getInternalName (ShadowReference.class);
+
+    private static final String CONSTRUCTOR_DESC = Type.getMethodDescriptor (
+        Type.VOID_TYPE, Type.getType (Method.class), Type.getType (Object.class)
+    );
+
+    //
+
+    /**
+     * Describes how an argument of the given type is unmarshalled.
+     */
+    private static final class ArgumentType {
+        final String readMethod;
+        final String fieldDesc;
+        final int size;
+
+        ArgumentType (
+            final String readMethod, final String fieldDesc, final int size
+        ) {
+            this.readMethod = readMethod;
+            this.fieldDesc = fieldDesc;
+            this.size = size;
+        }
+    }
+
+    private static final Map <Class <?>, ArgumentType>
+        primitiveTypes = new HashMap <Class <?>, ArgumentType> ();
+
+    private static final ArgumentType SHADOW_OBJECT_TYPE =
+        new ArgumentType ("getLong", SHADOW_OBJECT_DESC, Long.SIZE / Byte.SIZE);
+
+    // net reference resolved by the analysis - kept as long until invocation
+    private static final ArgumentType SHADOW_REFERENCE_TYPE =
+        new ArgumentType ("getLong", "J", Long.SIZE / Byte.SIZE);
+
+    static {
+        primitiveTypes.put (boolean.class,
+            new ArgumentType ("getBoolean", "Z", Byte.SIZE / Byte.SIZE));
+        primitiveTypes.put (char.class,
+            new ArgumentType ("getChar", "C", Character.SIZE / Byte.SIZE));
+        primitiveTypes.put (byte.class,
+            new ArgumentType ("get", "B", Byte.SIZE / Byte.SIZE));
+        primitiveTypes.put (short.class,
+            new ArgumentType ("getShort", "S", Short.SIZE / Byte.SIZE));
+        primitiveTypes.put (int.class,
+            new ArgumentType ("getInt", "I", Integer.SIZE / Byte.SIZE));
+        primitiveTypes.put (long.class,
+            new ArgumentType ("getLong", "J", Long.SIZE / Byte.SIZE));
+        primitiveTypes.put (float.class,
+            new ArgumentType ("getFloat", "F", Float.SIZE / Byte.SIZE));
+        primitiveTypes.put (double.class,
+            new ArgumentType ("getDouble", "D", Double.SIZE / Byte.SIZE));
+    }
+
+    private static int generatedCount = 0;
+
+    // invocation classes are shared by all sessions using the method
+    private static final ConcurrentMap <Method, Constructor <?>>
+        invocationConstructors = new ConcurrentHashMap <Method, Constructor <?>> ();
+
+    //
+
+    private static ArgumentType __getArgumentType (
+        final Class <?> argClass, final Method analysisMethod
+    ) throws DiSLREServerException {
+        final ArgumentType primitiveType = primitiveTypes.get (argClass);
+        if (primitiveType != null) {
+            return primitiveType;
+        }
+
+        if (ShadowObject.class.isAssignableFrom (argClass)) {
+            return SHADOW_OBJECT_TYPE;
+        }
+
+        if (ShadowReference.class.equals (argClass)) {
+            return SHADOW_REFERENCE_TYPE;
+        }
+
+        throw new DiSLREServerException (String.format (
+            "Unsupported data type %s in analysis method %s.%s",
+            argClass.getName (), analysisMethod.getDeclaringClass ().getName (),
+            analysisMethod.getName ()
+        ));
+    }
+
+
+    /**
+     * Returns the length of marshalled argument data of the analysis method.
+     */
+    static int argumentsLength (final Method analysisMethod)
+    throws DiSLREServerException {
+        int result = 0;
+        for (final Class <?> argClass : analysisMethod.getParameterTypes ()) {
+            result += __getArgumentType (argClass, analysisMethod).size;
+        }
+
+        return result;
+    }
+
+
+    /**
+     * Returns a prototype instance of the invocation class for the analysis
+     * method bound to the analysis instance. The class is generated on the
+     * first use of the method.
+     */
+    static AnalysisInvocation generate (
+        final RemoteAnalysis analysis, final Method analysisMethod
+    ) throws DiSLREServerException {
+        Constructor <?> constructor = invocationConstructors.get (analysisMethod);
+        if (constructor == null) {
+            constructor = __defineInvocationClass (analysis, analysisMethod);
+
+            final Constructor <?> existing = invocationConstructors.putIfAbsent (
+                analysisMethod, constructor
+            );
+
+            if (existing != null) {
+                constructor = existing;
+            }
+        }
+
+        try {
+            return (AnalysisInvocation) constructor.newInstance (
+                analysisMethod, analysis
+            );
+
+        } catch (final Exception e) {
+            throw new DiSLREServerException (e);
+        }
+    }
+
+
+    private static Constructor <?> __defineInvocationClass (
+        final RemoteAnalysis analysis, final Method analysisMethod
+    ) throws DiSLREServerException {
+        final Class <?> declaringClass = analysisMethod.getDeclaringClass ();
+        if (!Modifier.isPublic (declaringClass.getModifiers ())) {
+            throw new DiSLREServerException (String.format (
+                "Analysis method %s.%s is not declared in a public class",
+                declaringClass.getName (), analysisMethod.getName ()
+            ));
+        }
+
+        final Class <?> [] argClasses = analysisMethod.getParameterTypes ();
+        final ArgumentType [] argTypes = new ArgumentType [argClasses.length];
+        for (int i = 0; i < argClasses.length; ++i) {
+            argTypes [i] = __getArgumentType (argClasses [i], analysisMethod);
+        }
+
+        final String className = __generateClassName (analysisMethod);
+        final byte [] classCode = __generateClass (
+            className, analysisMethod, argClasses, argTypes
+        );
+
+        try {
+            final Class <?> invocationClass = new InvocationClassLoader (
+                analysis.getClass ().getClassLoader ()
+            ).define (className.replace ('/', '.'), classCode);
+
+            return invocationClass.getConstructor (Method.class, Object.class);
+
+        } catch (final Exception e) {
+            throw new DiSLREServerException (e);
+        } catch (final LinkageError e) {
+            throw new DiSLREServerException (e);
+        }
+    }
+
+
+    private static synchronized String __generateClassName (
+        final Method analysisMethod
+    ) {
+        return GENERATED_PACKAGE
+            + analysisMethod.getDeclaringClass ().getSimpleName ()
+            + "$" + analysisMethod.getName () + "$" + (generatedCount++);
+    }
+
+
+    private static byte [] __generateClass (
+        final String className, final Method analysisMethod,
+        final Class <?> [] argClasses, final ArgumentType [] argTypes
+    ) {
+        // no branches in the generated code - frames are not needed
+        final ClassWriter cw = new ClassWriter (ClassWriter.COMPUTE_MAXS);
+
+        cw.visit (
+            Opcodes.V1_6, Opcodes.ACC_PUBLIC | Opcodes.ACC_FINAL | Opcodes.ACC_SUPER,
+            className, null, INVOCATION_NAME, null
+        );
+
+        // fields - the analysis instance is kept by the superclass
+        for (int i = 0; i < argTypes.length; ++i) {
+            cw.visitField (
+                Opcodes.ACC_PRIVATE, ARGUMENT_FIELD + i, argTypes [i].fieldDesc,
+                null, null
+            ).visitEnd ();
+        }
+
+        __generateConstructor (cw, className);
+        __generateUnmarshal (cw, className, argTypes);
+        __generateInvokeAnalysis (cw, className, analysisMethod, argClasses, argTypes);
+
+        cw.visitEnd ();
+        return cw.toByteArray ();
+    }
+
+
+    private static void __generateConstructor (
+        final ClassWriter cw, final String className
+    ) {
+        final MethodVisitor mv = cw.visitMethod (
+            Opcodes.ACC_PUBLIC, "<init>", CONSTRUCTOR_DESC, null, null
+        );
+
+        mv.visitCode ();
+        mv.visitVarInsn (Opcodes.ALOAD, 0);
+        mv.visitVarInsn (Opcodes.ALOAD, 1);
+        mv.visitVarInsn (Opcodes.ALOAD, 2);
+        mv.visitMethodInsn (
+            Opcodes.INVOKESPECIAL, INVOCATION_NAME, "<init>", CONSTRUCTOR_DESC,
+            false
+        );
+
+        mv.visitInsn (Opcodes.RETURN);
+        mv.visitMaxs (0, 0);
+        mv.visitEnd ();
+    }
+
+
+    private static void __generateUnmarshal (
+        final ClassWriter cw, final String className,
+        final ArgumentType [] argTypes
+    ) {
+        final MethodVisitor mv = cw.visitMethod (
+            Opcodes.ACC_PUBLIC, "unmarshal",
+            Type.getMethodDescriptor (
+                Type.getType (AnalysisInvocation.class),
+                Type.getType (ByteBuffer.class)
+            ),
+            null, null
+        );
+
+        mv.visitCode ();
+
+        // new invocation with the same method and analysis
+        mv.visitTypeInsn (Opcodes.NEW, className);
+        mv.visitInsn (Opcodes.DUP);
+        mv.visitVarInsn (Opcodes.ALOAD, 0);
+        mv.visitMethodInsn (
+            Opcodes.INVOKEVIRTUAL, INVOCATION_NAME, "getAnalysisMethod",
+            Type.getMethodDescriptor (Type.getType (Method.class)), false
+        );
+        mv.visitVarInsn (Opcodes.ALOAD, 0);
+        mv.visitFieldInsn (Opcodes.GETFIELD, INVOCATION_NAME, ANALYSIS_FIELD, OBJECT_DESC);
+        mv.visitMethodInsn (
+            Opcodes.INVOKESPECIAL, className, "<init>", CONSTRUCTOR_DESC, false
+        );
+
+        // read arguments in order
+        for (int i = 0; i < argTypes.length; ++i) {
+            final ArgumentType argType = argTypes [i];
+
+            mv.visitInsn (Opcodes.DUP);
+            mv.visitVarInsn (Opcodes.ALOAD, 1);
+
+            if (argType == SHADOW_OBJECT_TYPE) {
+                mv.visitMethodInsn (
+                    Opcodes.INVOKEVIRTUAL, INPUT_NAME, argType.readMethod, "()J", false
+                );
+                mv.visitMethodInsn (
+                    Opcodes.INVOKESTATIC, OBJECT_TABLE_NAME, "get",
+                    "(J)" + SHADOW_OBJECT_DESC, false
+                );
+            } else if (argType.fieldDesc.equals ("Z")) {
+                // ByteBuffer has no boolean accessor
+                mv.visitMethodInsn (
+                    Opcodes.INVOKESTATIC, INVOCATION_NAME, argType.readMethod,
+                    "(" + Type.getDescriptor (ByteBuffer.class) + ")Z", false
+                );
+            } else {
+                mv.visitMethodInsn (
+                    Opcodes.INVOKEVIRTUAL, INPUT_NAME, argType.readMethod,
+                    "()" + argType.fieldDesc, false
+                );
+            }
+
+            mv.visitFieldInsn (
+                Opcodes.PUTFIELD, className, ARGUMENT_FIELD + i, argType.fieldDesc
+            );
+        }
+
+        mv.visitInsn (Opcodes.ARETURN);
+        mv.visitMaxs (0, 0);
+        mv.visitEnd ();
+    }
+
+
+    private static void __generateInvokeAnalysis (
+        final ClassWriter cw, final String className, final Method analysisMethod,
+        final Class <?> [] argClasses, final ArgumentType [] argTypes
+    ) {
+        final MethodVisitor mv = cw.visitMethod (
+            Opcodes.ACC_PROTECTED, "invokeAnalysis", "()V",
+            null, new String [] { "java/lang/Throwable" }
+        );
+
+        final String analysisName =
+            Type.getInternalName (analysisMethod.getDeclaringClass ());
+
+        final boolean isStatic =
+            Modifier.isStatic (analysisMethod.getModifiers ());
+
+        mv.visitCode ();
+        if (!isStatic) {
+            mv.visitVarInsn (Opcodes.ALOAD, 0);
+            mv.visitFieldInsn (Opcodes.GETFIELD, INVOCATION_NAME, ANALYSIS_FIELD, OBJECT_DESC);
+            mv.visitTypeInsn (Opcodes.CHECKCAST, analysisName);
+        }
+
+        for (int i = 0; i < argTypes.length; ++i) {
+            if (argTypes [i] == SHADOW_REFERENCE_TYPE) {
+                // wrap the net reference on the analysis thread
+                mv.visitTypeInsn (Opcodes.NEW, SHADOW_REFERENCE_NAME);
+                mv.visitInsn (Opcodes.DUP);
+                mv.visitVarInsn (Opcodes.ALOAD, 0);
+                mv.visitFieldInsn (
+                    Opcodes.GETFIELD, className, ARGUMENT_FIELD + i, "J"
+                );
+                mv.visitMethodInsn (
+                    Opcodes.INVOKESPECIAL, SHADOW_REFERENCE_NAME, "<init>",
+                    "(J)V", false
+                );
+                continue;
+            }
+
+            mv.visitVarInsn (Opcodes.ALOAD, 0);
+            mv.visitFieldInsn (
+                Opcodes.GETFIELD, className, ARGUMENT_FIELD + i, argTypes [i].fieldDesc
+            );
+
+            // shadow objects are resolved to the declared subclass on invocation
+            if (argTypes [i] == SHADOW_OBJECT_TYPE
+                && argClasses [i] != ShadowObject.class) {
+                mv.visitTypeInsn (
+                    Opcodes.CHECKCAST, Type.getInternalName (argClasses [i])
+                );
+            }
+        }
+
+        mv.visitMethodInsn (
+            isStatic ? Opcodes.INVOKESTATIC : Opcodes.INVOKEVIRTUAL,
+            analysisName, analysisMethod.getName (),
+            Type.getMethodDescriptor (analysisMethod), false
+        );
+
+        // discard the result
+        final int resultSize =
+            Type.getReturnType (analysisMethod).getSize ();
+        if (resultSize == 1) {
+            mv.visitInsn (Opcodes.POP);
+        } else if (resultSize == 2) {
+            mv.visitInsn (Opcodes.POP2);
+        }
+
+        mv.visitInsn (Opcodes.RETURN);
+        mv.visitMaxs (0, 0);
+        mv.visitEnd ();
+    }
+
+    //
+
+    private static final class InvocationClassLoader extends ClassLoader {
+
+        InvocationClassLoader (final ClassLoader parent) {
+            super (parent);
+        }
+
+        Class <?> define (final String name, final byte [] code) {
+            return defineClass (name, code, 0, code.length);
+        }
+    }
+
+}
@@ -7,23 +7,46 @@ import java.util.HashSet;
 import java.util.List;
 import java.util.Map;
 import java.util.Set;
+import java.util.concurrent.ConcurrentHashMap;
 
 import ch.usi.dag.dislreserver.DiSLREServerException;
 import ch.usi.dag.dislreserver.DiSLREServerFatalException;
+import ch.usi.dag.dislreserver.Session;
 import ch.usi.dag.dislreserver.remoteanalysis.RemoteAnalysis;
+import ch.usi.dag.dislreserver.remoteanalysis.ThreadConfinedAnalysis;
+import ch.usi.dag.dislreserver.stats.Statistics;
 
 public final class AnalysisResolver {
     private static final String METHOD_DELIM = ".";
 
-    private static final Map <Short, AnalysisMethodHolder>
-        methodMap = new HashMap <Short, AnalysisMethodHolder> ();
+    // analyses of one session - each session has its own analysis instances
+    private static final class Analyses {
+        // read concurrently by the analysis request decoders
+        final Map <Short, AnalysisMethodHolder>
+            methodMap = new ConcurrentHashMap <Short, AnalysisMethodHolder> ();
 
-    private static final Map <String, RemoteAnalysis>
-        analysisMap = new HashMap <String, RemoteAnalysis> ();
+        final Map <String, RemoteAnalysis>
+            analysisMap = new HashMap <String, RemoteAnalysis> ();
 
-    // for fast set access - contains all values from analysisMap
-    private static final Set <RemoteAnalysis>
-        analysisSet = new HashSet <RemoteAnalysis> ();
+        // for fast set access - contains all values from analysisMap
+        final Set <RemoteAnalysis>
+            analysisSet = new HashSet <RemoteAnalysis> ();
+
+        // instances of thread-confined analyses - keyed by the primary instance
+        final Map <RemoteAnalysis, ConfinedInstances>
+            confinedMap = new ConcurrentHashMap <RemoteAnalysis, ConfinedInstances> ();
+    }
+
+    private static final Session.Key <Analyses> __analysesKey = new Session.Key <Analyses> () {
+        @Override
+        protected Analyses create (final Session session) {
+            return new Analyses ();
+        }
+    };
+
+    private static Analyses __analyses () {
+        return Session.current ().get (__analysesKey);
+    }
 
     //
 
@@ -31,11 +54,36 @@ public final class AnalysisResolver {
         private final RemoteAnalysis analysisInstance;
         private final Method analysisMethod;
 
+        // generated invocation unmarshalling the method arguments
+        // not used for batch methods
+        private final AnalysisInvocation invocationPrototype;
+        private final int argumentsLength;
+        private final boolean batch;
+
+        // null if the analysis is not thread-confined
+        private final ConfinedInstances confinedInstances;
+
         public AnalysisMethodHolder(
-            final RemoteAnalysis analysisInstance, final Method analysisMethod
-        ) {
+            final RemoteAnalysis analysisInstance, final Method analysisMethod,
+            final ConfinedInstances confinedInstances
+        ) throws DiSLREServerException {
             this.analysisInstance = analysisInstance;
             this.analysisMethod = analysisMethod;
+            this.confinedInstances = confinedInstances;
+
+            this.batch = BatchInvocation.isBatchMethod (analysisMethod);
+
+            if (batch) {
+                this.invocationPrototype = null;
+                this.argumentsLength =
+                    BatchInvocation.argumentsLength (analysisMethod);
+            } else {
+                this.invocationPrototype = AnalysisInvocationGenerator.generate (
+                    analysisInstance, analysisMethod
+                );
+                this.argumentsLength =
+                    AnalysisInvocationGenerator.argumentsLength (analysisMethod);
+            }
         }
 
         public RemoteAnalysis getAnalysisInstance() {
@@ -45,11 +93,34 @@ public final class AnalysisResolver {
         public Method getAnalysisMethod() {
             return analysisMethod;
         }
+
+        public AnalysisInvocation getInvocationPrototype() {
+            return invocationPrototype;
+        }
+
+        public int getArgumentsLength() {
+            return argumentsLength;
+        }
+
+        public boolean isBatch() {
+            return batch;
+        }
+
+        ConfinedInstances getConfinedInstances() {
+            return confinedInstances;
+        }
+
+        // creates an empty batch collecting consecutive events of the method
+        AnalysisInvocation newBatch(final Object analysis)
+        throws DiSLREServerException {
+            return new BatchInvocation (analysisMethod, analysis);
+        }
     }
 
     //
 
-    private static AnalysisMethodHolder resolveMethod (String methodStr
+    private static AnalysisMethodHolder resolveMethod (
+        final Analyses analyses, String methodStr
     ) throws DiSLREServerException {
         try {
             int classNameEnd = methodStr.lastIndexOf (METHOD_DELIM);
@@ -59,7 +130,7 @@ public final class AnalysisResolver {
             String methodName = methodStr.substring (classNameEnd + 1);
 
             // resolve analysis instance
-            RemoteAnalysis raInst = analysisMap.get (className);
+            RemoteAnalysis raInst = analyses.analysisMap.get (className);
             if (raInst == null) {
                 // resolve class
                 Class <?> raClass = Class.forName (className);
@@ -67,14 +138,22 @@ public final class AnalysisResolver {
                 // create instance
                 raInst = (RemoteAnalysis) raClass.newInstance ();
 
-                analysisMap.put (className, raInst);
-                analysisSet.add (raInst);
+                analyses.analysisMap.put (className, raInst);
+                analyses.analysisSet.add (raInst);
+
+                if (raInst instanceof ThreadConfinedAnalysis) {
+                    analyses.confinedMap.put (raInst, new ConfinedInstances (
+                        (ThreadConfinedAnalysis <?>) raInst
+                    ));
+                }
             }
 
             // resolve analysis method
             final Method raMethod = __getAnalysisMethod (raInst, methodName);
 
-            return new AnalysisMethodHolder(raInst, raMethod);
+            return new AnalysisMethodHolder (
+                raInst, raMethod, analyses.confinedMap.get (raInst)
+            );
         }
 
         catch (ClassNotFoundException e) {
@@ -121,7 +200,7 @@ public final class AnalysisResolver {
 
     static AnalysisMethodHolder getMethod (final short methodId)
     throws DiSLREServerException {
-        AnalysisMethodHolder result = methodMap.get (methodId);
+        AnalysisMethodHolder result = __analyses ().methodMap.get (methodId);
         if (result == null) {
             throw new DiSLREServerFatalException ("Unknown method id: "+ methodId);
         }
@@ -133,11 +212,42 @@ public final class AnalysisResolver {
     public static void registerMethodId (
         final short methodId, String methodString
     ) throws DiSLREServerException {
-        methodMap.put(methodId, resolveMethod(methodString));
+        final Analyses analyses = __analyses ();
+        final AnalysisMethodHolder holder = resolveMethod (analyses, methodString);
+        analyses.methodMap.put (methodId, holder);
+
+        if (Statistics.ENABLED) {
+            Statistics.current ().analysisMethodRegistered (
+                methodId, holder.getAnalysisMethod ()
+            );
+        }
     }
 
 
     public static Set <RemoteAnalysis> getAllAnalyses () {
-        return analysisSet;
+        return __analyses ().analysisSet;
+    }
+
+
+    /**
+     * Merges the thread-confined analysis instances of the ordering id into
+     * their primary instances. Called after the last event of the ordering
+     * id has been processed.
+     */
+    public static void orderingEnded (final long orderingId) {
+        for (final ConfinedInstances instances : __analyses ().confinedMap.values ()) {
+            instances.merge (orderingId);
+        }
+    }
+
+
+    /**
+     * Merges all remaining thread-confined analysis instances into their
+     * primary instances.
+     */
+    public static void mergeConfinedInstances () {
+        for (final ConfinedInstances instances : __analyses ().confinedMap.values ()) {
+            instances.mergeAll ();
+        }
     }
 }
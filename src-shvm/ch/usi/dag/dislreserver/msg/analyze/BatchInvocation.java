@@ -0,0 +1,225 @@
+package ch.usi.dag.dislreserver.msg.analyze;
+
+import java.lang.reflect.Array;
+import java.lang.reflect.InvocationTargetException;
+import java.lang.reflect.Method;
+import java.nio.ByteBuffer;
+
+import ch.usi.dag.dislreserver.DiSLREServerException;
+import ch.usi.dag.dislreserver.remoteanalysis.Batch;
+import ch.usi.dag.dislreserver.shadow.ShadowObject;
+import ch.usi.dag.dislreserver.shadow.ShadowObjectTable;
+
+/**
+ * Invocation of a batch analysis method with the argument values of all its
+ * events from one analysis message. The values are decoded column-wise into
+ * primitive arrays and the analysis method is invoked once for the whole
+ * batch.
+ * <p>
+ * A batch analysis method is annotated with {@link Batch} and takes one
+ * array per event argument, followed by an int holding the number of events
+ * in the batch. The arrays can be longer than the number of events. A batch
+ * holds consecutive events of the method, so that it is invoked in order
+ * with the events of other analysis methods.
+ */
+final class BatchInvocation extends AnalysisInvocation {
+
+    private static final int INITIAL_CAPACITY = 64;
+
+    private static final byte COLUMN_BOOLEAN = 0;
+    private static final byte COLUMN_CHAR = 1;
+    private static final byte COLUMN_BYTE = 2;
+    private static final byte COLUMN_SHORT = 3;
+    private static final byte COLUMN_INT = 4;
+    private static final byte COLUMN_LONG = 5;
+    private static final byte COLUMN_FLOAT = 6;
+    private static final byte COLUMN_DOUBLE = 7;
+    private static final byte COLUMN_SHADOW_OBJECT = 8;
+
+    private static final Class <?> [] COLUMN_CLASSES = {
+        boolean [].class, char [].class, byte [].class, short [].class,
+        int [].class, long [].class, float [].class, double [].class,
+        ShadowObject [].class
+    };
+
+    private static final int [] COLUMN_SIZES = {
+        Byte.SIZE / Byte.SIZE, Character.SIZE / Byte.SIZE,
+        Byte.SIZE / Byte.SIZE, Short.SIZE / Byte.SIZE,
+        Integer.SIZE / Byte.SIZE, Long.SIZE / Byte.SIZE,
+        Float.SIZE / Byte.SIZE, Double.SIZE / Byte.SIZE,
+        Long.SIZE / Byte.SIZE
+    };
+
+    //
+
+    private final byte [] columnTypes;
+    private final Object [] columns;
+    private int count;
+
+
+    BatchInvocation (final Method analysisMethod, final Object analysis)
+    throws DiSLREServerException {
+        super (analysisMethod, analysis);
+
+        this.columnTypes = __columnTypes (analysisMethod);
+        this.columns = new Object [columnTypes.length];
+        this.count = 0;
+
+        for (int i = 0; i < columns.length; ++i) {
+            columns [i] = Array.newInstance (
+                COLUMN_CLASSES [columnTypes [i]].getComponentType (),
+                INITIAL_CAPACITY
+            );
+        }
+    }
+
+    //
+
+    private static byte __columnType (final Class <?> paramClass) {
+        for (byte type = 0; type < COLUMN_CLASSES.length; ++type) {
+            if (COLUMN_CLASSES [type].equals (paramClass)) {
+                return type;
+            }
+        }
+
+        return -1;
+    }
+
+
+    /**
+     * Returns true if the analysis method takes its events in batches, i.e.,
+     * if it is annotated with {@link Batch}.
+     */
+    static boolean isBatchMethod (final Method analysisMethod) {
+        return analysisMethod.isAnnotationPresent (Batch.class);
+    }
+
+
+    private static byte [] __columnTypes (final Method analysisMethod)
+    throws DiSLREServerException {
+        final Class <?> [] paramClasses = analysisMethod.getParameterTypes ();
+        if (paramClasses.length < 2
+            || !int.class.equals (paramClasses [paramClasses.length - 1])) {
+            throw new DiSLREServerException (String.format (
+                "Batch analysis method %s.%s has to take arrays of event arguments followed by an int event count",
+                analysisMethod.getDeclaringClass ().getName (),
+                analysisMethod.getName ()
+            ));
+        }
+
+        final byte [] result = new byte [paramClasses.length - 1];
+
+        for (int i = 0; i < result.length; ++i) {
+            result [i] = __columnType (paramClasses [i]);
+
+            if (result [i] < 0) {
+                throw new DiSLREServerException (String.format (
+                    "Unsupported batch data type %s in analysis method %s.%s",
+                    paramClasses [i].getName (),
+                    analysisMethod.getDeclaringClass ().getName (),
+                    analysisMethod.getName ()
+                ));
+            }
+        }
+
+        return result;
+    }
+
+
+    /**
+     * Returns the length of marshalled argument data of one event.
+     */
+    static int argumentsLength (final Method analysisMethod)
+    throws DiSLREServerException {
+        int result = 0;
+        for (final byte columnType : __columnTypes (analysisMethod)) {
+            result += COLUMN_SIZES [columnType];
+        }
+
+        return result;
+    }
+
+    //
+
+    private void __ensureCapacity () {
+        final int capacity = Array.getLength (columns [0]);
+        if (count < capacity) {
+            return;
+        }
+
+        for (int i = 0; i < columns.length; ++i) {
+            final Object column = Array.newInstance (
+                columns [i].getClass ().getComponentType (), 2 * capacity
+            );
+
+            System.arraycopy (columns [i], 0, column, 0, count);
+            columns [i] = column;
+        }
+    }
+
+
+    /**
+     * Appends the argument values of one event to the batch.
+     *
+     * @return this batch
+     */
+    @Override
+    public AnalysisInvocation unmarshal (final ByteBuffer buffer) {
+        __ensureCapacity ();
+
+        for (int i = 0; i < columns.length; ++i) {
+            final Object column = columns [i];
+
+            switch (columnTypes [i]) {
+            case COLUMN_BOOLEAN:
+                ((boolean []) column) [count] = getBoolean (buffer);
+                break;
+            case COLUMN_CHAR:
+                ((char []) column) [count] = buffer.getChar ();
+                break;
+            case COLUMN_BYTE:
+                ((byte []) column) [count] = buffer.get ();
+                break;
+            case COLUMN_SHORT:
+                ((short []) column) [count] = buffer.getShort ();
+                break;
+            case COLUMN_INT:
+                ((int []) column) [count] = buffer.getInt ();
+                break;
+            case COLUMN_LONG:
+                ((long []) column) [count] = buffer.getLong ();
+                break;
+            case COLUMN_FLOAT:
+                ((float []) column) [count] = buffer.getFloat ();
+                break;
+            case COLUMN_DOUBLE:
+                ((double []) column) [count] = buffer.getDouble ();
+                break;
+            case COLUMN_SHADOW_OBJECT:
+                ((ShadowObject []) column) [count] =
+                    ShadowObjectTable.get (buffer.getLong ());
+                break;
+            }
+        }
+
+        ++count;
+        return this;
+    }
+
+
+    @Override
+    protected void invokeAnalysis () throws Throwable {
+        final Object [] args = new Object [columns.length + 1];
+        System.arraycopy (columns, 0, args, 0, columns.length);
+        args [columns.length] = count;
+
+        try {
+            // single reflective call for the whole batch
+            getAnalysisMethod ().invoke (analysis, args);
+
+        } catch (final InvocationTargetException e) {
+            throw e.getCause ();
+        }
+    }
+
+}
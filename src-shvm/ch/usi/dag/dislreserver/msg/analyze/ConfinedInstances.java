@@ -0,0 +1,90 @@
+package ch.usi.dag.dislreserver.msg.analyze;
+
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ConcurrentMap;
+
+import ch.usi.dag.dislreserver.DiSLREServerException;
+import ch.usi.dag.dislreserver.remoteanalysis.ThreadConfinedAnalysis;
+
+/**
+ * Instances of a thread-confined analysis, one for each ordering id, and the
+ * primary instance they are merged into.
+ */
+final class ConfinedInstances {
+
+    private final ThreadConfinedAnalysis <?> primary;
+
+    private final ConcurrentMap <Long, ThreadConfinedAnalysis <?>>
+        instances = new ConcurrentHashMap <Long, ThreadConfinedAnalysis <?>> ();
+
+    //
+
+    ConfinedInstances (final ThreadConfinedAnalysis <?> primary) {
+        this.primary = primary;
+    }
+
+
+    /**
+     * Returns the instance for the ordering id. Creates new one if it does
+     * not exist. Can be called concurrently.
+     */
+    ThreadConfinedAnalysis <?> get (final long orderingId)
+    throws DiSLREServerException {
+        ThreadConfinedAnalysis <?> result = instances.get (orderingId);
+        if (result != null) {
+            return result;
+        }
+
+        try {
+            final ThreadConfinedAnalysis <?> instance =
+                primary.getClass ().newInstance ();
+
+            result = instances.putIfAbsent (orderingId, instance);
+            return (result != null) ? result : instance;
+
+        } catch (final InstantiationException e) {
+            throw new DiSLREServerException (e);
+        } catch (final IllegalAccessException e) {
+            throw new DiSLREServerException (e);
+        }
+    }
+
+
+    /**
+     * Merges the instance of the ordering id into the primary instance and
+     * forgets it.
+     */
+    void merge (final long orderingId) {
+        final ThreadConfinedAnalysis <?> instance = instances.remove (orderingId);
+        if (instance != null) {
+            __merge (instance);
+        }
+    }
+
+
+    void mergeAll () {
+        for (final Long orderingId : instances.keySet ()) {
+            merge (orderingId);
+        }
+    }
+
+
+    @SuppressWarnings ({ "unchecked", "rawtypes" })
+    private void __merge (final ThreadConfinedAnalysis instance) {
+        try {
+            synchronized (primary) {
+                ((ThreadConfinedAnalysis) primary).merge (instance);
+            }
+
+        } catch (final Throwable t) {
+            // report error during merge
+            System.err.format (
+                "DiSL-RE: exception in analysis %s.merge(): ",
+                primary.getClass ().getName ()
+            );
+
+            t.printStackTrace ();
+        }
+    }
+
+}
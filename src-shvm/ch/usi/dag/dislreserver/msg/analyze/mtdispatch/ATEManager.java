@@ -1,27 +1,57 @@
 package ch.usi.dag.dislreserver.msg.analyze.mtdispatch;
 
 import java.util.Collections;
-import java.util.concurrent.BlockingQueue;
+import java.util.Set;
 import java.util.concurrent.ConcurrentHashMap;
 import java.util.concurrent.ConcurrentMap;
-import java.util.concurrent.LinkedBlockingQueue;
+import java.util.concurrent.CopyOnWriteArraySet;
+import java.util.concurrent.ForkJoinPool;
+import java.util.concurrent.locks.LockSupport;
 
 import ch.usi.dag.dislreserver.DiSLREServerFatalException;
+import ch.usi.dag.dislreserver.Session;
+import ch.usi.dag.dislreserver.reqdispatch.FlowControl;
+import ch.usi.dag.dislreserver.stats.Statistics;
 
 /**
  * Manages executors
  */
 class ATEManager {
 
+    private static final String PROP_ANALYSIS_THREADS =
+            "dislreserver.analysisThreads";
+
+    // all executors of all sessions share one work-stealing pool sized to
+    // the server cores
+    protected static final ForkJoinPool pool = new ForkJoinPool(
+            Math.max(1, Integer.getInteger(PROP_ANALYSIS_THREADS,
+                    Runtime.getRuntime().availableProcessors())),
+            ForkJoinPool.defaultForkJoinWorkerThreadFactory, null, true);
+
+    // session the executors work for - bound while they run in the pool
+    protected final Session session = Session.current();
+
+    // statistics of the session, null if not collected
+    protected final Statistics statistics = Statistics.current();
+
     // we need concurrent for waitForAllToProcessEpoch method
     protected final ConcurrentMap<Long, AnalysisTaskExecutor> liveExecutors =
             new ConcurrentHashMap<Long, AnalysisTaskExecutor>();
 
-    protected final BlockingQueue<AnalysisTaskExecutor> endingExecutors =
-            new LinkedBlockingQueue<AnalysisTaskExecutor>();
+    protected final Set<AnalysisTaskExecutor> endingExecutors =
+            Collections.newSetFromMap(
+                    new ConcurrentHashMap<AnalysisTaskExecutor, Boolean>());
+
+    // flow control of the connection, if any
+    protected volatile FlowControl flowControl;
+
+    // threads parked in waitForAllToProcessEpoch
+    protected final Set<Thread> epochWaiters =
+            new CopyOnWriteArraySet<Thread>();
 
     /**
      * Retrieves executor. Creates new one if it does not exists.
+     * Can be called concurrently.
      */
     public AnalysisTaskExecutor getExecutor(long id) {
 
@@ -30,8 +60,12 @@ class ATEManager {
         // create new executor
         if(ate == null) {
 
-            ate = new AnalysisTaskExecutor(this);
-            liveExecutors.put(id, ate);
+            final AnalysisTaskExecutor newATE =
+                    new AnalysisTaskExecutor(this, pool, id);
+            ate = liveExecutors.putIfAbsent(id, newATE);
+            if (ate == null) {
+                ate = newATE;
+            }
         }
 
         return ate;
@@ -51,48 +85,87 @@ class ATEManager {
     public void executorIsEnding(long id) {
 
         AnalysisTaskExecutor removedATE = liveExecutors.remove(id);
+        endingExecutors.add(removedATE);
 
-        try {
-            endingExecutors.put(removedATE);
-        } catch (InterruptedException e) {
-            throw new DiSLREServerFatalException(
-                    "Cannot add executor to the ending queue", e);
+        // the executor may have already ended
+        if (removedATE.terminated.getCount() == 0) {
+            endingExecutors.remove(removedATE);
         }
     }
 
     /**
-     * Changes global epoch in all executors
+     * Waits for all executors to process an epoch
      */
-    public void globalEpochChange(long newEpoch) {
+    public void waitForAllToProcessEpoch(long epochToProcess) {
 
-        for(AnalysisTaskExecutor ate : liveExecutors.values()) {
-            ate.globalEpochChanged(newEpoch);
+        // executors created later have only tasks from later epochs
+        final Thread waiter = Thread.currentThread();
+        epochWaiters.add(waiter);
+
+        try {
+
+            for(AnalysisTaskExecutor ate : liveExecutors.values()) {
+                awaitEpochProcessing(ate, epochToProcess);
+            }
+
+            for(AnalysisTaskExecutor ate : endingExecutors) {
+                awaitEpochProcessing(ate, epochToProcess);
+            }
+
+        } finally {
+            epochWaiters.remove(waiter);
         }
+    }
+
+    private void awaitEpochProcessing(AnalysisTaskExecutor ate,
+            long epochToProcess) {
 
-        for(AnalysisTaskExecutor ate : endingExecutors) {
-            ate.globalEpochChanged(newEpoch);
+        // the executor announces progress after publishing it, so the
+        // check cannot miss the wake up
+        while (!ate.hasProcessedEpoch(epochToProcess)) {
+            LockSupport.park(this);
+
+            if (Thread.interrupted()) {
+                throw new DiSLREServerFatalException(
+                        "Interupt occured while waiting for processing of an epoch");
+            }
         }
     }
 
     /**
-     * Waits for all executors to process an epoch
+     * Wakes up threads waiting for processing of an epoch. Called by
+     * executors after they start a task from a new epoch or become idle.
      */
-    public void waitForAllToProcessEpoch(long epochToProcess) {
+    public void executorProgressed() {
 
-        try {
+        if (epochWaiters.isEmpty()) {
+            return;
+        }
 
-            for(AnalysisTaskExecutor ate : liveExecutors.values()) {
-                ate.waitForEpochProcessing(epochToProcess);
-            }
+        for (Thread waiter : epochWaiters) {
+            LockSupport.unpark(waiter);
+        }
+    }
 
-            for(AnalysisTaskExecutor ate : endingExecutors) {
-                ate.waitForEpochProcessing(epochToProcess);
-            }
+    /**
+     * Accounts a queued analysis task.
+     */
+    public void taskQueued() {
 
-        } catch (InterruptedException e) {
-            throw new DiSLREServerFatalException(
-                    "Interupt occured while waiting for processing of an epoch",
-                    e);
+        FlowControl fc = flowControl;
+        if (fc != null) {
+            fc.bufferQueued();
+        }
+    }
+
+    /**
+     * Accounts a processed analysis task. Can be called concurrently.
+     */
+    public void taskProcessed() {
+
+        FlowControl fc = flowControl;
+        if (fc != null) {
+            fc.bufferProcessed();
         }
     }
 
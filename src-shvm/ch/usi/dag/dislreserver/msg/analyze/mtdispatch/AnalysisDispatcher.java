@@ -1,30 +1,78 @@
 package ch.usi.dag.dislreserver.msg.analyze.mtdispatch;
 
+import java.util.Arrays;
 import java.util.List;
+import java.util.Map;
 
 import ch.usi.dag.dislreserver.DiSLREServerFatalException;
 import ch.usi.dag.dislreserver.msg.analyze.AnalysisInvocation;
+import ch.usi.dag.dislreserver.reqdispatch.FlowControl;
+import ch.usi.dag.dislreserver.shadow.NetReferenceHelper;
+import ch.usi.dag.dislreserver.stats.Statistics;
 
 // Each thread has dedicated queue where new tasks are submitted.
 public class AnalysisDispatcher {
 
+    private static final String PROP_FREE_THREADS = "dislreserver.freeThreads";
+
     // Epoch is used during object free event sending. Each task is assigned
     // with current epoch number. When free event arrives it increments the
     // epoch and adds task for object free thread. The thread has to wait until
     // all threads processed all tasks from this epoch and then can start
     // with
-    protected long globalEpoch = 0;
+    // NOTE: tasks are added by the decoder threads, the epoch is changed by
+    // the input thread only while no analysis request is being decoded
+    protected volatile long globalEpoch = 0;
 
     protected final ATEManager ateManager = new ATEManager();
 
-    protected final ObjectFreeTaskExecutor oftExec =
-            new ObjectFreeTaskExecutor(ateManager);
+    // object free events can be processed by several threads, each handling
+    // the objects with ids from its shard - the analyses have to handle
+    // concurrent objectFree calls then
+    // class objects are freed last, see ObjectFreeBatch
+    protected final ObjectFreeTaskExecutor[] oftExecs;
+
+    // accessed by the input thread only
+    protected boolean exited = false;
 
     public AnalysisDispatcher() {
         super();
 
-        // start object free thread
-        oftExec.start();
+        oftExecs = new ObjectFreeTaskExecutor[
+                Math.max(1, Integer.getInteger(PROP_FREE_THREADS, 1))];
+
+        // start object free threads
+        for (int i = 0; i < oftExecs.length; ++i) {
+            oftExecs[i] = new ObjectFreeTaskExecutor(ateManager);
+            oftExecs[i].start();
+        }
+
+        if (Statistics.ENABLED) {
+            ateManager.statistics.setExecutorProbe(
+                    new Statistics.ExecutorProbe() {
+                        @Override
+                        public void sample(Map<Long, Long> queueDepths,
+                                Map<Long, Long> epochLags) {
+                            sampleExecutors(queueDepths, epochLags);
+                        }
+                    });
+        }
+    }
+
+    private void sampleExecutors(Map<Long, Long> queueDepths,
+            Map<Long, Long> epochLags) {
+
+        long currentEpoch = globalEpoch;
+
+        for (AnalysisTaskExecutor ate : ateManager.getAllLiveExecutors()) {
+            queueDepths.put(ate.orderingID, (long) ate.getPendingTasks());
+            epochLags.put(ate.orderingID, ate.getEpochLag(currentEpoch));
+        }
+    }
+
+    // processed tasks return credits to the agent
+    public void setFlowControl(FlowControl flowControl) {
+        ateManager.flowControl = flowControl;
     }
 
     public void addTask(long orderingID,
@@ -36,25 +84,76 @@ public class AnalysisDispatcher {
         AnalysisTask at = new AnalysisTask(invocations, globalEpoch);
 
         // add task
+        ateManager.taskQueued();
         ateManager.getExecutor(orderingID).addTask(at);
     }
 
 
     public void objectsFreedEvent(long[] objFreeIDs) {
 
-        // create object free task
-        ObjectFreeTask oft = new ObjectFreeTask(objFreeIDs, globalEpoch);
+        // separate class objects, they are freed after all other objects
+        final long[] objectIDs = new long[objFreeIDs.length];
+        final long[] classIDs = new long[objFreeIDs.length];
+        int objectCount = 0;
+        int classCount = 0;
+
+        for (long objFreeID : objFreeIDs) {
+            if (NetReferenceHelper.isClassInstance(objFreeID)) {
+                classIDs[classCount++] = objFreeID;
+            } else {
+                objectIDs[objectCount++] = objFreeID;
+            }
+        }
+
+        // create object free tasks and send them
+        // at least one thread takes part in the batch to free the classes
+        long[][] shards = shardObjectFreeIDs(objectIDs, objectCount);
+
+        int shardCount = 0;
+        for (long[] shard : shards) {
+            shardCount += (shard.length != 0) ? 1 : 0;
+        }
+
+        ObjectFreeBatch batch = new ObjectFreeBatch(
+                Arrays.copyOf(classIDs, classCount), Math.max(1, shardCount));
 
-        // send event
-        oftExec.addTask(oft);
+        for (int i = 0; i < oftExecs.length; ++i) {
+            if (shards[i].length != 0 || (shardCount == 0 && i == 0)) {
+                oftExecs[i].addTask(
+                        new ObjectFreeTask(shards[i], batch, globalEpoch));
+            }
+        }
 
         // start new epoch
+        // executors publish their progress themselves, so there is nothing
+        // to notify
         ++globalEpoch;
+    }
+
+    private long[][] shardObjectFreeIDs(long[] objFreeIDs, int count) {
+
+        final int shardCount = oftExecs.length;
+        if (shardCount == 1) {
+            return new long[][] { Arrays.copyOf(objFreeIDs, count) };
+        }
+
+        final long[][] result = new long[shardCount][count];
+        final int[] lengths = new int[shardCount];
 
-        // notify all analysis executors about epoch change
-        // this is important for AnalysisTaskExecutors that do not have tasks
-        // from new epoch
-        ateManager.globalEpochChange(globalEpoch);
+        // resolved once for the whole batch
+        final NetReferenceHelper.Layout layout = NetReferenceHelper.layout();
+
+        for (int i = 0; i < count; ++i) {
+            long objFreeID = objFreeIDs[i];
+            int shard = (int) (layout.get_object_id(objFreeID) % shardCount);
+            result[shard][lengths[shard]++] = objFreeID;
+        }
+
+        for (int i = 0; i < shardCount; ++i) {
+            result[i] = Arrays.copyOf(result[i], lengths[i]);
+        }
+
+        return result;
     }
 
     // called by analysis handler when thread ended on the application vm
@@ -72,6 +171,13 @@ public class AnalysisDispatcher {
 
     public void exit() {
 
+        // called again when the session of the connection is closed
+        if (exited) {
+            return;
+        }
+
+        exited = true;
+
         // create end of processing analysis task
         AnalysisTask at = new AnalysisTask();
 
@@ -86,14 +192,18 @@ public class AnalysisDispatcher {
         // wait for analysis threads
         ateManager.waitForAllToEnd();
 
-        // wait for free thread
+        // wait for free threads
         try {
 
             // signal end
-            oftExec.addTask(new ObjectFreeTask());
+            for (ObjectFreeTaskExecutor oftExec : oftExecs) {
+                oftExec.addTask(new ObjectFreeTask());
+            }
 
             // wait for end
-            oftExec.join();
+            for (ObjectFreeTaskExecutor oftExec : oftExecs) {
+                oftExec.join();
+            }
 
         } catch (InterruptedException e) {
             throw new DiSLREServerFatalException(
@@ -1,147 +1,179 @@
 package ch.usi.dag.dislreserver.msg.analyze.mtdispatch;
 
-import java.util.LinkedList;
 import java.util.Queue;
-
-class AnalysisTaskExecutor {
-
-    // The whole locking fun here is for safe object free processing.
-    // If object free arrives (message with free object), it is necessary to
-    // first process all events that arrived before this message.
-
-    // So when object free arrives, input thread increments global epoch and
-    // "orders" obj free thread to wait using waitForEpochProcessing for all
-    // executors to complete processing of events that arrived before (have
-    // lower epochs).
-    // Then, obj free thread can safely process all object free events from that
-    // epoch.
-
-    // getTask() is the main driving method here which either synchronizes
-    // counter with global epoch if no task is available (meaning there is no
-    // work from lower epochs) or sets executorEpoch to processed event epoch
-
-    // NOTE: no epoch should have this value
-    private static final long           THREAD_SHUTDOWN = -1;
+import java.util.concurrent.ConcurrentLinkedQueue;
+import java.util.concurrent.CountDownLatch;
+import java.util.concurrent.Executor;
+import java.util.concurrent.atomic.AtomicInteger;
+
+import ch.usi.dag.dislreserver.Session;
+import ch.usi.dag.dislreserver.msg.analyze.AnalysisInvocation;
+import ch.usi.dag.dislreserver.msg.analyze.AnalysisResolver;
+import ch.usi.dag.dislreserver.stats.Statistics;
+
+/**
+ * Serial queue of analysis tasks of one ordering id.
+ * <p>
+ * The executor does not own a thread. When a task arrives to an idle
+ * executor, the executor schedules itself on the shared analysis pool and
+ * processes tasks until its queue is empty. Tasks of one executor are
+ * therefore processed one at a time and in order, but not necessarily by the
+ * same pool thread.
+ */
+class AnalysisTaskExecutor implements Runnable {
+
+    // Object free processing has to wait until all events that arrived
+    // before the object free message are processed.
+
+    // Each task carries the epoch it arrived in. When object free arrives,
+    // input thread closes the current epoch and obj free thread waits until
+    // every executor has processed the tasks of the closed epoch
+    // (see hasProcessedEpoch).
+
+    // Both pieces of state used for the check are published without locking:
+    // - startedEpoch is the epoch of the task being processed - tasks are
+    //   processed in order, so all tasks from lower epochs are done
+    // - pendingTasks counts queued tasks and the task being processed - the
+    //   tasks of the closed epoch were added before object free arrived, so
+    //   if there is no pending task, they are done
+
+    // NOTE: greater than any epoch
+    private static final long           THREAD_SHUTDOWN = Long.MAX_VALUE;
+
+    // number of tasks processed before the executor yields its pool thread
+    private static final int            TASKS_PER_RUN   = 16;
 
     final protected ATEManager          ateManager;
 
-    protected final AnalysisThread      executingThread;
+    protected final long                orderingID;
+
+    protected final Executor            pool;
 
-    // !! RULES !!
-    // Lock on "this" is protecting globalEpoch, executorEpoch, and taskQueue.
-    // All methods working with the values should be synchronized.
-    // Every change to any of the variable (queue) should trigger notifyAll().
-    // If we follow the rules, it should simply work :)
+    protected final Queue<AnalysisTask> taskQueue =
+            new ConcurrentLinkedQueue<AnalysisTask>();
 
-    // Note that we could use two locking objects.
-    // One for announcing executorEpoch changes and one for announcing
-    // globalEpoch and taskQueue changes, but it would require more
-    // sophisticated locking also.
+    // the executor is scheduled while there are pending tasks
+    protected final AtomicInteger       pendingTasks    = new AtomicInteger();
 
-    protected long                      globalEpoch     = 0;
+    protected volatile long             startedEpoch    = 0;
 
-    protected long                      executorEpoch   = 0;
-    protected final Queue<AnalysisTask> taskQueue;
+    protected final CountDownLatch      terminated      = new CountDownLatch(1);
 
-    public AnalysisTaskExecutor(ATEManager ateManager) {
+    public AnalysisTaskExecutor(ATEManager ateManager, Executor pool,
+            long orderingID) {
         super();
         this.ateManager = ateManager;
-        this.taskQueue = new LinkedList<AnalysisTask>();
-        this.executingThread = new AnalysisThread(this);
+        this.orderingID = orderingID;
+        this.pool = pool;
     }
 
-    public synchronized void addTask(AnalysisTask at) {
+    public void addTask(AnalysisTask at) {
 
         taskQueue.add(at);
-        // changed taskQueue -> according to the rules notifyAll
-        this.notifyAll();
-
-        // start thread if it is not started
-        // we cannot start the thread in the constructor because it has
-        // pointer to "this"
-        // we could have some init function but this is exposing better API
-        if (!executingThread.isAlive()) {
-            executingThread.start();
+
+        // first pending task - schedule the executor
+        if (pendingTasks.getAndIncrement() == 0) {
+            pool.execute(this);
         }
     }
 
-    public synchronized AnalysisTask getTask() throws InterruptedException {
+    public void run() {
 
-        // executor thread is driving whole executor from this method
-        // - the state of the executor epoch is updated here
-        // - tasks are requested here
-        // - executor is finalized from here
+        // pool threads are shared by all sessions
+        ateManager.session.bind();
 
-        // note that at the beginning, the new task is added right away
-        // and executorEpoch will be updated to some meaningful value
-
-        AnalysisTask atToProcess = taskQueue.poll();
+        try {
+            processTasks();
+        } finally {
+            Session.unbind();
+        }
+    }
 
-        // waiting for a task
-        while (atToProcess == null) {
+    private void processTasks() {
 
-            // ** no task - epoch updating only **
-            // update executorEpoch, notifyAll and wait
-            executorEpoch = globalEpoch;
-            // changed executorEpoch -> according to the rules notifyAll
-            this.notifyAll();
+        // process a bounded number of tasks so that busy executors do not
+        // starve the others, then reschedule
+        for (int i = 0; i < TASKS_PER_RUN; ++i) {
 
-            // wait for new task or globalEpoch update
-            this.wait();
+            // the queue holds at least one task while the executor runs
+            AnalysisTask at = taskQueue.poll();
 
-            atToProcess = taskQueue.poll();
-        }
+            // ** executor end **
 
-        // ** executor end **
+            // the end task stays pending so the executor is never
+            // scheduled again
+            if (at.isSignalingEnd()) {
+                // no more events for thread-confined analysis instances
+                AnalysisResolver.orderingEnded(orderingID);
 
-        // set proper executorEpoch, notifyAll, notify ATEManager, and
-        // forward end task
-        if (atToProcess.isSignalingEnd()) {
+                startedEpoch = THREAD_SHUTDOWN;
+                ateManager.executorEndConcurrentCallback(this);
+                ateManager.executorProgressed();
+                terminated.countDown();
+                return;
+            }
 
-            executorEpoch = THREAD_SHUTDOWN;
-            // changed executorEpoch -> according to the rules notifyAll
-            this.notifyAll();
-            ateManager.executorEndConcurrentCallback(this);
-            return atToProcess;
-        }
+            // ** normal task **
 
-        // ** normal task **
+            if (at.epoch != startedEpoch) {
+                startedEpoch = at.epoch;
+                ateManager.executorProgressed();
+            }
 
-        executorEpoch = atToProcess.epoch;
-        // changed executorEpoch -> according to the rules notifyAll
-        this.notifyAll();
-        return atToProcess;
-    }
+            // invoke all methods in this task
+            for(AnalysisInvocation ai : at.getInvocations()) {
+                if (Statistics.ENABLED) {
+                    long start = System.nanoTime();
+                    ai.invoke();
+                    ateManager.statistics.analysisInvoked(
+                            ai.getAnalysisMethod(), System.nanoTime() - start);
+                } else {
+                    ai.invoke();
+                }
+            }
 
-    // works with executorEpoch -> synchronized
-    public synchronized void globalEpochChanged(long newEpoch) {
+            ateManager.taskProcessed();
 
-        globalEpoch = newEpoch;
+            // no more tasks - the executor is idle
+            if (pendingTasks.decrementAndGet() == 0) {
+                ateManager.executorProgressed();
+                return;
+            }
+        }
 
-        // changed globalEpoch -> according to the rules notifyAll
-        this.notifyAll();
+        pool.execute(this);
     }
 
-    // works with executorEpoch -> synchronized
-    public synchronized void waitForEpochProcessing(long epochToProcess)
-            throws InterruptedException {
-
-        while (true) {
+    /**
+     * Returns the number of queued tasks and the task being processed.
+     */
+    public int getPendingTasks() {
+        return pendingTasks.get();
+    }
 
-            // epoch was reached or executor thread is shutting down
-            if (executorEpoch > epochToProcess
-                    || executorEpoch == THREAD_SHUTDOWN) {
+    /**
+     * Returns the number of epochs the task being processed (or the oldest
+     * queued task) lags behind the given epoch. Approximate, for statistics
+     * only.
+     */
+    public long getEpochLag(long currentEpoch) {
+        long epoch = startedEpoch;
+        if (pendingTasks.get() == 0 || epoch == THREAD_SHUTDOWN) {
+            return 0;
+        }
 
-                return;
-            }
+        return Math.max(0, currentEpoch - epoch);
+    }
 
-            // wait for executorEpoch change
-            this.wait();
-        }
+    /**
+     * Returns true if all tasks from the given epoch were processed.
+     */
+    public boolean hasProcessedEpoch(long epoch) {
+        return startedEpoch > epoch || pendingTasks.get() == 0;
     }
 
     // await for executor to finish all jobs
     public void awaitTermination() throws InterruptedException {
-        executingThread.join();
+        terminated.await();
     }
 }
@@ -0,0 +1,34 @@
+package ch.usi.dag.dislreserver.msg.analyze.mtdispatch;
+
+import java.util.concurrent.atomic.AtomicInteger;
+
+// Object free events of one message, split among the object free threads.
+// Class objects are freed only after every thread has freed its share of
+// the other objects - freeing a class object releases the class id, which
+// can then be reused by another class, while instances of the freed class
+// would still be looked up by their class id.
+class ObjectFreeBatch {
+
+    protected final long[] classFreeIDs;
+
+    // threads that have not yet freed their share of the batch
+    protected final AtomicInteger pendingShards;
+
+    public ObjectFreeBatch(long[] classFreeIDs, int shardCount) {
+        super();
+        this.classFreeIDs = classFreeIDs;
+        this.pendingShards = new AtomicInteger(shardCount);
+    }
+
+    public long[] getClassFreeIDs() {
+        return classFreeIDs;
+    }
+
+    /**
+     * Called by each thread after freeing its share of the batch. Returns
+     * true for the last one, which then frees the class objects.
+     */
+    public boolean shardDone() {
+        return pendingShards.decrementAndGet() == 0;
+    }
+}
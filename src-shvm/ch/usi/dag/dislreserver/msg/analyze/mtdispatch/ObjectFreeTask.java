@@ -1,11 +1,18 @@
 package ch.usi.dag.dislreserver.msg.analyze.mtdispatch;
 
+import ch.usi.dag.dislreserver.stats.Statistics;
+
 class ObjectFreeTask {
 
     protected boolean signalsEnd = false;
     protected long[] objFreeIDs;
+    protected ObjectFreeBatch batch;
     protected long closingEpoch;
 
+    // arrival time of the object free events, for statistics only
+    protected final long arrivalTime =
+            Statistics.ENABLED ? System.nanoTime() : 0;
+
     /**
      * Constructed task signals end of the processing
      */
@@ -13,9 +20,11 @@ class ObjectFreeTask {
         signalsEnd = true;
     }
 
-    public ObjectFreeTask(long[] objFreeIDs, long closingEpoch) {
+    public ObjectFreeTask(long[] objFreeIDs, ObjectFreeBatch batch,
+            long closingEpoch) {
         super();
         this.objFreeIDs = objFreeIDs;
+        this.batch = batch;
         this.closingEpoch = closingEpoch;
     }
 
@@ -27,7 +36,15 @@ class ObjectFreeTask {
         return objFreeIDs;
     }
 
+    public ObjectFreeBatch getBatch() {
+        return batch;
+    }
+
     public long getClosingEpoch() {
         return closingEpoch;
     }
+
+    public long getArrivalTime() {
+        return arrivalTime;
+    }
 }
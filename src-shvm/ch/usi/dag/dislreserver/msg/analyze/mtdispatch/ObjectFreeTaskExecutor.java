@@ -9,6 +9,7 @@ import ch.usi.dag.dislreserver.msg.analyze.AnalysisResolver;
 import ch.usi.dag.dislreserver.remoteanalysis.RemoteAnalysis;
 import ch.usi.dag.dislreserver.shadow.ShadowObject;
 import ch.usi.dag.dislreserver.shadow.ShadowObjectTable;
+import ch.usi.dag.dislreserver.stats.Statistics;
 
 class ObjectFreeTaskExecutor extends Thread {
 
@@ -26,12 +27,18 @@ class ObjectFreeTaskExecutor extends Thread {
         taskQueue.add(oft);
     }
 
-    private void invokeObjectFreeAnalysisHandlers(long objectFreeID) {
+    // returns false if the object is not known
+    private boolean invokeObjectFreeAnalysisHandlers(long objectFreeID) {
 
         // TODO free events should be sent to analysis that sees the shadow object
 
-        // retrieve shadow object
-        ShadowObject obj = ShadowObjectTable.get(objectFreeID);
+        // retrieve shadow object - an object never seen by this server (the
+        // agent broadcasts object frees to all shadow VMs it sends analysis
+        // data to) is not created just to be freed
+        ShadowObject obj = ShadowObjectTable.lookup(objectFreeID);
+        if (obj == null) {
+            return false;
+        }
 
         // get all analysis objects
         Set<RemoteAnalysis> raSet = AnalysisResolver.getAllAnalyses();
@@ -43,10 +50,13 @@ class ObjectFreeTaskExecutor extends Thread {
 
         // release shadow object
         ShadowObjectTable.freeShadowObject(obj);
+        return true;
     }
 
     public void run() {
 
+        ateManager.session.bind();
+
         try {
 
             ObjectFreeTask oft = taskQueue.take();
@@ -58,8 +68,26 @@ class ObjectFreeTaskExecutor extends Thread {
                 ateManager.waitForAllToProcessEpoch(oft.getClosingEpoch());
 
                 // invoke object free analysis handler for each free object
+                int freedCount = 0;
                 for(long objectFreeID : oft.getObjFreeIDs()) {
-                    invokeObjectFreeAnalysisHandlers(objectFreeID);
+                    if (invokeObjectFreeAnalysisHandlers(objectFreeID)) {
+                        ++freedCount;
+                    }
+                }
+
+                // the thread finishing the batch last frees the class objects
+                ObjectFreeBatch batch = oft.getBatch();
+                if (batch.shardDone()) {
+                    for (long classFreeID : batch.getClassFreeIDs()) {
+                        if (invokeObjectFreeAnalysisHandlers(classFreeID)) {
+                            ++freedCount;
+                        }
+                    }
+                }
+
+                if (Statistics.ENABLED) {
+                    ateManager.statistics.objectsFreed(freedCount,
+                            System.nanoTime() - oft.getArrivalTime());
                 }
 
                 // get task to process
@@ -33,6 +33,6 @@ public class ClassInfoHandler implements RequestHandler {
     }
 
     public void exit() {
-
+        ShadowClassTable.logFootprint();
     }
 }
@@ -19,6 +19,9 @@ public final class CloseHandler implements RequestHandler {
             handler.exit ();
         }
 
+        // thread-confined analysis instances are merged before atExit
+        AnalysisResolver.mergeConfinedInstances ();
+
         // invoke atExit on all analyses
         for (final RemoteAnalysis analysis : AnalysisResolver.getAllAnalyses ()) {
             analysis.atExit ();
@@ -0,0 +1,38 @@
+package ch.usi.dag.dislreserver.msg.netreflayout;
+
+import java.io.DataInputStream;
+import java.io.DataOutputStream;
+import java.io.IOException;
+
+import ch.usi.dag.dislreserver.DiSLREServerException;
+import ch.usi.dag.dislreserver.reqdispatch.RequestHandler;
+import ch.usi.dag.dislreserver.shadow.NetReferenceHelper;
+
+public class NetReferenceLayoutHandler implements RequestHandler {
+
+    public void handle(DataInputStream is, DataOutputStream os, boolean debug)
+            throws DiSLREServerException {
+
+        try {
+
+            // sent by the agent before any net reference
+            int classIdBits = is.readByte();
+
+            NetReferenceHelper.setLayout(classIdBits);
+
+            if (debug) {
+                System.out.printf(
+                        "DiSL-RE: net reference layout with %d class id bits\n",
+                        classIdBits);
+            }
+
+        } catch (IOException e) {
+            throw new DiSLREServerException(e);
+        }
+    }
+
+    public void exit() {
+
+    }
+
+}
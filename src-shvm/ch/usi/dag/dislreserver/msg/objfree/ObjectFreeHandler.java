@@ -7,6 +7,8 @@ import java.io.IOException;
 import ch.usi.dag.dislreserver.DiSLREServerException;
 import ch.usi.dag.dislreserver.msg.analyze.AnalysisHandler;
 import ch.usi.dag.dislreserver.reqdispatch.RequestHandler;
+import ch.usi.dag.dislreserver.shadow.NetReferenceHelper;
+import ch.usi.dag.dislreserver.shadow.ShadowClassTable;
 
 public class ObjectFreeHandler implements RequestHandler {
 
@@ -21,15 +23,15 @@ final AnalysisHandler analysisHandler;
 
         try {
 
-            int freeCount = is.readInt();
+            long[] objFreeIDs = readFreedReferences(is);
 
-            long[] objFreeIDs = new long[freeCount];
-
-            for(int i = 0; i < freeCount; ++i) {
-
-                long netref = is.readLong();
-
-                objFreeIDs[i] = netref;
+            // class id can be reused by the agent after this message
+            NetReferenceHelper.Layout layout = NetReferenceHelper.layout();
+            for (long netref : objFreeIDs) {
+                if (NetReferenceHelper.isClassInstance(netref)) {
+                    ShadowClassTable.retireClassId(
+                            layout.get_class_id(netref));
+                }
             }
 
             analysisHandler.objectsFreed(objFreeIDs);
@@ -39,6 +41,60 @@ final AnalysisHandler analysisHandler;
         }
     }
 
+    /**
+     * Reads the net references of freed objects, in the order they were
+     * sent by the agent (sorted as unsigned values).
+     */
+    public static long[] readFreedReferences(DataInputStream is)
+            throws IOException, DiSLREServerException {
+
+        int freeCount = is.readInt();
+
+        long[] objFreeIDs = new long[freeCount];
+
+        // net references are sent sorted, as runs of consecutive values
+        // each run holds a delta from the end of the previous run and
+        // the number of net references following the first one
+        long lastNetRef = 0;
+        int filled = 0;
+
+        while (filled < freeCount) {
+
+            long netref = lastNetRef + readVarLong(is);
+            long runLength = readVarLong(is);
+
+            if (runLength < 0 || runLength >= freeCount - filled) {
+                throw new DiSLREServerException(
+                        "Invalid run length in object free message: "
+                                + runLength);
+            }
+
+            for (long i = 0; i <= runLength; ++i) {
+                objFreeIDs[filled++] = netref + i;
+            }
+
+            lastNetRef = netref + runLength;
+        }
+
+        return objFreeIDs;
+    }
+
+    // unsigned LEB128 - should be in sync with pack_varlong in the agent
+    private static long readVarLong(DataInputStream is) throws IOException {
+
+        long result = 0;
+        int shift = 0;
+        int groupByte;
+
+        do {
+            groupByte = is.readUnsignedByte();
+            result |= (long) (groupByte & 0x7F) << shift;
+            shift += 7;
+        } while ((groupByte & 0x80) != 0 && shift < Long.SIZE);
+
+        return result;
+    }
+
     public void exit() {
 
     }
@@ -0,0 +1,24 @@
+package ch.usi.dag.dislreserver.remoteanalysis;
+
+import java.lang.annotation.Documented;
+import java.lang.annotation.ElementType;
+import java.lang.annotation.Retention;
+import java.lang.annotation.RetentionPolicy;
+import java.lang.annotation.Target;
+
+
+/**
+ * Marks an analysis method that receives its events in batches.
+ * <p>
+ * The method takes one array per event argument (primitive arrays or
+ * ShadowObject[]), followed by an int argument holding the number of events
+ * in the batch. The arrays can be longer than the number of events. A batch
+ * holds consecutive events of the method from one analysis message, so the
+ * batches stay in order with the events of other analysis methods.
+ */
+@Documented
+@Retention (RetentionPolicy.RUNTIME)
+@Target (ElementType.METHOD)
+public @interface Batch {
+
+}
@@ -19,6 +19,27 @@ import ch.usi.dag.dislreserver.shadow.ShadowObject;
  * Valid only in the case, that transmission is done manually.
  *
  * Object argument on the client will contain NetReference instnace.
+ *
+ * Objects can be also received without resolving their shadow objects while
+ * the events are decoded - either as a long holding the net reference, or as
+ * a ShadowReference resolved by the analysis on access.
+ *
+ * An analysis method annotated with {@link Batch} receives its events in
+ * batches - consecutive events of the method from one analysis message at
+ * once. Such method takes one array per event argument (primitive arrays or
+ * ShadowObject[]), followed by an int argument holding the number of events,
+ * e.g. add(long[] netRefs, int[] values, int count). Objects can be received
+ * as raw net references in a long[]. An event of another analysis method
+ * ends the batch, so batches are delivered in order with other events.
+ *
+ * Events with the same ordering id are processed in order and one at a time,
+ * but not necessarily by the same server thread - the queue of an ordering
+ * id moves between the threads of a shared pool. Per-thread analysis state
+ * therefore must not be kept in ThreadLocal variables: a ThreadLocal would
+ * mix the state of unrelated application threads and lose it whenever the
+ * queue moves. Analyses with per-thread state extend ThreadConfinedAnalysis,
+ * which gets an instance per ordering id, and keep the state in (non-static)
+ * fields of the instance.
  */
 public abstract class RemoteAnalysis {
 
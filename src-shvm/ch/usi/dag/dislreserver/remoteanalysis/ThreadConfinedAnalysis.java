@@ -0,0 +1,26 @@
+package ch.usi.dag.dislreserver.remoteanalysis;
+
+/**
+ * Analysis with a separate instance for each ordering id.
+ *
+ * The server creates an instance of the analysis class for each ordering id
+ * (application thread or total ordering buffer) that sends events to the
+ * analysis. Events with the same ordering id are processed one at a time, so
+ * the instance state needs no synchronization.
+ *
+ * When the events of an ordering id end (the thread ended or the application
+ * exits), the server merges the instance into the primary instance, which
+ * was created at registration, using merge(). The merge calls are serialized
+ * on the primary instance. Only the primary instance receives objectFree()
+ * and atExit(), the latter after all instances were merged.
+ */
+public abstract class ThreadConfinedAnalysis <T extends ThreadConfinedAnalysis <T>>
+extends RemoteAnalysis {
+
+    /**
+     * Merges the state of an instance confined to an ordering id into this
+     * (primary) instance.
+     */
+    public abstract void merge (T other);
+
+}
@@ -0,0 +1,56 @@
+package ch.usi.dag.dislreserver.reqdispatch;
+
+import java.io.InputStream;
+import java.nio.ByteBuffer;
+
+
+/**
+ * Unsynchronized input stream reading the remaining content of a byte
+ * buffer. The stream shares the position with the buffer, so that reads from
+ * the stream and from the buffer can be interleaved.
+ */
+final class ByteBufferInputStream extends InputStream {
+
+    private final ByteBuffer buffer;
+
+    ByteBufferInputStream (final ByteBuffer buffer) {
+        this.buffer = buffer;
+    }
+
+
+    @Override
+    public int read () {
+        return buffer.hasRemaining () ? buffer.get () & 0xFF : -1;
+    }
+
+
+    @Override
+    public int read (final byte [] bytes, final int offset, final int length) {
+        if (length == 0) {
+            return 0;
+        }
+
+        final int count = Math.min (length, buffer.remaining ());
+        if (count == 0) {
+            return -1;
+        }
+
+        buffer.get (bytes, offset, count);
+        return count;
+    }
+
+
+    @Override
+    public long skip (final long count) {
+        final int skipped = (int) Math.min (Math.max (count, 0), buffer.remaining ());
+        buffer.position (buffer.position () + skipped);
+        return skipped;
+    }
+
+
+    @Override
+    public int available () {
+        return buffer.remaining ();
+    }
+
+}
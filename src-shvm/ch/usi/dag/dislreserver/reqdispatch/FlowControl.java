@@ -0,0 +1,140 @@
+package ch.usi.dag.dislreserver.reqdispatch;
+
+import java.io.DataOutputStream;
+import java.io.IOException;
+import java.util.concurrent.atomic.AtomicInteger;
+import java.util.concurrent.atomic.AtomicLong;
+
+import ch.usi.dag.dislreserver.util.Logging;
+import ch.usi.dag.util.logging.Logger;
+
+
+/**
+ * Grants the agent credits for sending analysis buffers.
+ * <p>
+ * The agent needs a credit for each analysis buffer it sends. The server
+ * grants an initial window of credits when the connection is established and
+ * returns the credit of an analysis buffer once all its invocations have been
+ * processed. The number of analysis buffers queued on the server is therefore
+ * bounded by the window, and a slow analysis stalls the agent instead of
+ * filling the server heap.
+ */
+public final class FlowControl {
+
+    private static final Logger __log = Logging.getPackageInstance ();
+
+    //
+
+    private static final String PROP_CREDIT_WINDOW = "dislreserver.creditWindow";
+    private static final int DEFAULT_CREDIT_WINDOW = 256;
+
+    // credits are returned in batches to limit the number of messages
+    private static final int GRANT_BATCH_DIVISOR = 8;
+
+    //
+
+    private final DataOutputStream os;
+
+    private final int window;
+    private final int grantBatch;
+
+    // credits of processed buffers not yet returned to the agent
+    private final AtomicInteger ungrantedCredits = new AtomicInteger ();
+
+    private final AtomicInteger queuedBuffers = new AtomicInteger ();
+    private volatile int maxQueuedBuffers;
+
+    private final AtomicLong grantedCredits = new AtomicLong ();
+
+    private volatile boolean closed;
+
+    //
+
+    FlowControl (final DataOutputStream os) {
+        this.os = os;
+        this.window = Math.max (
+            1, Integer.getInteger (PROP_CREDIT_WINDOW, DEFAULT_CREDIT_WINDOW)
+        );
+        this.grantBatch = Math.max (1, window / GRANT_BATCH_DIVISOR);
+    }
+
+
+    void start () {
+        __grant (window);
+    }
+
+
+    void close () {
+        closed = true;
+
+        __log.debug (
+            "flow control: %d credits granted, at most %d of %d analysis buffers queued",
+            grantedCredits.get (), maxQueuedBuffers, window
+        );
+    }
+
+    //
+
+    /**
+     * Called when an analysis buffer has been decoded and queued.
+     */
+    public void bufferQueued () {
+        final int queued = queuedBuffers.incrementAndGet ();
+
+        // racy, but good enough for statistics
+        if (queued > maxQueuedBuffers) {
+            maxQueuedBuffers = queued;
+        }
+    }
+
+
+    /**
+     * Called when all invocations from an analysis buffer have been
+     * processed. Can be called concurrently.
+     */
+    public void bufferProcessed () {
+        queuedBuffers.decrementAndGet ();
+
+        if (ungrantedCredits.incrementAndGet () >= grantBatch) {
+            final int credits = ungrantedCredits.getAndSet (0);
+            if (credits > 0) {
+                __grant (credits);
+            }
+        }
+    }
+
+
+    public int getQueuedBuffers () {
+        return queuedBuffers.get ();
+    }
+
+
+    public int getMaxQueuedBuffers () {
+        return maxQueuedBuffers;
+    }
+
+
+    public long getGrantedCredits () {
+        return grantedCredits.get ();
+    }
+
+    //
+
+    private void __grant (final int credits) {
+        try {
+            synchronized (os) {
+                os.writeInt (credits);
+                os.flush ();
+            }
+
+            grantedCredits.addAndGet (credits);
+
+        } catch (final IOException ioe) {
+            // the agent does not wait for credits after closing
+            if (!closed) {
+                __log.warn ("failed to grant credits: %s", ioe.getMessage ());
+            }
+        }
+    }
+
+}
@@ -0,0 +1,75 @@
+package ch.usi.dag.dislreserver.reqdispatch;
+
+import java.nio.ByteBuffer;
+import java.util.concurrent.ArrayBlockingQueue;
+import java.util.concurrent.BlockingQueue;
+
+import ch.usi.dag.dislreserver.DiSLREServerFatalException;
+
+
+/**
+ * Pool of direct buffers holding the frames received from the agent.
+ * <p>
+ * The pool allocates up to a fixed number of buffers. When all of them are
+ * in use, the reader blocks until a decoder returns one, which keeps the
+ * amount of undecoded data bounded. Frames that do not fit into a pooled
+ * buffer get a buffer of their own, which is not returned to the pool.
+ */
+final class FramePool {
+
+    private final int frameCapacity;
+    private final int maxFrames;
+
+    private final BlockingQueue <ByteBuffer> freeFrames;
+
+    // only the reader allocates
+    private int allocatedFrames;
+
+    //
+
+    FramePool (final int frameCapacity, final int maxFrames) {
+        this.frameCapacity = frameCapacity;
+        this.maxFrames = maxFrames;
+        this.freeFrames = new ArrayBlockingQueue <ByteBuffer> (maxFrames);
+    }
+
+
+    /**
+     * Returns a buffer with the limit set to the given frame length.
+     */
+    ByteBuffer acquire (final int length) {
+        if (length > frameCapacity) {
+            return ByteBuffer.allocate (length);
+        }
+
+        ByteBuffer result = freeFrames.poll ();
+        if (result == null) {
+            if (allocatedFrames < maxFrames) {
+                result = ByteBuffer.allocateDirect (frameCapacity);
+                ++allocatedFrames;
+
+            } else {
+                try {
+                    result = freeFrames.take ();
+
+                } catch (final InterruptedException ie) {
+                    throw new DiSLREServerFatalException (
+                        "Interrupted while waiting for a free frame buffer", ie
+                    );
+                }
+            }
+        }
+
+        result.clear ();
+        result.limit (length);
+        return result;
+    }
+
+
+    void release (final ByteBuffer frame) {
+        if (frame.isDirect () && frame.capacity () == frameCapacity) {
+            freeFrames.offer (frame);
+        }
+    }
+
+}
@@ -10,9 +10,11 @@ import java.util.Map.Entry;
 
 import ch.usi.dag.dislreserver.DiSLREServerException;
 import ch.usi.dag.dislreserver.DiSLREServerFatalException;
+import ch.usi.dag.dislreserver.Session;
 import ch.usi.dag.dislreserver.msg.analyze.AnalysisHandler;
 import ch.usi.dag.dislreserver.msg.classinfo.ClassInfoHandler;
 import ch.usi.dag.dislreserver.msg.close.CloseHandler;
+import ch.usi.dag.dislreserver.msg.netreflayout.NetReferenceLayoutHandler;
 import ch.usi.dag.dislreserver.msg.newclass.NewClassHandler;
 import ch.usi.dag.dislreserver.msg.objfree.ObjectFreeHandler;
 import ch.usi.dag.dislreserver.msg.reganalysis.RegAnalysisHandler;
@@ -37,33 +39,63 @@ public final class RequestDispatcher {
     private static final byte __REQUEST_ID_REGISTER_ANALYSIS__ = 6;
     private static final byte __REQUEST_ID_THREAD_INFO__ = 7;
     private static final byte __REQUEST_ID_THREAD_END__ = 8;
+    private static final byte __REQUEST_ID_NETREF_LAYOUT__ = 9;
+
+    // request names indexed by request id - used in statistics
+    private static final String [] __REQUEST_NAMES__ = {
+        "close", "analyze", "objectFree", "newClass", "classInfo",
+        "stringInfo", "registerAnalysis", "threadInfo", "threadEnd",
+        "netrefLayout"
+    };
 
     //
 
-    private static RequestHandler [] __dispatchTable;
-    private static Collection <RequestHandler> __handlers;
+    // request handlers of one session
+    private static final class Handlers {
+        final RequestHandler [] dispatchTable;
+        final Collection <RequestHandler> handlers;
+        final AnalysisHandler analysisHandler;
+
+        Handlers () {
+            //
+            // Register request handlers.
+            // The indices should be in sync with the native agent.
+            //
+            final Map <Byte, RequestHandler> requestMap = new HashMap <Byte, RequestHandler> ();
+            requestMap.put (__REQUEST_ID_CLOSE__, new CloseHandler ());
+            AnalysisHandler anlHndl = new AnalysisHandler ();
+            requestMap.put (__REQUEST_ID_INVOKE_ANALYSIS__, anlHndl);
+            requestMap.put (__REQUEST_ID_OBJECT_FREE__, new ObjectFreeHandler (anlHndl));
+            requestMap.put (__REQUEST_ID_NEW_CLASS__, new NewClassHandler ());
+            requestMap.put (__REQUEST_ID_CLASS_INFO__, new ClassInfoHandler ());
+            requestMap.put (__REQUEST_ID_STRING_INFO__, new StringInfoHandler ());
+            requestMap.put (__REQUEST_ID_REGISTER_ANALYSIS__, new RegAnalysisHandler ());
+            requestMap.put (__REQUEST_ID_THREAD_INFO__, new ThreadInfoHandler());
+            requestMap.put (__REQUEST_ID_THREAD_END__,  new ThreadEndHandler(anlHndl));
+            requestMap.put (__REQUEST_ID_NETREF_LAYOUT__, new NetReferenceLayoutHandler ());
+
+            analysisHandler = anlHndl;
+            handlers = Collections.unmodifiableCollection (requestMap.values ());
+            dispatchTable = __createDispatchTable (requestMap);
+        }
+    }
 
-    //
+    private static final Session.Key <Handlers> __handlersKey = new Session.Key <Handlers> () {
+        @Override
+        protected Handlers create (final Session session) {
+            return new Handlers ();
+        }
 
-    static {
-        //
-        // Register request handlers.
-        // The indices should be in sync with the native agent.
-        //
-        final Map <Byte, RequestHandler> requestMap = new HashMap <Byte, RequestHandler> ();
-        requestMap.put (__REQUEST_ID_CLOSE__, new CloseHandler ());
-        AnalysisHandler anlHndl = new AnalysisHandler ();
-        requestMap.put (__REQUEST_ID_INVOKE_ANALYSIS__, anlHndl);
-        requestMap.put (__REQUEST_ID_OBJECT_FREE__, new ObjectFreeHandler (anlHndl));
-        requestMap.put (__REQUEST_ID_NEW_CLASS__, new NewClassHandler ());
-        requestMap.put (__REQUEST_ID_CLASS_INFO__, new ClassInfoHandler ());
-        requestMap.put (__REQUEST_ID_STRING_INFO__, new StringInfoHandler ());
-        requestMap.put (__REQUEST_ID_REGISTER_ANALYSIS__, new RegAnalysisHandler ());
-        requestMap.put (__REQUEST_ID_THREAD_INFO__, new ThreadInfoHandler());
-        requestMap.put (__REQUEST_ID_THREAD_END__,  new ThreadEndHandler(anlHndl));
-
-        __handlers = Collections.unmodifiableCollection (requestMap.values ());
-        __dispatchTable = __createDispatchTable (requestMap);
+        @Override
+        protected void close (final Handlers handlers) {
+            // stops the executors of a connection closed without a close
+            // request, nothing to do otherwise
+            handlers.analysisHandler.exit ();
+        }
+    };
+
+    private static Handlers __handlers () {
+        return Session.current ().get (__handlersKey);
     }
 
 
@@ -92,7 +124,7 @@ public final class RequestDispatcher {
         // Lookup the request handler and process the request using the handler.
         // Signal to terminate the request loop after handling a close request.
         //
-        final RequestHandler rh = __dispatchTable [requestId];
+        final RequestHandler rh = __handlers ().dispatchTable [requestId];
         if (rh != null) {
             if (debug) {
                 System.out.printf (
@@ -112,8 +144,39 @@ public final class RequestDispatcher {
     }
 
 
+    public static String getRequestName (final byte requestId) {
+        if (requestId >= 0 && requestId < __REQUEST_NAMES__.length) {
+            return __REQUEST_NAMES__ [requestId];
+        }
+
+        return "unknown" + requestId;
+    }
+
+
     public static Iterable <RequestHandler> getAllHandlers () {
-        return __handlers;
+        return __handlers ().handlers;
+    }
+
+    //
+
+    static AnalysisHandler getAnalysisHandler () {
+        return __handlers ().analysisHandler;
+    }
+
+
+    static boolean isAnalysisRequest (final byte requestId) {
+        return requestId == __REQUEST_ID_INVOKE_ANALYSIS__;
+    }
+
+
+    /**
+     * Returns {@code true} for requests that must not be handled before all
+     * preceding analysis requests have been decoded and enqueued.
+     */
+    static boolean isOrderedAfterAnalysis (final byte requestId) {
+        return requestId == __REQUEST_ID_OBJECT_FREE__
+            || requestId == __REQUEST_ID_THREAD_END__
+            || requestId == __REQUEST_ID_CLOSE__;
     }
 
 }
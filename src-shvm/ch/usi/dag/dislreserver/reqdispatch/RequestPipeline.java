@@ -0,0 +1,361 @@
+package ch.usi.dag.dislreserver.reqdispatch;
+
+import java.io.DataInputStream;
+import java.io.DataOutputStream;
+import java.io.EOFException;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.channels.ReadableByteChannel;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.LinkedBlockingQueue;
+
+import ch.usi.dag.dislreserver.DiSLREServerException;
+import ch.usi.dag.dislreserver.DiSLREServerFatalException;
+import ch.usi.dag.dislreserver.Session;
+import ch.usi.dag.dislreserver.msg.analyze.AnalysisHandler;
+import ch.usi.dag.dislreserver.stats.Statistics;
+
+
+/**
+ * Reads the requests of the agent and dispatches them to request handlers.
+ * <p>
+ * The agent sends each of its buffers as a frame prefixed with the frame
+ * length. The reader thread pulls whole frames into pooled direct buffers.
+ * Frames holding an analysis request are passed to a decoder lane selected
+ * by the ordering id of the request. Requests with the same ordering id are
+ * therefore decoded and enqueued for analysis in the order of arrival, while
+ * requests with different ordering ids are decoded in parallel.
+ * <p>
+ * All other requests are handled by the reader thread. Requests that have to
+ * observe the effects of all preceding analysis requests (object free, thread
+ * end, close) first wait until the decoder lanes are drained.
+ */
+public final class RequestPipeline {
+
+    private static final String PROP_DECODERS = "dislreserver.decoders";
+    private static final int DEFAULT_DECODERS = Math.min (
+        4, Runtime.getRuntime ().availableProcessors ()
+    );
+
+    // fits a full agent buffer in the common case
+    private static final int FRAME_CAPACITY = 1 << 20;
+    private static final int FRAMES_PER_DECODER = 4;
+
+    private static final int FRAME_HEADER_SIZE = Integer.SIZE / Byte.SIZE;
+
+    // request id followed by the ordering id
+    private static final int ANALYSIS_HEADER_SIZE =
+        (Byte.SIZE + Long.SIZE) / Byte.SIZE;
+
+    // signals the end of work to a decoder lane
+    private static final ByteBuffer __END_OF_FRAMES__ = ByteBuffer.allocate (0);
+
+    //
+
+    private final ReadableByteChannel channel;
+    private final DataOutputStream os;
+    private final boolean debug;
+
+    private final ByteBuffer header = ByteBuffer.allocateDirect (FRAME_HEADER_SIZE);
+
+    private final FramePool framePool;
+    private final DecoderLane [] lanes;
+
+    private final FlowControl flowControl;
+
+    private final Statistics statistics = Statistics.current ();
+
+    // number of frames passed to the lanes and not yet decoded
+    // guarded by "this"
+    private int pendingFrames;
+
+    // first error encountered by a decoder lane
+    private volatile Throwable decoderFailure;
+
+    //
+
+    public RequestPipeline (
+        final ReadableByteChannel channel, final DataOutputStream os,
+        final boolean debug
+    ) {
+        this.channel = channel;
+        this.os = os;
+        this.debug = debug;
+
+        final int decoderCount = Math.max (
+            1, Integer.getInteger (PROP_DECODERS, DEFAULT_DECODERS)
+        );
+
+        // the reader may hold one more frame while waiting for a decoder
+        this.framePool = new FramePool (
+            FRAME_CAPACITY, decoderCount * FRAMES_PER_DECODER + 1
+        );
+
+        this.lanes = new DecoderLane [decoderCount];
+        for (int i = 0; i < lanes.length; ++i) {
+            lanes [i] = new DecoderLane (i);
+        }
+
+        this.flowControl = new FlowControl (os);
+        RequestDispatcher.getAnalysisHandler ().getDispatcher ().setFlowControl (
+            flowControl
+        );
+
+        if (Statistics.ENABLED) {
+            statistics.setFlowControl (flowControl);
+        }
+    }
+
+
+    /**
+     * Processes requests until the agent closes the connection.
+     */
+    public void run () throws DiSLREServerException {
+        for (final DecoderLane lane : lanes) {
+            lane.start ();
+        }
+
+        // the agent sends analysis buffers only with credits
+        flowControl.start ();
+
+        try {
+            FRAME_LOOP: while (true) {
+                final ByteBuffer frame = __readFrame ();
+                __checkDecoders ();
+
+                final byte requestId = frame.get (frame.position ());
+                if (RequestDispatcher.isAnalysisRequest (requestId)) {
+                    __decodeAnalysisFrame (frame);
+
+                } else if (__handleFrame (frame)) {
+                    break FRAME_LOOP;
+                }
+            }
+
+            __checkDecoders ();
+
+        } catch (final IOException ioe) {
+            throw new DiSLREServerException (ioe);
+
+        } finally {
+            __stopLanes ();
+            flowControl.close ();
+
+            if (Statistics.ENABLED) {
+                statistics.logReport ();
+            }
+        }
+    }
+
+    //
+
+    private ByteBuffer __readFrame () throws IOException, DiSLREServerException {
+        header.clear ();
+        __readFully (header);
+
+        final int length = header.getInt (0);
+        if (length <= 0) {
+            throw new DiSLREServerException (String.format (
+                "invalid request frame length: %d", length
+            ));
+        }
+
+        final ByteBuffer frame = framePool.acquire (length);
+        __readFully (frame);
+        frame.flip ();
+        return frame;
+    }
+
+
+    private void __readFully (final ByteBuffer buffer) throws IOException {
+        while (buffer.hasRemaining ()) {
+            if (channel.read (buffer) < 0) {
+                throw new EOFException ("connection closed by the agent");
+            }
+        }
+    }
+
+
+    private void __decodeAnalysisFrame (final ByteBuffer frame)
+    throws DiSLREServerException {
+        if (frame.remaining () < ANALYSIS_HEADER_SIZE) {
+            throw new DiSLREServerException (String.format (
+                "truncated analysis request: %d bytes", frame.remaining ()
+            ));
+        }
+
+        if (Statistics.ENABLED) {
+            statistics.requestReceived (
+                frame.get (frame.position ()), frame.remaining ()
+            );
+        }
+
+        // requests with the same ordering id always go to the same lane
+        final long orderingId = frame.getLong (frame.position () + 1);
+        final int hash = (int) (orderingId ^ (orderingId >>> 32));
+        final int laneIndex = (hash & Integer.MAX_VALUE) % lanes.length;
+
+        synchronized (this) {
+            ++pendingFrames;
+        }
+
+        lanes [laneIndex].submit (frame);
+    }
+
+
+    /**
+     * Handles all requests in the frame on the reader thread.
+     *
+     * @return {@code true} if the frame contained a close request
+     */
+    private boolean __handleFrame (final ByteBuffer frame)
+    throws DiSLREServerException {
+        final DataInputStream is = new DataInputStream (
+            new ByteBufferInputStream (frame)
+        );
+
+        try {
+            while (frame.hasRemaining ()) {
+                final int requestStart = frame.position ();
+                final byte requestId = frame.get ();
+                final boolean close;
+
+                if (RequestDispatcher.isAnalysisRequest (requestId)) {
+                    // keep the order with requests already in the lanes
+                    __awaitDecoders ();
+                    RequestDispatcher.getAnalysisHandler ().handle (frame, debug);
+                    close = false;
+
+                } else {
+                    if (RequestDispatcher.isOrderedAfterAnalysis (requestId)) {
+                        __awaitDecoders ();
+                    }
+
+                    close = RequestDispatcher.dispatch (requestId, is, os, debug);
+                }
+
+                if (Statistics.ENABLED) {
+                    statistics.requestReceived (
+                        requestId, frame.position () - requestStart
+                    );
+                }
+
+                if (close) {
+                    return true;
+                }
+            }
+
+            return false;
+
+        } finally {
+            framePool.release (frame);
+        }
+    }
+
+    //
+
+    private synchronized void __frameDecoded () {
+        --pendingFrames;
+        if (pendingFrames == 0) {
+            this.notifyAll ();
+        }
+    }
+
+
+    private synchronized void __awaitDecoders () throws DiSLREServerException {
+        try {
+            while (pendingFrames > 0) {
+                this.wait ();
+            }
+
+        } catch (final InterruptedException ie) {
+            throw new DiSLREServerFatalException (
+                "Interrupted while waiting for analysis request decoders", ie
+            );
+        }
+
+        __checkDecoders ();
+    }
+
+
+    private void __checkDecoders () throws DiSLREServerException {
+        final Throwable failure = decoderFailure;
+        if (failure instanceof DiSLREServerException) {
+            throw (DiSLREServerException) failure;
+
+        } else if (failure != null) {
+            throw new DiSLREServerException (failure);
+        }
+    }
+
+
+    private void __stopLanes () {
+        for (final DecoderLane lane : lanes) {
+            lane.submit (__END_OF_FRAMES__);
+        }
+    }
+
+    //
+
+    private final class DecoderLane extends Thread {
+
+        private final BlockingQueue <ByteBuffer> frames =
+            new LinkedBlockingQueue <ByteBuffer> ();
+
+        // session of the connection
+        private final Session session = Session.current ();
+
+        DecoderLane (final int index) {
+            super ("DiSL-RE decoder " + index);
+            setDaemon (true);
+        }
+
+
+        void submit (final ByteBuffer frame) {
+            frames.add (frame);
+        }
+
+
+        @Override
+        public void run () {
+            session.bind ();
+            final AnalysisHandler handler = RequestDispatcher.getAnalysisHandler ();
+
+            try {
+                ByteBuffer frame = frames.take ();
+
+                while (frame != __END_OF_FRAMES__) {
+                    try {
+                        // skip the request id
+                        frame.get ();
+                        handler.handle (frame, debug);
+
+                        if (frame.hasRemaining ()) {
+                            throw new DiSLREServerException (String.format (
+                                "unexpected %d bytes after analysis request",
+                                frame.remaining ()
+                            ));
+                        }
+
+                    } catch (final Throwable t) {
+                        if (decoderFailure == null) {
+                            decoderFailure = t;
+                        }
+
+                    } finally {
+                        framePool.release (frame);
+                        __frameDecoded ();
+                    }
+
+                    frame = frames.take ();
+                }
+
+            } catch (final InterruptedException ie) {
+                throw new DiSLREServerFatalException (
+                    "Decoder thread interrupted while waiting on a frame", ie
+                );
+            }
+        }
+    }
+
+}
@@ -37,6 +37,7 @@ public class MethodInfo {
         exceptionTypes = methodNode.exceptions.toArray(new String[0]);
     }
 
+    // the node of a class method carries no code
     public MethodNode getMethodNode() {
         return methodNode;
     }
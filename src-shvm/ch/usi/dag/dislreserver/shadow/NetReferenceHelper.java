@@ -1,5 +1,10 @@
 package ch.usi.dag.dislreserver.shadow;
 
+import java.util.concurrent.atomic.AtomicReference;
+
+import ch.usi.dag.dislreserver.DiSLREServerFatalException;
+import ch.usi.dag.dislreserver.Session;
+
 public class NetReferenceHelper {
     // ************* special bit mask handling methods **********
 
@@ -9,19 +14,87 @@ public class NetReferenceHelper {
     // should be in sync with net_reference functions on the client
 
     // format of net reference looks like this
-    // HIGHEST (1 bit spec, 23 bits class id, 40 bits object id)
+    // HIGHEST (1 bit spec, 1 bit class instance, 22 bits class id,
+    // 40 bits object id)
     // bit field not used because there is no guarantee of alignment
 
+    // the split between class id and object id bits is announced by the
+    // agent when it connects - see setLayout() - and kept in its session, so
+    // that agents with different layouts can be served at once
+
     private static final short OBJECT_ID_POS = 0;
-    private static final short CLASS_ID_POS = 40;
     private static final short SPEC_POS = 63;
     private static final short CBIT_POS = 62;
 
-    private static final long OBJECT_ID_MASK = 0xFFFFFFFFFFL;
-    private static final long CLASS_ID_MASK = 0x3FFFFFL;
     private static final long SPEC_MASK = 0x1L;
     private static final long CBIT_MASK = 0x1L;
 
+    private static final int MIN_CLASS_ID_BITS = 22;
+    private static final int MAX_CLASS_ID_BITS = 31;
+
+    /**
+     * Split between class id and object id bits of one session. Code
+     * decoding many net references resolves the layout once and uses it for
+     * all of them.
+     */
+    public static final class Layout {
+        final short classIdPos;
+        final long objectIdMask;
+        final long classIdMask;
+
+        Layout(int classIdBits) {
+            classIdPos = (short) (CBIT_POS - classIdBits);
+            objectIdMask = (1L << classIdPos) - 1;
+            classIdMask = (1L << classIdBits) - 1;
+        }
+
+        public long get_object_id(long net_ref) {
+
+            return get_bits(net_ref, objectIdMask, OBJECT_ID_POS);
+        }
+
+        public int get_class_id(long net_ref) {
+
+            return (int) get_bits(net_ref, classIdMask, classIdPos);
+        }
+    }
+
+    private static final Layout DEFAULT_LAYOUT = new Layout(MIN_CLASS_ID_BITS);
+
+    private static final Session.Key<AtomicReference<Layout>> layoutKey =
+            new Session.Key<AtomicReference<Layout>>() {
+
+        @Override
+        protected AtomicReference<Layout> create(Session session) {
+            return new AtomicReference<Layout>(DEFAULT_LAYOUT);
+        }
+    };
+
+    /**
+     * Returns the net reference layout of the current session.
+     */
+    public static Layout layout() {
+        return layout(Session.current());
+    }
+
+    static Layout layout(Session session) {
+        return session.get(layoutKey).get();
+    }
+
+    /**
+     * Sets the net reference layout of the current session.
+     */
+    public static void setLayout(int classIdBits) {
+
+        if (classIdBits < MIN_CLASS_ID_BITS || classIdBits > MAX_CLASS_ID_BITS) {
+            throw new DiSLREServerFatalException(
+                    "Unsupported net reference layout: " + classIdBits
+                            + " class id bits");
+        }
+
+        Session.current().get(layoutKey).set(new Layout(classIdBits));
+    }
+
     // get bits from "from" with pattern "bit_mask" lowest bit starting on
     // position
     // "low_start" (from 0)
@@ -36,12 +109,12 @@ public class NetReferenceHelper {
 
     public static long get_object_id(long net_ref) {
 
-        return get_bits(net_ref, OBJECT_ID_MASK, OBJECT_ID_POS);
+        return layout().get_object_id(net_ref);
     }
 
     public static int get_class_id(long net_ref) {
 
-        return (int) get_bits(net_ref, CLASS_ID_MASK, CLASS_ID_POS);
+        return layout().get_class_id(net_ref);
     }
 
     public static short get_spec(long net_ref) {
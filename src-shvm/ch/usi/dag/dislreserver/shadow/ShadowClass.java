@@ -2,9 +2,18 @@ package ch.usi.dag.dislreserver.shadow;
 
 public abstract class ShadowClass extends ShadowObject {
 
+    // kind of shadow objects created for instances of this class
+    static final byte INSTANCE_KIND_UNKNOWN = 0;
+    static final byte INSTANCE_KIND_OBJECT = 1;
+    static final byte INSTANCE_KIND_STRING = 2;
+    static final byte INSTANCE_KIND_THREAD = 3;
+
     private final int          classId;
     private final ShadowObject classLoader;
 
+    // resolved on first use - races are benign
+    private volatile byte      instanceKind = INSTANCE_KIND_UNKNOWN;
+
     //
 
     protected ShadowClass(
@@ -27,6 +36,36 @@ public abstract class ShadowClass extends ShadowObject {
         return classLoader;
     }
 
+    final byte getInstanceKind() {
+
+        byte kind = instanceKind;
+
+        if (kind == INSTANCE_KIND_UNKNOWN) {
+            kind = resolveInstanceKind();
+            instanceKind = kind;
+        }
+
+        return kind;
+    }
+
+    private byte resolveInstanceKind() {
+
+        if ("java.lang.String".equals(getName())) {
+            return INSTANCE_KIND_STRING;
+        }
+
+        for (ShadowClass klass = this;
+                klass != null && !"java.lang.Object".equals(klass.getName());
+                klass = klass.getSuperclass()) {
+
+            if ("java.lang.Thread".equals(klass.getName())) {
+                return INSTANCE_KIND_THREAD;
+            }
+        }
+
+        return INSTANCE_KIND_OBJECT;
+    }
+
     public abstract boolean isArray();
 
     public abstract ShadowClass getComponentType();
@@ -1,37 +1,68 @@
 package ch.usi.dag.dislreserver.shadow;
 
+import java.util.HashMap;
+import java.util.HashSet;
+import java.util.Map;
+import java.util.Set;
 import java.util.concurrent.ConcurrentHashMap;
 
 import org.objectweb.asm.Type;
 
 import ch.usi.dag.dislreserver.DiSLREServerFatalException;
+import ch.usi.dag.dislreserver.Session;
+import ch.usi.dag.dislreserver.util.Logging;
+import ch.usi.dag.util.logging.Logger;
 
 public class ShadowClassTable {
 
+    private static final Logger __log = Logging.getPackageInstance();
+
     private static final int INITIAL_TABLE_SIZE = 10000;
 
-    final static ShadowObject BOOTSTRAP_CLASSLOADER;
+    // shared by all sessions - shadow objects are compared by id only
+    final static ShadowObject BOOTSTRAP_CLASSLOADER = new ShadowObject(0, null);
+
+    // classes of one session
+    private static final class Classes {
+
+        volatile ShadowClass javaLangClass;
+
+        final ConcurrentHashMap<ShadowObject, ConcurrentHashMap<String, byte[]>> classLoaderMap =
+                new ConcurrentHashMap<ShadowObject, ConcurrentHashMap<String, byte[]>>(INITIAL_TABLE_SIZE);
 
-    static ShadowClass JAVA_LANG_CLASS;
+        final ConcurrentHashMap<Integer, ShadowClass> shadowClasses =
+                new ConcurrentHashMap<Integer, ShadowClass>(INITIAL_TABLE_SIZE);
 
-    private static ConcurrentHashMap<ShadowObject, ConcurrentHashMap<String, byte[]>> classLoaderMap;
-    private static ConcurrentHashMap<Integer, ShadowClass> shadowClasses;
+        // ids of unloaded classes that are not yet freed - guarded by itself
+        final Set<Integer> retiredClassIds = new HashSet<Integer>();
 
-    static {
+        Classes() {
+            classLoaderMap.put(BOOTSTRAP_CLASSLOADER,
+                    new ConcurrentHashMap<String, byte[]>());
+        }
+    }
 
-        BOOTSTRAP_CLASSLOADER = new ShadowObject(0, null);
-        JAVA_LANG_CLASS = null;
+    private static final Session.Key<Classes> classesKey = new Session.Key<Classes>() {
+
+        @Override
+        protected Classes create(Session session) {
+            return new Classes();
+        }
+    };
 
-        classLoaderMap = new ConcurrentHashMap<ShadowObject, ConcurrentHashMap<String, byte[]>>(INITIAL_TABLE_SIZE);
-        shadowClasses = new ConcurrentHashMap<Integer, ShadowClass>(INITIAL_TABLE_SIZE);
+    private static Classes classes() {
+        return Session.current().get(classesKey);
+    }
 
-        classLoaderMap.put(BOOTSTRAP_CLASSLOADER,
-                new ConcurrentHashMap<String, byte[]>());
+    static ShadowClass getJavaLangClass() {
+        return classes().javaLangClass;
     }
 
     public static void load(ShadowObject loader, String className,
             byte[] classCode, boolean debug) {
 
+        Classes classes = classes();
+
         ConcurrentHashMap<String, byte[]> classNameMap;
 
         if (loader == null) {
@@ -39,13 +70,13 @@ public class ShadowClassTable {
             loader = BOOTSTRAP_CLASSLOADER;
         }
 
-        classNameMap = classLoaderMap.get(loader);
+        classNameMap = classes.classLoaderMap.get(loader);
 
         if (classNameMap == null) {
 
             ConcurrentHashMap<String, byte[]> tmp = new ConcurrentHashMap<String, byte[]>();
 
-            if ((classNameMap = classLoaderMap.putIfAbsent(loader, tmp)) == null) {
+            if ((classNameMap = classes.classLoaderMap.putIfAbsent(loader, tmp)) == null) {
                 classNameMap = tmp;
             }
         }
@@ -62,6 +93,8 @@ public class ShadowClassTable {
             ShadowObject loader, String classSignature, String classGenericStr,
             boolean debug) {
 
+        Classes classes = classes();
+
         if (!NetReferenceHelper.isClassInstance(net_ref)) {
             throw new DiSLREServerFatalException("Unknown class instance");
         }
@@ -81,7 +114,7 @@ public class ShadowClassTable {
                 loader = BOOTSTRAP_CLASSLOADER;
             }
 
-            classNameMap = classLoaderMap.get(loader);
+            classNameMap = classes.classLoaderMap.get(loader);
 
             if (classNameMap == null) {
                 throw new DiSLREServerFatalException("Unknown class loader");
@@ -90,19 +123,30 @@ public class ShadowClassTable {
             byte[] classCode = classNameMap.get(t.getClassName());
 
             if (classCode == null) {
+                // the class code is released once the class is known
+                ShadowClass known = classes.shadowClasses.get(
+                        NetReferenceHelper.get_class_id(net_ref));
+
+                if (known != null && known.getNetRef() == net_ref) {
+                    return known;
+                }
+
                 throw new DiSLREServerFatalException("Class "
                         + t.getClassName() + " has not been loaded");
             }
 
             klass = new ShadowCommonClass(net_ref, classSignature, loader,
                     superClass, classCode);
+
+            // the shadow class now holds the only reference to the code
+            classNameMap.remove(t.getClassName(), classCode);
         } else {
 
             klass = new ShadowPrimitiveClass(net_ref, loader, t);
         }
 
         int classID = NetReferenceHelper.get_class_id(net_ref);
-        ShadowClass exist = shadowClasses.putIfAbsent(classID, klass);
+        ShadowClass exist = registerClass(classes, classID, klass);
 
         if (exist == null) {
             ShadowObjectTable.register(klass, debug);
@@ -110,9 +154,9 @@ public class ShadowClassTable {
             throw new DiSLREServerFatalException("Duplicated class ID");
         }
 
-        if (JAVA_LANG_CLASS == null
+        if (classes.javaLangClass == null
                 && "Ljava/lang/Class;".equals(classSignature)) {
-            JAVA_LANG_CLASS = klass;
+            classes.javaLangClass = klass;
         }
 
         return klass;
@@ -120,12 +164,17 @@ public class ShadowClassTable {
 
     public static ShadowClass get(int classID) {
 
+        return get(Session.current(), classID);
+    }
+
+    static ShadowClass get(Session session, int classID) {
+
         if (classID == 0) {
             // reserved ID for java/lang/Class
             return null;
         }
 
-        ShadowClass klass = shadowClasses.get(classID);
+        ShadowClass klass = session.get(classesKey).shadowClasses.get(classID);
 
         if (klass == null) {
             throw new DiSLREServerFatalException("Unknown class instance");
@@ -134,13 +183,124 @@ public class ShadowClassTable {
         return klass;
     }
 
+    // Class ids of unloaded classes are reused by the agent. The class stays
+    // registered until its class object is freed - events queued before the
+    // unloading can still resolve objects of the class. A class info reusing
+    // a retired id waits until then.
+    public static void retireClassId(int classID) {
+
+        Classes classes = classes();
+
+        synchronized (classes.retiredClassIds) {
+            classes.retiredClassIds.add(classID);
+        }
+    }
+
+    private static ShadowClass registerClass(Classes classes, int classID,
+            ShadowClass klass) {
+
+        ShadowClass exist = classes.shadowClasses.putIfAbsent(classID, klass);
+
+        synchronized (classes.retiredClassIds) {
+            while (exist != null && !exist.equals(klass)
+                    && classes.retiredClassIds.contains(classID)) {
+
+                try {
+                    classes.retiredClassIds.wait();
+                } catch (InterruptedException e) {
+                    throw new DiSLREServerFatalException(
+                            "Interrupted while waiting for class id release", e);
+                }
+
+                exist = classes.shadowClasses.putIfAbsent(classID, klass);
+            }
+        }
+
+        return exist;
+    }
+
+    /**
+     * Logs the memory held by the class metadata of each class loader.
+     */
+    public static void logFootprint() {
+
+        Classes classes = classes();
+
+        if (!__log.debugIsLoggable()) {
+            return;
+        }
+
+        Map<ShadowObject, long[]> footprints = new HashMap<ShadowObject, long[]>();
+
+        // classes, parsed classes, parsed members, retained code bytes
+        for (ShadowClass klass : classes.shadowClasses.values()) {
+
+            if (!(klass instanceof ShadowCommonClass)) {
+                continue;
+            }
+
+            ShadowCommonClass commonClass = (ShadowCommonClass) klass;
+            long[] footprint = getFootprint(footprints,
+                    klass.getShadowClassLoader());
+
+            footprint[0]++;
+            footprint[1] += commonClass.isParsed() ? 1 : 0;
+            footprint[2] += commonClass.getParsedMemberCount();
+            footprint[3] += commonClass.getRetainedCodeSize();
+        }
+
+        // code of classes loaded but not yet known
+        for (Map.Entry<ShadowObject, ConcurrentHashMap<String, byte[]>> entry
+                : classes.classLoaderMap.entrySet()) {
+
+            long[] footprint = getFootprint(footprints, entry.getKey());
+
+            for (byte[] classCode : entry.getValue().values()) {
+                footprint[3] += classCode.length;
+            }
+        }
+
+        for (Map.Entry<ShadowObject, long[]> entry : footprints.entrySet()) {
+            long[] footprint = entry.getValue();
+
+            __log.debug("class loader %d: %d classes, %d parsed with %d "
+                    + "members, %d bytes of class code retained",
+                    entry.getKey().getId(), footprint[0], footprint[1],
+                    footprint[2], footprint[3]);
+        }
+    }
+
+    private static long[] getFootprint(Map<ShadowObject, long[]> footprints,
+            ShadowObject loader) {
+
+        if (loader == null) {
+            loader = BOOTSTRAP_CLASSLOADER;
+        }
+
+        long[] footprint = footprints.get(loader);
+
+        if (footprint == null) {
+            footprint = new long[4];
+            footprints.put(loader, footprint);
+        }
+
+        return footprint;
+    }
+
     public static void freeShadowObject(ShadowObject obj) {
 
+        Classes classes = classes();
+
         if (NetReferenceHelper.isClassInstance(obj.getNetRef())) {
             int classID = NetReferenceHelper.get_class_id(obj.getNetRef());
-            shadowClasses.remove(classID);
-        } else if (classLoaderMap.keySet().contains(obj)) {
-            classLoaderMap.remove(obj);
+
+            synchronized (classes.retiredClassIds) {
+                classes.shadowClasses.remove(classID, obj);
+                classes.retiredClassIds.remove(classID);
+                classes.retiredClassIds.notifyAll();
+            }
+        } else if (classes.classLoaderMap.keySet().contains(obj)) {
+            classes.classLoaderMap.remove(obj);
         }
     }
 
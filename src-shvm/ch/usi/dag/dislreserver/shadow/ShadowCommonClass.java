@@ -2,7 +2,6 @@ package ch.usi.dag.dislreserver.shadow;
 
 import java.util.ArrayList;
 import java.util.Arrays;
-import java.util.LinkedList;
 import java.util.List;
 
 import org.objectweb.asm.ClassReader;
@@ -19,11 +18,17 @@ class ShadowCommonClass extends ShadowClass {
     // TODO ! is this implementation of methods really working ??
 
     private ShadowClass superClass;
-    private ClassNode   classNode;
 
     private int         access;
     private String      name;
 
+    // class file bytes - released once the class info is parsed
+    // guarded by "this"
+    private byte[]      classCode;
+
+    // parsed on the first reflective query
+    private volatile ClassInfo classInfo;
+
     ShadowCommonClass(long net_ref, String classSignature,
             ShadowObject classLoader, ShadowClass superClass, byte[] classCode) {
         super(net_ref, classLoader);
@@ -35,67 +40,120 @@ class ShadowCommonClass extends ShadowClass {
                     + classSignature + " with no code provided");
         }
 
-        initializeClassInfo(classCode);
+        // only the class header is read here
+        ClassReader classReader = new ClassReader(classCode);
+        access = classReader.getAccess();
+        name = classReader.getClassName().replace('/', '.');
+
+        this.classCode = classCode;
     }
 
-    private List<MethodInfo> methods;
-    private List<MethodInfo> public_methods;
-    private List<FieldInfo>  fields;
-    private List<FieldInfo>  public_fields;
-    private List<String>     innerclasses;
+    // Members declared by the class. Members inherited from superclasses are
+    // not copied here, queries walk the superclass chain instead.
+    private static final class ClassInfo {
 
-    private void initializeClassInfo(byte[] classCode) {
+        final MethodInfo[] methods;
+        final MethodInfo[] publicMethods;
+        final FieldInfo[]  fields;
+        final FieldInfo[]  publicFields;
+        final String[]     interfaces;
+        final String[]     innerclasses;
 
-        ClassReader classReader = new ClassReader(classCode);
-        classNode = new ClassNode(Opcodes.ASM4);
-        classReader.accept(classNode, ClassReader.SKIP_DEBUG
-                | ClassReader.EXPAND_FRAMES);
+        ClassInfo(byte[] classCode) {
 
-        access = classNode.access;
-        name = classNode.name.replace('/', '.');
+            // the server never looks at method bodies
+            ClassReader classReader = new ClassReader(classCode);
+            ClassNode classNode = new ClassNode(Opcodes.ASM4);
+            classReader.accept(classNode, ClassReader.SKIP_CODE
+                    | ClassReader.SKIP_DEBUG | ClassReader.SKIP_FRAMES);
 
-        methods = new ArrayList<MethodInfo>(classNode.methods.size());
-        public_methods = new LinkedList<MethodInfo>();
+            List<MethodInfo> allMethods = new ArrayList<MethodInfo>(
+                    classNode.methods.size());
+            List<MethodInfo> ownPublicMethods = new ArrayList<MethodInfo>();
 
-        for (MethodNode methodNode : classNode.methods) {
+            for (MethodNode methodNode : classNode.methods) {
 
-            MethodInfo methodInfo = new MethodInfo(methodNode);
-            methods.add(methodInfo);
+                MethodInfo methodInfo = new MethodInfo(methodNode);
+                allMethods.add(methodInfo);
 
-            if (methodInfo.isPublic()) {
-                public_methods.add(methodInfo);
+                if (methodInfo.isPublic()) {
+                    ownPublicMethods.add(methodInfo);
+                }
             }
-        }
 
-        fields = new ArrayList<FieldInfo>(classNode.fields.size());
-        public_fields = new LinkedList<FieldInfo>();
+            List<FieldInfo> allFields = new ArrayList<FieldInfo>(
+                    classNode.fields.size());
+            List<FieldInfo> ownPublicFields = new ArrayList<FieldInfo>();
 
-        for (FieldNode fieldNode : classNode.fields) {
+            for (FieldNode fieldNode : classNode.fields) {
 
-            FieldInfo fieldInfo = new FieldInfo(fieldNode);
-            fields.add(fieldInfo);
+                FieldInfo fieldInfo = new FieldInfo(fieldNode);
+                allFields.add(fieldInfo);
 
-            if (fieldInfo.isPublic()) {
-                public_fields.add(fieldInfo);
+                if (fieldInfo.isPublic()) {
+                    ownPublicFields.add(fieldInfo);
+                }
             }
-        }
 
-        if (getSuperclass() != null) {
+            innerclasses = new String[classNode.innerClasses.size()];
 
-            for (MethodInfo methodInfo : getSuperclass().getMethods()) {
-                public_methods.add(methodInfo);
+            for (int i = 0; i < innerclasses.length; i++) {
+                InnerClassNode innerClassNode = classNode.innerClasses.get(i);
+                innerclasses[i] = innerClassNode.name;
             }
 
-            for (FieldInfo fieldInfo : getSuperclass().getFields()) {
-                public_fields.add(fieldInfo);
-            }
+            methods = allMethods.toArray(new MethodInfo[allMethods.size()]);
+            publicMethods = ownPublicMethods
+                    .toArray(new MethodInfo[ownPublicMethods.size()]);
+            fields = allFields.toArray(new FieldInfo[allFields.size()]);
+            publicFields = ownPublicFields
+                    .toArray(new FieldInfo[ownPublicFields.size()]);
+            interfaces = classNode.interfaces
+                    .toArray(new String[classNode.interfaces.size()]);
+        }
+
+        int memberCount() {
+            return methods.length + fields.length;
+        }
+    }
+
+    private ClassInfo getClassInfo() {
+
+        ClassInfo result = classInfo;
+
+        if (result == null) {
+            result = parseClassInfo();
         }
 
-        innerclasses = new ArrayList<String>(classNode.innerClasses.size());
+        return result;
+    }
+
+    private synchronized ClassInfo parseClassInfo() {
 
-        for (InnerClassNode innerClassNode : classNode.innerClasses) {
-            innerclasses.add(innerClassNode.name);
+        if (classInfo == null) {
+            classInfo = new ClassInfo(classCode);
+
+            // not needed any more
+            classCode = null;
         }
+
+        return classInfo;
+    }
+
+    // footprint accounting
+
+    synchronized int getRetainedCodeSize() {
+        return (classCode != null) ? classCode.length : 0;
+    }
+
+    boolean isParsed() {
+        return classInfo != null;
+    }
+
+    int getParsedMemberCount() {
+
+        ClassInfo info = classInfo;
+        return (info != null) ? info.memberCount() : 0;
     }
 
     @Override
@@ -169,7 +227,9 @@ class ShadowCommonClass extends ShadowClass {
 
     @Override
     public String[] getInterfaces() {
-        return classNode.interfaces.toArray(new String[0]);
+
+        String[] interfaces = getClassInfo().interfaces;
+        return Arrays.copyOf(interfaces, interfaces.length);
     }
 
     @Override
@@ -191,14 +251,19 @@ class ShadowCommonClass extends ShadowClass {
 
     public FieldInfo[] getFields() {
 
-        // to have "checked" array :(
-        return public_fields.toArray(new FieldInfo[0]);
+        FieldInfo[] ownFields = getClassInfo().publicFields;
+
+        if (getSuperclass() == null) {
+            return Arrays.copyOf(ownFields, ownFields.length);
+        }
+
+        return concat(ownFields, getSuperclass().getFields());
     }
 
     public FieldInfo getField(String fieldName) throws NoSuchFieldException {
 
-        for (FieldInfo fieldInfo : fields) {
-            if (fieldInfo.isPublic() && fieldInfo.getName().equals(fieldName)) {
+        for (FieldInfo fieldInfo : getClassInfo().publicFields) {
+            if (fieldInfo.getName().equals(fieldName)) {
                 return fieldInfo;
             }
         }
@@ -212,14 +277,19 @@ class ShadowCommonClass extends ShadowClass {
 
     public MethodInfo[] getMethods() {
 
-        // to have "checked" array :(
-        return public_methods.toArray(new MethodInfo[0]);
+        MethodInfo[] ownMethods = getClassInfo().publicMethods;
+
+        if (getSuperclass() == null) {
+            return Arrays.copyOf(ownMethods, ownMethods.length);
+        }
+
+        return concat(ownMethods, getSuperclass().getMethods());
     }
 
     public MethodInfo getMethod(String methodName, String[] argumentNames)
             throws NoSuchMethodException {
 
-        for (MethodInfo methodInfo : public_methods) {
+        for (MethodInfo methodInfo : getClassInfo().publicMethods) {
             if (methodName.equals(methodInfo.getName())
                     && Arrays.equals(argumentNames,
                             methodInfo.getParameterTypes())) {
@@ -227,18 +297,28 @@ class ShadowCommonClass extends ShadowClass {
             }
         }
 
+        if (getSuperclass() != null) {
+            try {
+                return getSuperclass().getMethod(methodName, argumentNames);
+            } catch (NoSuchMethodException e) {
+                // reported for this class below
+            }
+        }
+
         throw new NoSuchMethodException(name + "." + methodName
                 + argumentNamesToString(argumentNames));
     }
 
     public FieldInfo[] getDeclaredFields() {
-        return fields.toArray(new FieldInfo[0]);
+
+        FieldInfo[] fields = getClassInfo().fields;
+        return Arrays.copyOf(fields, fields.length);
     }
 
     public FieldInfo getDeclaredField(String fieldName)
             throws NoSuchFieldException {
 
-        for (FieldInfo fieldInfo : fields) {
+        for (FieldInfo fieldInfo : getClassInfo().fields) {
             if (fieldInfo.getName().equals(fieldName)) {
                 return fieldInfo;
             }
@@ -248,17 +328,21 @@ class ShadowCommonClass extends ShadowClass {
     }
 
     public MethodInfo[] getDeclaredMethods() {
-        return methods.toArray(new MethodInfo[methods.size()]);
+
+        MethodInfo[] methods = getClassInfo().methods;
+        return Arrays.copyOf(methods, methods.length);
     }
 
     public String[] getDeclaredClasses() {
-        return innerclasses.toArray(new String[innerclasses.size()]);
+
+        String[] innerclasses = getClassInfo().innerclasses;
+        return Arrays.copyOf(innerclasses, innerclasses.length);
     }
 
     public MethodInfo getDeclaredMethod(String methodName,
             String[] argumentNames) throws NoSuchMethodException {
 
-        for (MethodInfo methodInfo : methods) {
+        for (MethodInfo methodInfo : getClassInfo().methods) {
             if (methodName.equals(methodInfo.getName())
                     && Arrays.equals(argumentNames,
                             methodInfo.getParameterTypes())) {
@@ -270,4 +354,11 @@ class ShadowCommonClass extends ShadowClass {
                 + argumentNamesToString(argumentNames));
     }
 
+    private static <T> T[] concat(T[] first, T[] second) {
+
+        T[] result = Arrays.copyOf(first, first.length + second.length);
+        System.arraycopy(second, 0, result, first.length, second.length);
+        return result;
+    }
+
 }
@@ -2,6 +2,7 @@ package ch.usi.dag.dislreserver.shadow;
 
 import java.util.Formattable;
 import java.util.Formatter;
+import java.util.concurrent.atomic.AtomicReferenceArray;
 
 public class ShadowObject implements Formattable {
 
@@ -9,16 +10,36 @@ public class ShadowObject implements Formattable {
     final private long shadowId;
     final private ShadowClass shadowClass;
 
-    private Object shadowState;
+    // analysis state, one element per state slot - created on first update
+    // and replaced by a longer array if a slot is allocated later, SPILLED
+    // while the states are moved out of the heap
+    private volatile AtomicReferenceArray <Object> shadowStates;
+
+    private static final AtomicReferenceArray <Object> SPILLED =
+        new AtomicReferenceArray <Object> (0);
+
+    // recently accessed through the object table - cleared by the spiller
+    boolean touched = true;
 
     //
 
 
     ShadowObject (final long netReference, final ShadowClass shadowClass) {
+        this (
+            netReference, NetReferenceHelper.get_object_id (netReference),
+            shadowClass
+        );
+    }
+
+
+    ShadowObject (
+        final long netReference, final long shadowId,
+        final ShadowClass shadowClass
+    ) {
         this.netRef = netReference;
-        this.shadowId = NetReferenceHelper.get_object_id (netReference);
+        this.shadowId = shadowId;
         this.shadowClass = shadowClass;
-        this.shadowState = null;
+        this.shadowStates = null;
     }
 
     //
@@ -41,35 +62,243 @@ public class ShadowObject implements Formattable {
                 throw new NullPointerException();
             }
 
-            return ShadowClassTable.JAVA_LANG_CLASS;
+            return ShadowClassTable.getJavaLangClass();
+        }
+    }
+
+    public Object getState () {
+        return getState (ShadowStateSlot.DEFAULT);
+    }
+
+
+    public <T> T getState (final Class <T> type) {
+        return type.cast (getState (ShadowStateSlot.DEFAULT));
+    }
+
+
+    public void setState (final Object shadowState) {
+        setState (ShadowStateSlot.DEFAULT, shadowState);
+    }
+
+
+    public Object setStateIfAbsent (final Object shadowState) {
+        return setStateIfAbsent (ShadowStateSlot.DEFAULT, shadowState);
+    }
+
+    //
+
+    public <T> T getState (final ShadowStateSlot <T> slot) {
+        AtomicReferenceArray <Object> states;
+        while ((states = shadowStates) == SPILLED) {
+            ShadowObjectTable.faultIn (this);
+        }
+
+        if (states == null || slot.index >= states.length ()) {
+            return null;
+        }
+
+        return slot.cast (__unfreeze (states.get (slot.index)));
+    }
+
+
+    public <T> void setState (final ShadowStateSlot <T> slot, final T value) {
+        while (true) {
+            final AtomicReferenceArray <Object> states = __getStates (slot);
+            if (states == null) {
+                ShadowObjectTable.faultIn (this);
+                continue;
+            }
+
+            final Object current = states.get (slot.index);
+
+            if (current instanceof FrozenState) {
+                __awaitFrozen ();
+
+            } else if (states.compareAndSet (slot.index, current, value)) {
+                return;
+            }
+        }
+    }
+
+
+    /**
+     * Sets the state if the slot holds no state.
+     *
+     * @return the state held by the slot, or {@code null} if the state was set
+     */
+    public <T> T setStateIfAbsent (final ShadowStateSlot <T> slot, final T value) {
+        while (true) {
+            final AtomicReferenceArray <Object> states = __getStates (slot);
+            if (states == null) {
+                ShadowObjectTable.faultIn (this);
+                continue;
+            }
+
+            final Object current = states.get (slot.index);
+
+            if (current instanceof FrozenState) {
+                __awaitFrozen ();
+
+            } else if (current != null) {
+                return slot.cast (current);
+
+            } else if (states.compareAndSet (slot.index, null, value)) {
+                return null;
+            }
+        }
+    }
+
+
+    public <T> boolean compareAndSetState (
+        final ShadowStateSlot <T> slot, final T expected, final T value
+    ) {
+        while (true) {
+            final AtomicReferenceArray <Object> states = __getStates (slot);
+            if (states == null) {
+                ShadowObjectTable.faultIn (this);
+                continue;
+            }
+
+            final Object current = states.get (slot.index);
+
+            if (current instanceof FrozenState) {
+                __awaitFrozen ();
+
+            } else if (current != expected) {
+                return false;
+
+            } else if (states.compareAndSet (slot.index, expected, value)) {
+                return true;
+            }
         }
     }
 
-    public synchronized Object getState () {
-        return shadowState;
+    //
+
+    // value of a state in an array that is being replaced or spilled
+    private static final class FrozenState {
+        final Object value;
+
+        FrozenState (final Object value) {
+            this.value = value;
+        }
+    }
+
+
+    private static Object __unfreeze (final Object state) {
+        return (state instanceof FrozenState) ? ((FrozenState) state).value : state;
     }
 
 
-    public synchronized <T> T getState (final Class <T> type) {
-        return type.cast (shadowState);
+    // returns null if the object has been spilled
+    private AtomicReferenceArray <Object> __getStates (final ShadowStateSlot <?> slot) {
+        final AtomicReferenceArray <Object> states = shadowStates;
+        if (states == SPILLED) {
+            return null;
+        }
+
+        if (states != null && slot.index < states.length ()) {
+            return states;
+        }
+
+        return __growStates (slot.index);
+    }
+
+
+    private synchronized AtomicReferenceArray <Object> __growStates (final int index) {
+        if (shadowStates == SPILLED) {
+            return null;
+        }
+
+        final AtomicReferenceArray <Object> states = shadowStates;
+        if (states != null && index < states.length ()) {
+            // grown in the meantime
+            return states;
+        }
+
+        final AtomicReferenceArray <Object> result = new AtomicReferenceArray <Object> (
+            Math.max (index + 1, ShadowStateSlot.count ())
+        );
+
+        final Object [] values = freezeStates ();
+        for (int i = 0; i < values.length; ++i) {
+            result.set (i, values [i]);
+        }
+
+        shadowStates = result;
+        return result;
     }
 
 
-    public synchronized void setState (final Object shadowState) {
-        this.shadowState = shadowState;
+    private void __awaitFrozen () {
+        // the states are frozen only while holding the lock
+        synchronized (this) {
+            // nothing to do, the states are replaced or spilled
+        }
     }
 
-    public synchronized Object setStateIfAbsent(Object shadowState) {
 
-        Object retVal = this.shadowState;
+    // spilling support - called with the lock held
 
-        if (retVal == null) {
-            this.shadowState = shadowState;
+    /**
+     * Freezes the states so that no concurrent update gets lost. The states
+     * must be replaced, thawed or spilled before releasing the lock.
+     */
+    Object [] freezeStates () {
+        final AtomicReferenceArray <Object> states = shadowStates;
+        if (states == null) {
+            return new Object [0];
         }
 
-        return retVal;
+        final Object [] result = new Object [states.length ()];
+        for (int i = 0; i < result.length; ++i) {
+            Object value;
+            do {
+                value = states.get (i);
+            } while (!states.compareAndSet (i, value, new FrozenState (value)));
+
+            result [i] = value;
+        }
+
+        return result;
     }
 
+
+    void thawStates (final Object [] values) {
+        if (shadowStates != null) {
+            shadowStates = new AtomicReferenceArray <Object> (values);
+        }
+    }
+
+
+    void restoreStates (final Object [] values) {
+        shadowStates = new AtomicReferenceArray <Object> (values);
+    }
+
+
+    /**
+     * Drops the frozen states from the heap once they were spilled. Further
+     * state accesses fault the states back in through the object table.
+     */
+    void markSpilled () {
+        shadowStates = SPILLED;
+    }
+
+
+    /**
+     * Drops the spilled states of a freed object.
+     */
+    void discardStates () {
+        shadowStates = null;
+    }
+
+
+    boolean isSpilled () {
+        return shadowStates == SPILLED;
+    }
+
+    //
+
     // only object id considered
     // TODO consider also the class ID
     public int hashCode() {
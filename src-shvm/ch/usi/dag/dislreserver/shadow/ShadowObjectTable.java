@@ -1,20 +1,523 @@
 package ch.usi.dag.dislreserver.shadow;
 
+import java.nio.ByteBuffer;
+import java.nio.LongBuffer;
+import java.util.AbstractMap.SimpleImmutableEntry;
 import java.util.Iterator;
 import java.util.Map.Entry;
-import java.util.concurrent.ConcurrentHashMap;
+import java.util.NoSuchElementException;
+import java.util.concurrent.atomic.AtomicInteger;
+import java.util.concurrent.atomic.AtomicLong;
+import java.util.concurrent.atomic.AtomicReferenceArray;
 
 import ch.usi.dag.dislreserver.DiSLREServerFatalException;
+import ch.usi.dag.dislreserver.Session;
 
 public class ShadowObjectTable {
 
-    private static final int INITIAL_TABLE_SIZE = 10000000;
-    private static ConcurrentHashMap<Long, ShadowObject> shadowObjects;
+    // Object ids are assigned densely by the agent, so the shadow objects are
+    // kept in a segmented array indexed directly by the object id - three
+    // levels of 15, 15 and 10 bits cover the 40 bits of the object id. Reads
+    // are lock-free. Leaf and middle segments are created on demand and
+    // dropped again when all their objects (leaves) are gone. Leaves are
+    // small, so that a few long-lived objects do not keep much memory.
 
-    static {
-        shadowObjects = new ConcurrentHashMap<Long, ShadowObject>(INITIAL_TABLE_SIZE);
+    private static final int LEAF_BITS = 10;
+    private static final int MIDDLE_BITS = 15;
+    private static final int TOP_BITS = 15;
+
+    private static final int LEAF_SIZE = 1 << LEAF_BITS;
+    private static final int MIDDLE_SIZE = 1 << MIDDLE_BITS;
+    private static final int TOP_SIZE = 1 << TOP_BITS;
+
+    private static final long MAX_OBJECT_ID =
+        (1L << (LEAF_BITS + MIDDLE_BITS + TOP_BITS)) - 1;
+
+    // live count of a segment that is being dropped
+    private static final int SEALED = -1;
+
+    private static final class Leaf {
+        final AtomicReferenceArray<ShadowObject> slots =
+                new AtomicReferenceArray<ShadowObject>(LEAF_SIZE);
+
+        // number of objects in the leaf or SEALED
+        final AtomicInteger live = new AtomicInteger(0);
+
+        // off-heap handles of spilled objects, zero if not spilled
+        // created on the first spill, updated with the leaf lock held
+        volatile LongBuffer spilled;
+    }
+
+    private static final class Middle {
+        final AtomicReferenceArray<Leaf> leaves =
+                new AtomicReferenceArray<Leaf>(MIDDLE_SIZE);
+
+        // number of leaves in the middle segment or SEALED
+        final AtomicInteger live = new AtomicInteger(0);
+    }
+
+    // objects of one session
+    private static final class Table {
+        // resolves the net reference layout and the classes without a thread
+        // local lookup of the session for every net reference
+        final Session session;
+
+        final AtomicReferenceArray<Middle> directory =
+                new AtomicReferenceArray<Middle>(TOP_SIZE);
+
+        // null if spilling is disabled
+        final ShadowSpillStore spillStore;
+
+        // plain shadow objects with their states on the heap - counted only
+        // when spilling
+        final AtomicLong heapObjects = new AtomicLong();
+
+        Table(Session session, ShadowSpillStore spillStore) {
+            this.session = session;
+            this.spillStore = spillStore;
+        }
+    }
+
+    private static final Session.Key<Table> tableKey = new Session.Key<Table>() {
+
+        @Override
+        protected Table create(Session session) {
+
+            Table table = new Table(session,
+                    ShadowSpillStore.open(session.getId()));
+
+            if (table.spillStore != null) {
+                new Spiller(table,
+                        Math.max(1, Long.getLong(PROP_SPILL_THRESHOLD,
+                                DEFAULT_SPILL_THRESHOLD)),
+                        Math.max(1, Long.getLong(PROP_SPILL_INTERVAL,
+                                DEFAULT_SPILL_INTERVAL))).start();
+            }
+
+            return table;
+        }
+
+        @Override
+        protected void close(Table table) {
+
+            if (table.spillStore != null) {
+                table.spillStore.close();
+            }
+        }
+    };
+
+    private static Table table() {
+        return Session.current().get(tableKey);
+    }
+
+    // ************* segmented array handling **********
+
+    private static int topIndex(long objID) {
+        return (int) (objID >>> (LEAF_BITS + MIDDLE_BITS));
+    }
+
+    private static int middleIndex(long objID) {
+        return (int) (objID >>> LEAF_BITS) & (MIDDLE_SIZE - 1);
+    }
+
+    private static int leafIndex(long objID) {
+        return (int) objID & (LEAF_SIZE - 1);
+    }
+
+    private static Middle getMiddle(Table table, long objID, boolean create) {
+
+        if (objID < 0 || objID > MAX_OBJECT_ID) {
+            throw new DiSLREServerFatalException("Invalid object id " + objID);
+        }
+
+        Middle middle = table.directory.get(topIndex(objID));
+
+        if (middle == null && create) {
+            table.directory.compareAndSet(topIndex(objID), null, new Middle());
+            middle = table.directory.get(topIndex(objID));
+        }
+
+        return middle;
+    }
+
+    // returns null if the leaf has to be looked up again (or if it does
+    // not exist and should not be created)
+    private static Leaf getLeaf(Table table, Middle middle, long objID,
+            boolean create) {
+
+        Leaf leaf = middle.leaves.get(middleIndex(objID));
+
+        if (leaf == null && create) {
+
+            if (!acquire(middle.live)) {
+                // help to drop the sealed middle segment
+                table.directory.compareAndSet(topIndex(objID), middle, null);
+                return null;
+            }
+
+            if (!middle.leaves.compareAndSet(middleIndex(objID), null, new Leaf())) {
+                // created by another thread
+                releaseMiddle(table, middle, objID);
+            }
+
+            leaf = middle.leaves.get(middleIndex(objID));
+        }
+
+        return leaf;
+    }
+
+    // returns false if the segment is being dropped
+    private static boolean acquire(AtomicInteger live) {
+
+        while (true) {
+            int count = live.get();
+
+            if (count == SEALED) {
+                return false;
+            }
+
+            if (live.compareAndSet(count, count + 1)) {
+                return true;
+            }
+        }
+    }
+
+    // returns true if the segment became empty and was sealed
+    private static boolean release(AtomicInteger live) {
+
+        return live.decrementAndGet() == 0 && live.compareAndSet(0, SEALED);
     }
 
+    private static void releaseMiddle(Table table, Middle middle, long objID) {
+
+        if (release(middle.live)) {
+            table.directory.compareAndSet(topIndex(objID), middle, null);
+        }
+    }
+
+    private static void dropLeaf(Table table, Middle middle, Leaf leaf,
+            long objID) {
+
+        // the middle segment loses the leaf only once
+        if (middle.leaves.compareAndSet(middleIndex(objID), leaf, null)) {
+            releaseMiddle(table, middle, objID);
+        }
+    }
+
+    private static void releaseLeaf(Table table, Middle middle, Leaf leaf,
+            long objID) {
+
+        if (release(leaf.live)) {
+            dropLeaf(table, middle, leaf, objID);
+        }
+    }
+
+    private static ShadowObject getSlot(Table table, long objID) {
+
+        Middle middle = getMiddle(table, objID, false);
+
+        if (middle == null) {
+            return null;
+        }
+
+        Leaf leaf = middle.leaves.get(middleIndex(objID));
+
+        if (leaf == null) {
+            return null;
+        }
+
+        return leaf.slots.get(leafIndex(objID));
+    }
+
+    // returns the already present object or null if newObj was stored
+    private static ShadowObject putSlotIfAbsent(Table table, long objID,
+            ShadowObject newObj) {
+
+        while (true) {
+            Middle middle = getMiddle(table, objID, true);
+            Leaf leaf = getLeaf(table, middle, objID, true);
+
+            if (leaf == null) {
+                // the middle segment is being dropped
+                continue;
+            }
+
+            if (!acquire(leaf.live)) {
+                // help to drop the sealed leaf and retry with a new one
+                dropLeaf(table, middle, leaf, objID);
+                continue;
+            }
+
+            while (true) {
+                if (leaf.slots.compareAndSet(leafIndex(objID), null, newObj)) {
+                    return null;
+                }
+
+                ShadowObject exist = leaf.slots.get(leafIndex(objID));
+
+                if (exist != null) {
+                    releaseLeaf(table, middle, leaf, objID);
+                    return exist;
+                }
+            }
+        }
+    }
+
+    private static boolean removeSlot(Table table, long objID,
+            ShadowObject obj) {
+
+        Middle middle = getMiddle(table, objID, false);
+
+        if (middle == null) {
+            return false;
+        }
+
+        Leaf leaf = middle.leaves.get(middleIndex(objID));
+
+        if (leaf == null) {
+            return false;
+        }
+
+        if (table.spillStore == null) {
+            if (!leaf.slots.compareAndSet(leafIndex(objID), obj, null)) {
+                return false;
+            }
+
+        } else {
+            // the spiller moves the states of the object under the leaf lock
+            synchronized (leaf) {
+                if (!leaf.slots.compareAndSet(leafIndex(objID), obj, null)) {
+                    return false;
+                }
+
+                if (!discardSpilled(table, leaf, objID, obj)
+                        && isSpillable(obj)) {
+                    table.heapObjects.decrementAndGet();
+                }
+            }
+        }
+
+        releaseLeaf(table, middle, leaf, objID);
+        return true;
+    }
+
+    // ************* spilling of cold shadow objects **********
+
+    // When spilling is enabled and there are more plain shadow objects with
+    // their states on the heap than the threshold, the spiller thread sweeps
+    // the table and moves the states of the objects that were not accessed
+    // through the table since its last sweep to the off-heap store. The
+    // shadow object itself stays in the table, so analyses holding it keep
+    // the same instance, and its leaf holds the handle of the record. The
+    // states are faulted back in on the next state access. Objects without
+    // state are not spilled.
+
+    private static final String PROP_SPILL_THRESHOLD = "dislreserver.spillThreshold";
+    private static final long DEFAULT_SPILL_THRESHOLD = 1000000;
+
+    private static final String PROP_SPILL_INTERVAL = "dislreserver.spillInterval";
+    private static final long DEFAULT_SPILL_INTERVAL = 1000;
+
+    private static boolean isSpillable(ShadowObject obj) {
+        // strings, threads and classes stay on the heap
+        return obj.getClass() == ShadowObject.class;
+    }
+
+    private static void spillObject(Table table, Leaf leaf, long objID,
+            ShadowObject obj) {
+
+        int index = leafIndex(objID);
+
+        synchronized (leaf) {
+            synchronized (obj) {
+
+                if (leaf.slots.get(index) != obj || obj.isSpilled()) {
+                    return;
+                }
+
+                Object[] states = obj.freezeStates();
+
+                if (!hasState(states)) {
+                    obj.thawStates(states);
+                    return;
+                }
+
+                long handle = table.spillStore.spill(obj.getNetRef(), states);
+
+                if (handle == 0) {
+                    // retry after another sweep
+                    obj.thawStates(states);
+                    obj.touched = true;
+                    return;
+                }
+
+                if (leaf.spilled == null) {
+                    leaf.spilled = ByteBuffer.allocateDirect(
+                            LEAF_SIZE * Long.SIZE / Byte.SIZE).asLongBuffer();
+                }
+
+                leaf.spilled.put(index, handle);
+                obj.markSpilled();
+
+                table.heapObjects.decrementAndGet();
+            }
+        }
+    }
+
+    private static boolean hasState(Object[] states) {
+
+        for (Object state : states) {
+            if (state != null) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // restores the spilled states of a shadow object in the table
+    static void faultIn(ShadowObject obj) {
+
+        Table table = table();
+        long objID = obj.getId();
+
+        Middle middle = getMiddle(table, objID, false);
+        Leaf leaf = (middle != null) ? middle.leaves.get(middleIndex(objID)) : null;
+
+        if (leaf == null) {
+            // freed in the meantime - the states were discarded
+            return;
+        }
+
+        int index = leafIndex(objID);
+
+        synchronized (leaf) {
+            synchronized (obj) {
+
+                if (!obj.isSpilled()) {
+                    // faulted in by another thread or freed
+                    return;
+                }
+
+                long handle = (leaf.spilled != null) ? leaf.spilled.get(index) : 0;
+
+                if (handle == 0) {
+                    throw new DiSLREServerFatalException(
+                            "Missing spilled states of shadow object " + objID);
+                }
+
+                obj.restoreStates(table.spillStore.restore(handle, obj.getNetRef()));
+                obj.touched = true;
+
+                leaf.spilled.put(index, 0);
+                table.spillStore.release(handle);
+            }
+        }
+
+        table.heapObjects.incrementAndGet();
+    }
+
+    // returns false if the object is not spilled - called with the leaf lock
+    private static boolean discardSpilled(Table table, Leaf leaf, long objID,
+            ShadowObject obj) {
+
+        synchronized (obj) {
+
+            if (!obj.isSpilled()) {
+                return false;
+            }
+
+            long handle = leaf.spilled.get(leafIndex(objID));
+            leaf.spilled.put(leafIndex(objID), 0);
+
+            table.spillStore.release(handle);
+            obj.discardStates();
+            return true;
+        }
+    }
+
+    // sweeps the table in a clock-like fashion
+    private static final class Spiller extends Thread {
+
+        private final Table table;
+        private final long threshold;
+        private final long interval;
+
+        // last visited object id
+        private long cursor = 0;
+
+        Spiller(Table table, long threshold, long interval) {
+            super("DiSL-RE shadow object spiller");
+            setDaemon(true);
+
+            this.table = table;
+            this.threshold = threshold;
+            this.interval = interval;
+        }
+
+        @Override
+        public void run() {
+
+            try {
+                while (!table.spillStore.isClosed()) {
+                    Thread.sleep(interval);
+
+                    if (table.heapObjects.get() > threshold) {
+                        sweep(threshold - threshold / 10);
+                    }
+                }
+
+            } catch (InterruptedException e) {
+                // terminate
+            }
+        }
+
+        private void sweep(long target) {
+
+            // the first lap may only clear the access marks
+            int laps = 0;
+
+            while (table.heapObjects.get() > target && laps < 2) {
+
+                if (++cursor > MAX_OBJECT_ID) {
+                    cursor = 0;
+                    ++laps;
+                    continue;
+                }
+
+                Middle middle = table.directory.get(topIndex(cursor));
+
+                if (middle == null) {
+                    // skip whole middle segment
+                    cursor = ((long) topIndex(cursor) + 1 << (LEAF_BITS + MIDDLE_BITS)) - 1;
+                    continue;
+                }
+
+                Leaf leaf = middle.leaves.get(middleIndex(cursor));
+
+                if (leaf == null) {
+                    // skip whole leaf
+                    cursor = (cursor | (LEAF_SIZE - 1));
+                    continue;
+                }
+
+                ShadowObject obj = leaf.slots.get(leafIndex(cursor));
+
+                if (obj == null || !isSpillable(obj) || obj.isSpilled()) {
+                    continue;
+                }
+
+                if (obj.touched) {
+                    obj.touched = false;
+                } else {
+                    spillObject(table, leaf, cursor, obj);
+                }
+            }
+        }
+    }
+
+    // ************* shadow object table **********
+
     public static void register(ShadowObject newObj, boolean debug) {
 
         if (newObj == null) {
@@ -23,7 +526,7 @@ public class ShadowObjectTable {
         }
 
         long objID = newObj.getId();
-        ShadowObject exist = shadowObjects.putIfAbsent(objID, newObj);
+        ShadowObject exist = putSlotIfAbsent(table(), objID, newObj);
 
         if (exist != null) {
 
@@ -71,32 +574,30 @@ public class ShadowObjectTable {
         }
     }
 
-    private static boolean isAssignableFromThread(ShadowClass klass) {
-
-        while (! "java.lang.Object".equals(klass.getName())) {
-
-            if ("java.lang.Thread".equals(klass.getName())) {
-                return true;
-            }
-
-            klass = klass.getSuperclass();
-        }
+    public static ShadowObject get(long net_ref) {
 
-        return false;
+        return get(table(), net_ref);
     }
 
-    public static ShadowObject get(long net_ref) {
+    private static ShadowObject get(Table table, long net_ref) {
 
-        long objID = NetReferenceHelper.get_object_id(net_ref);
+        // resolved once for all uses of the net reference
+        NetReferenceHelper.Layout layout =
+                NetReferenceHelper.layout(table.session);
+        long objID = layout.get_object_id(net_ref);
 
         if (objID == 0) {
             // reserved ID for null
             return null;
         }
 
-        ShadowObject retVal = shadowObjects.get(objID);
+        ShadowObject retVal = getSlot(table, objID);
 
         if (retVal != null) {
+            if (table.spillStore != null && !retVal.touched) {
+                retVal.touched = true;
+            }
+
             return retVal;
         }
 
@@ -104,33 +605,120 @@ public class ShadowObjectTable {
             throw new DiSLREServerFatalException("Unknown class instance");
         } else {
             // Only common shadow object will be generated here
-            ShadowClass klass = ShadowClassTable.get(NetReferenceHelper
-                    .get_class_id(net_ref));
+            ShadowClass klass = ShadowClassTable.get(table.session,
+                    layout.get_class_id(net_ref));
             ShadowObject tmp = null;
 
-            if ("java.lang.String".equals(klass.getName())) {
-                tmp = new ShadowString(net_ref, null, klass);
-            } else if (isAssignableFromThread(klass)) {
-                tmp = new ShadowThread(net_ref, null, false, klass);
-            } else {
-                tmp = new ShadowObject(net_ref, klass);
+            switch (klass.getInstanceKind()) {
+            case ShadowClass.INSTANCE_KIND_STRING:
+                tmp = new ShadowString(net_ref, objID, klass);
+                break;
+            case ShadowClass.INSTANCE_KIND_THREAD:
+                tmp = new ShadowThread(net_ref, objID, klass);
+                break;
+            default:
+                tmp = new ShadowObject(net_ref, objID, klass);
+                break;
             }
 
-            if ((retVal = shadowObjects.putIfAbsent(objID, tmp)) == null) {
+            if ((retVal = putSlotIfAbsent(table, objID, tmp)) == null) {
                 retVal = tmp;
+
+                if (table.spillStore != null && isSpillable(tmp)) {
+                    table.heapObjects.incrementAndGet();
+                }
             }
 
             return retVal;
         }
     }
 
+    /**
+     * Returns the shadow object of the net reference if it is known, or
+     * null. Unlike {@link #get(long)}, no shadow object is created.
+     */
+    public static ShadowObject lookup(long net_ref) {
+
+        Table table = table();
+        long objID = NetReferenceHelper.layout(table.session)
+                .get_object_id(net_ref);
+
+        if (objID == 0) {
+            // reserved ID for null
+            return null;
+        }
+
+        return getSlot(table, objID);
+    }
+
     public static void freeShadowObject(ShadowObject obj) {
-        shadowObjects.remove(obj.getId());
+        removeSlot(table(), obj.getId(), obj);
         ShadowClassTable.freeShadowObject(obj);
     }
 
     //TODO: find a more elegant way to allow users to traverse the shadow object table
     public static Iterator<Entry<Long, ShadowObject>> getIterator() {
-        return shadowObjects.entrySet().iterator();
+        return new ShadowObjectIterator(table());
+    }
+
+    // iterates over all segments, entries are created on the fly
+    private static final class ShadowObjectIterator implements
+            Iterator<Entry<Long, ShadowObject>> {
+
+        private final Table table;
+
+        private long nextID = 0;
+        private ShadowObject next = null;
+
+        ShadowObjectIterator(Table table) {
+            this.table = table;
+            advance();
+        }
+
+        private void advance() {
+
+            next = null;
+
+            while (next == null && ++nextID <= MAX_OBJECT_ID) {
+
+                Middle middle = table.directory.get(topIndex(nextID));
+
+                if (middle == null) {
+                    // skip whole middle segment
+                    nextID = ((long) topIndex(nextID) + 1 << (LEAF_BITS + MIDDLE_BITS)) - 1;
+                    continue;
+                }
+
+                Leaf leaf = middle.leaves.get(middleIndex(nextID));
+
+                if (leaf == null) {
+                    // skip whole leaf
+                    nextID = (nextID | (LEAF_SIZE - 1));
+                    continue;
+                }
+
+                next = leaf.slots.get(leafIndex(nextID));
+            }
+        }
+
+        public boolean hasNext() {
+            return next != null;
+        }
+
+        public Entry<Long, ShadowObject> next() {
+
+            if (next == null) {
+                throw new NoSuchElementException();
+            }
+
+            Entry<Long, ShadowObject> result =
+                    new SimpleImmutableEntry<Long, ShadowObject>(nextID, next);
+            advance();
+            return result;
+        }
+
+        public void remove() {
+            throw new UnsupportedOperationException();
+        }
     }
 }
@@ -0,0 +1,53 @@
+package ch.usi.dag.dislreserver.shadow;
+
+/**
+ * Unresolved reference to a shadow object. An analysis method declaring a
+ * ShadowReference argument receives the net reference without any lookup in
+ * the shadow object table - the shadow object is looked up (and possibly
+ * created) only when the reference is resolved.
+ * <p>
+ * The reference should be resolved during the analysis method invocation.
+ * Once the object free event of the object is processed, resolving the
+ * reference creates a new shadow object.
+ */
+public final class ShadowReference {
+
+    private final long netRef;
+
+    public ShadowReference(final long netRef) {
+        this.netRef = netRef;
+    }
+
+    public long getNetRef() {
+        return netRef;
+    }
+
+    public long getId() {
+        return NetReferenceHelper.get_object_id(netRef);
+    }
+
+    public boolean isNull() {
+        return getId() == 0;
+    }
+
+    public ShadowObject resolve() {
+        return ShadowObjectTable.get(netRef);
+    }
+
+    // only object id considered - same as ShadowObject
+    @Override
+    public int hashCode() {
+        final long shadowId = getId();
+        return 31 + (int) (shadowId ^ (shadowId >>> 32));
+    }
+
+    @Override
+    public boolean equals(Object obj) {
+        if (obj instanceof ShadowReference) {
+            return getId() == ((ShadowReference) obj).getId();
+        }
+
+        return false;
+    }
+
+}
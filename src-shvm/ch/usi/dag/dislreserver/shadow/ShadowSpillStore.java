@@ -0,0 +1,374 @@
+package ch.usi.dag.dislreserver.shadow;
+
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.DataInputStream;
+import java.io.DataOutputStream;
+import java.io.File;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.lang.reflect.Method;
+import java.nio.ByteBuffer;
+import java.nio.MappedByteBuffer;
+import java.nio.channels.FileChannel;
+import java.util.ArrayDeque;
+import java.util.ArrayList;
+import java.util.Deque;
+import java.util.Iterator;
+import java.util.List;
+
+import ch.usi.dag.dislreserver.DiSLREServerFatalException;
+
+
+/**
+ * Off-heap store of spilled shadow object states.
+ * <p>
+ * Each record holds the net reference of a shadow object and its states
+ * encoded by the codecs of their slots. The records are kept in a file
+ * mapped into memory in fixed-size segments. A record is identified by a
+ * handle, which is its position in the file plus one, so that zero never
+ * identifies a record.
+ * <p>
+ * Record sizes are rounded up to a power of two. The space of a released
+ * record is kept in a free list of its size and reused by the next record
+ * of that size. A segment whose records were all released is unmapped, and
+ * it is mapped again for new records before the file grows.
+ */
+final class ShadowSpillStore {
+
+    private static final String PROP_SPILL_FILE = "dislreserver.spillFile";
+
+    private static final int SEGMENT_BITS = 26;
+
+    private static final int MIN_RECORD_BITS = 5;
+
+    private static final int RECORD_HEADER_SIZE = Integer.SIZE / Byte.SIZE;
+
+    //
+
+    private static final class Segment {
+        // null while the segment is not used
+        MappedByteBuffer buffer;
+
+        // records not yet released
+        int records;
+    }
+
+    //
+
+    private final FileChannel channel;
+
+    private final int segmentBits;
+    private final int segmentSize;
+
+    // guarded by "this"
+    private final List <Segment> segments = new ArrayList <Segment> ();
+
+    // indices of unmapped segments
+    private final Deque <Integer> freeSegments = new ArrayDeque <Integer> ();
+
+    // positions of released records, one list per record size
+    private final List <Deque <Long>> freeRecords = new ArrayList <Deque <Long>> ();
+
+    // segment receiving new records, -1 if none
+    private int appendSegment = -1;
+    private int appendOffset;
+
+    private volatile boolean closed;
+
+    //
+
+    private ShadowSpillStore (final FileChannel channel, final int segmentBits) {
+        this.channel = channel;
+        this.segmentBits = segmentBits;
+        this.segmentSize = 1 << segmentBits;
+
+        for (int bits = 0; bits <= segmentBits; ++bits) {
+            freeRecords.add (new ArrayDeque <Long> ());
+        }
+    }
+
+
+    /**
+     * Opens the store of a session in the file given by the spill file
+     * property. Sessions other than the default one use the session id as
+     * a file name suffix.
+     *
+     * @return the store, or {@code null} if spilling is disabled
+     */
+    static ShadowSpillStore open (final int sessionId) {
+        String path = System.getProperty (PROP_SPILL_FILE, "").trim ();
+        if (path.isEmpty ()) {
+            return null;
+        }
+
+        if (sessionId != 0) {
+            path = path + "." + sessionId;
+        }
+
+        return open (new File (path), SEGMENT_BITS);
+    }
+
+
+    /**
+     * Opens a store in the given file, mapped in segments of the given size.
+     */
+    static ShadowSpillStore open (final File file, final int segmentBits) {
+        try {
+            file.deleteOnExit ();
+
+            final RandomAccessFile raf = new RandomAccessFile (file, "rw");
+            raf.setLength (0);
+            return new ShadowSpillStore (raf.getChannel (), segmentBits);
+
+        } catch (final IOException ioe) {
+            throw new DiSLREServerFatalException (
+                "Failed to open shadow object spill file " + file, ioe
+            );
+        }
+    }
+
+    /**
+     * Closes the store. The segments in use stay mapped until they are
+     * collected.
+     */
+    synchronized void close () {
+        closed = true;
+
+        try {
+            channel.close ();
+
+        } catch (final IOException ioe) {
+            // nothing to do, the file is deleted on exit
+        }
+    }
+
+
+    boolean isClosed () {
+        return closed;
+    }
+
+
+    /**
+     * Returns the number of segments currently mapped.
+     */
+    synchronized int mappedSegments () {
+        int result = 0;
+        for (final Segment segment : segments) {
+            result += (segment.buffer != null) ? 1 : 0;
+        }
+
+        return result;
+    }
+
+    //
+
+    /**
+     * Stores the states of a shadow object.
+     *
+     * @return the handle of the record, or zero if some of the states cannot
+     *         be spilled
+     */
+    long spill (final long netRef, final Object [] states) {
+        final ByteArrayOutputStream bytes = new ByteArrayOutputStream ();
+        final DataOutputStream out = new DataOutputStream (bytes);
+
+        try {
+            out.writeLong (netRef);
+
+            for (int index = 0; index < states.length; ++index) {
+                if (states [index] == null) {
+                    continue;
+                }
+
+                final ShadowStateSlot <?> slot = ShadowStateSlot.get (index);
+                if (!slot.isSpillable ()) {
+                    return 0;
+                }
+
+                out.writeInt (index);
+                slot.encode (states [index], out);
+            }
+
+            out.close ();
+            return __write (bytes.toByteArray ());
+
+        } catch (final IOException ioe) {
+            throw new DiSLREServerFatalException (
+                "Failed to spill shadow object " + netRef, ioe
+            );
+        }
+    }
+
+
+    /**
+     * Reads the states of a shadow object from a spilled record. The record
+     * stays in the store until it is released.
+     */
+    Object [] restore (final long handle, final long netRef) {
+        final DataInputStream in = new DataInputStream (
+            new ByteArrayInputStream (__read (handle))
+        );
+
+        try {
+            if (in.readLong () != netRef) {
+                throw new DiSLREServerFatalException (
+                    "Spilled record does not belong to shadow object " + netRef
+                );
+            }
+
+            final Object [] states = new Object [ShadowStateSlot.count ()];
+
+            while (in.available () > 0) {
+                final int index = in.readInt ();
+                states [index] = ShadowStateSlot.get (index).decode (in);
+            }
+
+            return states;
+
+        } catch (final IOException ioe) {
+            throw new DiSLREServerFatalException (
+                "Failed to restore spilled shadow object", ioe
+            );
+        }
+    }
+
+
+    /**
+     * Releases a record for reuse.
+     */
+    synchronized void release (final long handle) {
+        final long position = handle - 1;
+        final int index = (int) (position >>> segmentBits);
+        final Segment segment = segments.get (index);
+
+        final int length = segment.buffer.getInt ((int) (position & (segmentSize - 1)));
+        freeRecords.get (__sizeBits (RECORD_HEADER_SIZE + length)).add (position);
+
+        if (--segment.records == 0 && index != appendSegment) {
+            __unmapSegment (index);
+        }
+    }
+
+    //
+
+    private synchronized long __write (final byte [] record) throws IOException {
+        final int size = RECORD_HEADER_SIZE + record.length;
+        if (size > segmentSize || closed) {
+            return 0;
+        }
+
+        final int sizeBits = __sizeBits (size);
+
+        final Long free = freeRecords.get (sizeBits).poll ();
+        final long position = (free != null) ? free : __append (1 << sizeBits);
+
+        final Segment segment = segments.get ((int) (position >>> segmentBits));
+        segment.records++;
+
+        final ByteBuffer buffer = segment.buffer.duplicate ();
+        buffer.position ((int) (position & (segmentSize - 1)));
+        buffer.putInt (record.length);
+        buffer.put (record);
+
+        return position + 1;
+    }
+
+
+    private synchronized byte [] __read (final long handle) {
+        final long position = handle - 1;
+
+        final ByteBuffer buffer = segments.get (
+            (int) (position >>> segmentBits)
+        ).buffer.duplicate ();
+        buffer.position ((int) (position & (segmentSize - 1)));
+
+        final byte [] result = new byte [buffer.getInt ()];
+        buffer.get (result);
+        return result;
+    }
+
+
+    private static int __sizeBits (final int size) {
+        return Math.max (
+            MIN_RECORD_BITS, Integer.SIZE - Integer.numberOfLeadingZeros (size - 1)
+        );
+    }
+
+
+    // returns the position of the space, records never cross segments
+    private long __append (final int size) throws IOException {
+        if (appendSegment < 0 || appendOffset + size > segmentSize) {
+            final int previous = appendSegment;
+
+            appendSegment = __mapSegment ();
+            appendOffset = 0;
+
+            if (previous >= 0 && segments.get (previous).records == 0) {
+                __unmapSegment (previous);
+            }
+        }
+
+        final long position = ((long) appendSegment << segmentBits) + appendOffset;
+        appendOffset += size;
+        return position;
+    }
+
+
+    private int __mapSegment () throws IOException {
+        final Integer free = freeSegments.poll ();
+        final int index = (free != null) ? free : segments.size ();
+
+        if (free == null) {
+            segments.add (new Segment ());
+        }
+
+        segments.get (index).buffer = channel.map (
+            FileChannel.MapMode.READ_WRITE,
+            (long) index << segmentBits, segmentSize
+        );
+
+        return index;
+    }
+
+
+    private void __unmapSegment (final int index) {
+        // the released records of the segment are not reused anymore
+        for (final Deque <Long> positions : freeRecords) {
+            final Iterator <Long> iterator = positions.iterator ();
+            while (iterator.hasNext ()) {
+                if ((iterator.next () >>> segmentBits) == index) {
+                    iterator.remove ();
+                }
+            }
+        }
+
+        final Segment segment = segments.get (index);
+        __unmap (segment.buffer);
+        segment.buffer = null;
+
+        freeSegments.add (index);
+    }
+
+
+    private static void __unmap (final MappedByteBuffer buffer) {
+        //
+        // There is no public API to unmap a buffer - use the cleaner of the
+        // direct buffer if available, otherwise the mapping is released when
+        // the buffer is collected. The buffer is not accessed afterwards.
+        //
+        try {
+            final Method cleanerMethod = buffer.getClass ().getMethod ("cleaner");
+            cleanerMethod.setAccessible (true);
+
+            final Object cleaner = cleanerMethod.invoke (buffer);
+            if (cleaner != null) {
+                cleaner.getClass ().getMethod ("clean").invoke (cleaner);
+            }
+
+        } catch (final Exception e) {
+            // left to the garbage collector
+        }
+    }
+
+}
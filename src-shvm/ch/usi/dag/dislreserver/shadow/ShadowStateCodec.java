@@ -0,0 +1,21 @@
+package ch.usi.dag.dislreserver.shadow;
+
+import java.io.DataInput;
+import java.io.DataOutput;
+import java.io.IOException;
+
+
+/**
+ * Serializes the analysis state held in a {@link ShadowStateSlot}.
+ * <p>
+ * Shadow objects whose state can be serialized may be spilled out of the
+ * heap when they are not used for a while, and faulted back in when they are
+ * used again. A spilled state is decoded into a new state instance.
+ */
+public interface ShadowStateCodec <T> {
+
+    void encode (T state, DataOutput out) throws IOException;
+
+    T decode (DataInput in) throws IOException;
+
+}
@@ -0,0 +1,106 @@
+package ch.usi.dag.dislreserver.shadow;
+
+import java.io.DataInput;
+import java.io.DataOutput;
+import java.io.IOException;
+import java.util.List;
+import java.util.concurrent.CopyOnWriteArrayList;
+
+
+/**
+ * Typed slot for analysis state kept in shadow objects.
+ * <p>
+ * An analysis allocates its slots once, typically when it is created during
+ * registration, and then uses them to access its state in any shadow object.
+ * Each slot is updated independently and without locking, so analyses do
+ * not contend for the state of a shadow object and need no maps keyed by
+ * analysis.
+ * <p>
+ * Only slots allocated with a {@link ShadowStateCodec} allow the shadow
+ * objects holding state in them to be spilled out of the heap.
+ */
+public final class ShadowStateSlot <T> {
+
+    // allocated slots indexed by slot index
+    private static final List <ShadowStateSlot <?>> __slots =
+        new CopyOnWriteArrayList <ShadowStateSlot <?>> ();
+
+    /**
+     * Slot used by the untyped state accessors of {@link ShadowObject}.
+     */
+    static final ShadowStateSlot <Object> DEFAULT = allocate (Object.class);
+
+    //
+
+    final int index;
+    private final Class <T> type;
+    private final ShadowStateCodec <T> codec;
+
+    //
+
+    private ShadowStateSlot (
+        final int index, final Class <T> type, final ShadowStateCodec <T> codec
+    ) {
+        this.index = index;
+        this.type = type;
+        this.codec = codec;
+    }
+
+
+    /**
+     * Allocates a new slot holding values of the given type.
+     */
+    public static <T> ShadowStateSlot <T> allocate (final Class <T> type) {
+        return allocate (type, null);
+    }
+
+
+    /**
+     * Allocates a new slot holding values of the given type, serialized by
+     * the given codec when a shadow object is spilled.
+     */
+    public static synchronized <T> ShadowStateSlot <T> allocate (
+        final Class <T> type, final ShadowStateCodec <T> codec
+    ) {
+        final ShadowStateSlot <T> result = new ShadowStateSlot <T> (
+            __slots.size (), type, codec
+        );
+
+        __slots.add (result);
+        return result;
+    }
+
+
+    /**
+     * Returns the number of allocated slots.
+     */
+    static int count () {
+        return __slots.size ();
+    }
+
+
+    static ShadowStateSlot <?> get (final int index) {
+        return __slots.get (index);
+    }
+
+
+    T cast (final Object value) {
+        return type.cast (value);
+    }
+
+
+    boolean isSpillable () {
+        return codec != null;
+    }
+
+
+    void encode (final Object state, final DataOutput out) throws IOException {
+        codec.encode (type.cast (state), out);
+    }
+
+
+    T decode (final DataInput in) throws IOException {
+        return codec.decode (in);
+    }
+
+}
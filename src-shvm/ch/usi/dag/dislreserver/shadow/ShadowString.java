@@ -11,6 +11,10 @@ public class ShadowString extends ShadowObject {
         this.value = value;
     }
 
+    ShadowString(final long net_ref, final long shadowId, final ShadowClass klass) {
+        super(net_ref, shadowId, klass);
+    }
+
     // TODO warn user that it will return null when the ShadowString is not yet
     // sent.
     @Override
@@ -15,6 +15,10 @@ public class ShadowThread extends ShadowObject {
         this.isDaemon = isDaemon;
     }
 
+    ShadowThread(final long net_ref, final long shadowId, final ShadowClass klass) {
+        super(net_ref, shadowId, klass);
+    }
+
     // TODO warn user that it will return null when the ShadowThread is not yet
     // sent.
     public String getName() {
@@ -0,0 +1,80 @@
+package ch.usi.dag.dislreserver.stats;
+
+import java.util.concurrent.atomic.AtomicLong;
+import java.util.concurrent.atomic.AtomicLongArray;
+
+
+/**
+ * Histogram of latencies in nanoseconds with power-of-two buckets. Values
+ * can be recorded concurrently, percentiles are reported as the upper bound
+ * of the bucket they fall into.
+ */
+final class LatencyHistogram {
+
+    private static final int BUCKET_COUNT = Long.SIZE;
+
+    //
+
+    // bucket i holds values below 2^i and not below 2^(i-1)
+    private final AtomicLongArray buckets = new AtomicLongArray (BUCKET_COUNT);
+
+    private final AtomicLong count = new AtomicLong ();
+    private final AtomicLong total = new AtomicLong ();
+    private final AtomicLong max = new AtomicLong ();
+
+    //
+
+    void record (final long nanos) {
+        final long value = Math.max (0, nanos);
+
+        buckets.incrementAndGet (Long.SIZE - Long.numberOfLeadingZeros (value));
+        count.incrementAndGet ();
+        total.addAndGet (value);
+
+        long current = max.get ();
+        while (value > current && !max.compareAndSet (current, value)) {
+            current = max.get ();
+        }
+    }
+
+
+    long getCount () {
+        return count.get ();
+    }
+
+
+    long getMean () {
+        final long samples = count.get ();
+        return (samples != 0) ? total.get () / samples : 0;
+    }
+
+
+    long getMax () {
+        return max.get ();
+    }
+
+
+    /**
+     * Returns the upper bound of the bucket holding the given percentile.
+     */
+    long getPercentile (final double percentile) {
+        final long samples = count.get ();
+        if (samples == 0) {
+            return 0;
+        }
+
+        final long rank = (long) Math.ceil (samples * percentile / 100);
+
+        long seen = 0;
+        for (int i = 0; i < BUCKET_COUNT; ++i) {
+            seen += buckets.get (i);
+            if (seen >= rank) {
+                final long bound = (i < BUCKET_COUNT - 1) ? (1L << i) : Long.MAX_VALUE;
+                return Math.min (bound, max.get ());
+            }
+        }
+
+        return max.get ();
+    }
+
+}
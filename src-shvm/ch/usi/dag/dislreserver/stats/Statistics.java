@@ -0,0 +1,421 @@
+package ch.usi.dag.dislreserver.stats;
+
+import java.lang.management.ManagementFactory;
+import java.lang.reflect.Method;
+import java.util.Map;
+import java.util.Map.Entry;
+import java.util.Timer;
+import java.util.TimerTask;
+import java.util.TreeMap;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ConcurrentMap;
+import java.util.concurrent.atomic.AtomicLong;
+import java.util.concurrent.atomic.AtomicLongArray;
+
+import javax.management.JMException;
+import javax.management.MBeanServer;
+import javax.management.ObjectName;
+
+import ch.usi.dag.dislreserver.Session;
+import ch.usi.dag.dislreserver.reqdispatch.FlowControl;
+import ch.usi.dag.dislreserver.reqdispatch.RequestDispatcher;
+import ch.usi.dag.dislreserver.util.Logging;
+import ch.usi.dag.util.logging.Logger;
+
+
+/**
+ * Runtime statistics of a session: received requests, analysis method
+ * invocations, executor queues and object free latency.
+ * <p>
+ * The statistics are collected only if the {@code dislreserver.stats}
+ * property is set. The property is read once into a constant, so that the
+ * JIT compiler removes the collecting code when it is not set. Components
+ * therefore guard every update with {@link #ENABLED}. The statistics of
+ * each session are registered as an MXBean and logged periodically and when
+ * the connection is closed.
+ */
+public final class Statistics implements StatisticsMXBean {
+
+    private static final Logger __log = Logging.getPackageInstance ();
+
+    //
+
+    private static final String PROP_STATS = "dislreserver.stats";
+
+    /**
+     * Whether the statistics are collected.
+     */
+    public static final boolean ENABLED = Boolean.getBoolean (PROP_STATS);
+
+    private static final String PROP_STATS_INTERVAL = "dislreserver.statsInterval";
+    private static final long DEFAULT_STATS_INTERVAL = 10000;
+
+    private static final String OBJECT_NAME = "ch.usi.dag.dislreserver:type=Statistics,session=";
+
+    private static final int REQUEST_ID_COUNT = Byte.MAX_VALUE + 1;
+
+    // logs the statistics of all sessions
+    private static final Timer __timer = ENABLED ? new Timer ("DiSL-RE statistics", true) : null;
+
+    //
+
+    /**
+     * Samples the task queues of analysis executors.
+     */
+    public interface ExecutorProbe {
+
+        /**
+         * Puts the number of pending tasks and the number of epochs the
+         * oldest pending task lags behind for each live executor into the
+         * maps, keyed by the ordering id of the executor.
+         */
+        void sample (Map <Long, Long> queueDepths, Map <Long, Long> epochLags);
+    }
+
+    //
+
+    private static final class MethodStatistics {
+        final String name;
+        final AtomicLong invocations = new AtomicLong ();
+        final AtomicLong nanos = new AtomicLong ();
+
+        MethodStatistics (final short methodId, final Method method) {
+            this.name = String.format (
+                "%d:%s.%s", methodId,
+                method.getDeclaringClass ().getName (), method.getName ()
+            );
+        }
+    }
+
+    //
+
+    private static final Session.Key <Statistics> __statisticsKey = new Session.Key <Statistics> () {
+        @Override
+        protected Statistics create (final Session session) {
+            final Statistics result = new Statistics (session.getId ());
+            result.__start ();
+            return result;
+        }
+
+        @Override
+        protected void close (final Statistics statistics) {
+            statistics.__stop ();
+        }
+    };
+
+    //
+
+    private final int sessionId;
+
+    private final AtomicLongArray requestCounts = new AtomicLongArray (REQUEST_ID_COUNT);
+    private final AtomicLongArray requestBytes = new AtomicLongArray (REQUEST_ID_COUNT);
+
+    // keyed by the analysis method - the invocations do not know the id
+    private final ConcurrentMap <Method, MethodStatistics> methods =
+        new ConcurrentHashMap <Method, MethodStatistics> ();
+
+    private final AtomicLong freedObjects = new AtomicLong ();
+    private final LatencyHistogram objectFreeLatency = new LatencyHistogram ();
+
+    private volatile FlowControl flowControl;
+    private volatile ExecutorProbe executorProbe;
+
+    private TimerTask logTask;
+
+    //
+
+    private Statistics (final int sessionId) {
+        this.sessionId = sessionId;
+    }
+
+
+    /**
+     * Returns the statistics of the current session, or {@code null} if the
+     * statistics are not collected.
+     */
+    public static Statistics current () {
+        return ENABLED ? Session.current ().get (__statisticsKey) : null;
+    }
+
+    //
+
+    public void setFlowControl (final FlowControl flowControl) {
+        this.flowControl = flowControl;
+    }
+
+
+    public void setExecutorProbe (final ExecutorProbe executorProbe) {
+        this.executorProbe = executorProbe;
+    }
+
+    //
+
+    /**
+     * Accounts a request received from the agent.
+     */
+    public void requestReceived (final byte requestId, final int bytes) {
+        requestCounts.incrementAndGet (requestId);
+        requestBytes.addAndGet (requestId, bytes);
+    }
+
+
+    public void analysisMethodRegistered (final short methodId, final Method method) {
+        methods.putIfAbsent (method, new MethodStatistics (methodId, method));
+    }
+
+
+    /**
+     * Accounts an invocation of an analysis method. Can be called
+     * concurrently.
+     */
+    public void analysisInvoked (final Method method, final long nanos) {
+        final MethodStatistics stats = methods.get (method);
+        if (stats != null) {
+            stats.invocations.incrementAndGet ();
+            stats.nanos.addAndGet (nanos);
+        }
+    }
+
+
+    /**
+     * Accounts a processed batch of object free events, the latency is
+     * measured from the arrival of the batch.
+     */
+    public void objectsFreed (final int count, final long latencyNanos) {
+        freedObjects.addAndGet (count);
+        objectFreeLatency.record (latencyNanos);
+    }
+
+    // StatisticsMXBean
+
+    @Override
+    public long getReceivedBytes () {
+        return __sum (requestBytes);
+    }
+
+
+    @Override
+    public Map <String, Long> getRequestCounts () {
+        return __requestMap (requestCounts);
+    }
+
+
+    @Override
+    public Map <String, Long> getRequestBytes () {
+        return __requestMap (requestBytes);
+    }
+
+
+    private static Map <String, Long> __requestMap (final AtomicLongArray values) {
+        final Map <String, Long> result = new TreeMap <String, Long> ();
+        for (int id = 0; id < REQUEST_ID_COUNT; ++id) {
+            final long value = values.get (id);
+            if (value != 0) {
+                result.put (RequestDispatcher.getRequestName ((byte) id), value);
+            }
+        }
+
+        return result;
+    }
+
+
+    @Override
+    public Map <String, Long> getAnalysisInvocations () {
+        final Map <String, Long> result = new TreeMap <String, Long> ();
+        for (final MethodStatistics stats : methods.values ()) {
+            result.put (stats.name, stats.invocations.get ());
+        }
+
+        return result;
+    }
+
+
+    @Override
+    public Map <String, Long> getAnalysisTimes () {
+        final Map <String, Long> result = new TreeMap <String, Long> ();
+        for (final MethodStatistics stats : methods.values ()) {
+            result.put (stats.name, stats.nanos.get ());
+        }
+
+        return result;
+    }
+
+
+    @Override
+    public int getQueuedBuffers () {
+        final FlowControl fc = flowControl;
+        return (fc != null) ? fc.getQueuedBuffers () : 0;
+    }
+
+
+    @Override
+    public Map <Long, Long> getExecutorQueueDepths () {
+        final Map <Long, Long> result = new TreeMap <Long, Long> ();
+        __sampleExecutors (result, new TreeMap <Long, Long> ());
+        return result;
+    }
+
+
+    @Override
+    public Map <Long, Long> getExecutorEpochLags () {
+        final Map <Long, Long> result = new TreeMap <Long, Long> ();
+        __sampleExecutors (new TreeMap <Long, Long> (), result);
+        return result;
+    }
+
+
+    private void __sampleExecutors (
+        final Map <Long, Long> queueDepths, final Map <Long, Long> epochLags
+    ) {
+        final ExecutorProbe probe = executorProbe;
+        if (probe != null) {
+            probe.sample (queueDepths, epochLags);
+        }
+    }
+
+
+    @Override
+    public long getObjectFreeBatches () {
+        return objectFreeLatency.getCount ();
+    }
+
+
+    @Override
+    public long getFreedObjects () {
+        return freedObjects.get ();
+    }
+
+
+    @Override
+    public long getObjectFreeLatencyMean () {
+        return objectFreeLatency.getMean ();
+    }
+
+
+    @Override
+    public long getObjectFreeLatencyP99 () {
+        return objectFreeLatency.getPercentile (99);
+    }
+
+
+    @Override
+    public long getObjectFreeLatencyMax () {
+        return objectFreeLatency.getMax ();
+    }
+
+    //
+
+    private void __start () {
+        try {
+            final MBeanServer server = ManagementFactory.getPlatformMBeanServer ();
+            server.registerMBean (this, new ObjectName (OBJECT_NAME + sessionId));
+
+        } catch (final JMException jme) {
+            __log.warn ("failed to register statistics MXBean: %s", jme.getMessage ());
+        }
+
+        final long interval = Long.getLong (PROP_STATS_INTERVAL, DEFAULT_STATS_INTERVAL);
+        if (interval > 0) {
+            logTask = new TimerTask () {
+                @Override
+                public void run () {
+                    __logSummary ();
+                }
+            };
+
+            __timer.schedule (logTask, interval, interval);
+        }
+    }
+
+
+    private void __stop () {
+        if (logTask != null) {
+            logTask.cancel ();
+        }
+
+        try {
+            final MBeanServer server = ManagementFactory.getPlatformMBeanServer ();
+            server.unregisterMBean (new ObjectName (OBJECT_NAME + sessionId));
+
+        } catch (final JMException jme) {
+            // not registered
+        }
+    }
+
+
+    /**
+     * Logs the summary and the statistics of each request type and analysis
+     * method.
+     */
+    public void logReport () {
+        __logSummary ();
+        __logDetails ();
+    }
+
+
+    private void __logSummary () {
+        final Map <Long, Long> queueDepths = new TreeMap <Long, Long> ();
+        final Map <Long, Long> epochLags = new TreeMap <Long, Long> ();
+        __sampleExecutors (queueDepths, epochLags);
+
+        long invocations = 0;
+        for (final MethodStatistics stats : methods.values ()) {
+            invocations += stats.invocations.get ();
+        }
+
+        __log.info (
+            "session %d: %d requests (%d bytes), %d invocations, %d buffers queued, "
+            + "%d executors (max queue %d, max epoch lag %d), "
+            + "%d objects freed in %d batches (latency mean %d us, p99 %d us, max %d us)",
+            sessionId, __sum (requestCounts), getReceivedBytes (), invocations,
+            getQueuedBuffers (), queueDepths.size (), __max (queueDepths),
+            __max (epochLags), freedObjects.get (), objectFreeLatency.getCount (),
+            objectFreeLatency.getMean () / 1000,
+            objectFreeLatency.getPercentile (99) / 1000,
+            objectFreeLatency.getMax () / 1000
+        );
+    }
+
+
+    private void __logDetails () {
+        final Map <String, Long> bytes = getRequestBytes ();
+        for (final Entry <String, Long> entry : getRequestCounts ().entrySet ()) {
+            __log.info (
+                "session %d: request %s: %d messages, %d bytes",
+                sessionId, entry.getKey (), entry.getValue (), bytes.get (entry.getKey ())
+            );
+        }
+
+        for (final MethodStatistics stats : methods.values ()) {
+            final long invocations = stats.invocations.get ();
+            final long nanos = stats.nanos.get ();
+
+            __log.info (
+                "session %d: analysis %s: %d invocations, %d ms (%d ns per invocation)",
+                sessionId, stats.name, invocations, nanos / 1000000,
+                (invocations != 0) ? nanos / invocations : 0
+            );
+        }
+    }
+
+
+    private static long __sum (final AtomicLongArray values) {
+        long result = 0;
+        for (int i = 0; i < values.length (); ++i) {
+            result += values.get (i);
+        }
+
+        return result;
+    }
+
+
+    private static long __max (final Map <Long, Long> values) {
+        long result = 0;
+        for (final long value : values.values ()) {
+            result = Math.max (result, value);
+        }
+
+        return result;
+    }
+
+}
@@ -0,0 +1,45 @@
+package ch.usi.dag.dislreserver.stats;
+
+import java.util.Map;
+
+
+/**
+ * Management interface of the statistics of a session. Times are in
+ * nanoseconds, maps of requests are keyed by request name, maps of analysis
+ * methods by method id and name, maps of executors by ordering id.
+ */
+public interface StatisticsMXBean {
+
+    long getReceivedBytes ();
+
+    Map <String, Long> getRequestCounts ();
+
+    Map <String, Long> getRequestBytes ();
+
+    //
+
+    Map <String, Long> getAnalysisInvocations ();
+
+    Map <String, Long> getAnalysisTimes ();
+
+    //
+
+    int getQueuedBuffers ();
+
+    Map <Long, Long> getExecutorQueueDepths ();
+
+    Map <Long, Long> getExecutorEpochLags ();
+
+    //
+
+    long getObjectFreeBatches ();
+
+    long getFreedObjects ();
+
+    long getObjectFreeLatencyMean ();
+
+    long getObjectFreeLatencyP99 ();
+
+    long getObjectFreeLatencyMax ();
+
+}
@@ -0,0 +1,101 @@
+package ch.usi.dag.disl.test.junit;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertFalse;
+
+import java.io.BufferedReader;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.InputStreamReader;
+import java.nio.charset.StandardCharsets;
+import java.util.ArrayList;
+import java.util.List;
+
+import org.junit.Test;
+
+import ch.usi.dag.disl.scope.WildCard;
+
+/**
+ * Tests the class name patterns sent to the agent by the class filter. The
+ * patterns are the same as in the agent side test
+ * (src-disl-agent/test/classfilter_test.c), which matches them with the
+ * agent class filter.
+ */
+public class ClassFilterTest {
+
+    private static final String PATTERNS_RESOURCE = "glob-patterns.resource";
+
+    @Test
+    public void testWildCard()
+            throws IOException {
+        for (final String[] row : __patterns()) {
+            assertEquals(__describe(row), __expected(row),
+                    WildCard.match(row[2], row[1]));
+        }
+    }
+
+    @Test
+    public void testPatternKinds()
+            throws IOException {
+        //
+        // The filter sends patterns without wild cards as exact names and
+        // patterns with only a trailing wild card as prefixes, which the
+        // agent matches without the glob matcher.
+        //
+        for (final String[] row : __patterns()) {
+            final String pattern = row[1];
+            final int wildCard = pattern.indexOf(WildCard.WILDCARD_STR);
+
+            if (wildCard < 0) {
+                assertEquals(__describe(row), __expected(row),
+                        row[2].equals(pattern));
+
+            } else if (wildCard == pattern.length() - 1) {
+                assertEquals(__describe(row), __expected(row),
+                        row[2].startsWith(pattern.substring(0, wildCard)));
+            }
+        }
+    }
+
+    //
+
+    private static boolean __expected(final String[] row) {
+        return "yes".equals(row[0]);
+    }
+
+    private static String __describe(final String[] row) {
+        return String.format("pattern \"%s\", class \"%s\"", row[1], row[2]);
+    }
+
+    // same format as read by the agent side test
+    private static List<String[]> __patterns()
+            throws IOException {
+        final InputStream is = ClassFilterTest.class.getResourceAsStream(
+                PATTERNS_RESOURCE);
+        if (is == null) {
+            throw new IOException("missing resource " + PATTERNS_RESOURCE);
+        }
+
+        final List<String[]> result = new ArrayList<String[]>();
+        try (final BufferedReader reader = new BufferedReader(
+                new InputStreamReader(is, StandardCharsets.UTF_8))) {
+
+            String line;
+            while ((line = reader.readLine()) != null) {
+                if (line.isEmpty() || line.startsWith("#")) {
+                    continue;
+                }
+
+                final String[] row = line.split("\\|", -1);
+                if (row.length != 3) {
+                    throw new IOException("malformed pattern line: " + line);
+                }
+
+                result.add(row);
+            }
+        }
+
+        assertFalse("no patterns in " + PATTERNS_RESOURCE, result.isEmpty());
+        return result;
+    }
+}
@@ -0,0 +1,146 @@
+package ch.usi.dag.disl.test.junit;
+
+import static org.junit.Assert.assertArrayEquals;
+
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.DataInputStream;
+import java.io.DataOutputStream;
+import java.io.IOException;
+import java.util.Arrays;
+import java.util.Random;
+
+import org.junit.Test;
+
+import ch.usi.dag.dislreserver.DiSLREServerException;
+import ch.usi.dag.dislreserver.msg.objfree.ObjectFreeHandler;
+
+/**
+ * Tests decoding of object free messages. The expected bytes are the same
+ * as in the agent side test (src-shvm-agent/test/objfree_test.c).
+ */
+public class ObjectFreeEncodingTest {
+
+    private static final byte[] EXPECTED_BYTES = __bytes(
+        0x00, 0x00, 0x00, 0x06, 0x05, 0x02, 0xa5, 0x02, 0x00, 0xd4, 0xfd, 0xff,
+        0xff, 0xff, 0x1f, 0x00, 0x81, 0x80, 0x80, 0x80, 0x80, 0xe0, 0xff, 0xff,
+        0x7f, 0x00
+    );
+
+    private static final long[] EXPECTED_REFS = {
+        5, 6, 7, 300, 1L << 40, 0x8000000000000001L
+    };
+
+    @Test
+    public void testExpectedBytes()
+            throws IOException, DiSLREServerException {
+        assertArrayEquals(EXPECTED_REFS, __decode(EXPECTED_BYTES));
+    }
+
+    @Test
+    public void testEncoderMatchesAgent()
+            throws IOException {
+        assertArrayEquals(EXPECTED_BYTES, __encode(EXPECTED_REFS.clone()));
+    }
+
+    @Test
+    public void testRoundTrip()
+            throws IOException, DiSLREServerException {
+        final long[] refs = { 3, 1, 2, 10, 12, 11, -1, -2, Long.MIN_VALUE };
+        final long[] expected = __sortUnsigned(refs.clone());
+        assertArrayEquals(expected, __decode(__encode(refs)));
+    }
+
+    @Test
+    public void testClusteredRoundTrip()
+            throws IOException, DiSLREServerException {
+        final Random random = new Random(1);
+        final long[] refs = new long[4096];
+
+        long next = 1;
+        for (int i = 0; i < refs.length; i++) {
+            next += (random.nextInt(8) == 0) ? random.nextInt(100000) + 2 : 1;
+            refs[i] = next;
+        }
+
+        assertArrayEquals(refs.clone(), __decode(__encode(refs)));
+    }
+
+    @Test(expected = DiSLREServerException.class)
+    public void testInvalidRunLength()
+            throws IOException, DiSLREServerException {
+        // two references announced, run of three
+        __decode(__bytes(0x00, 0x00, 0x00, 0x02, 0x01, 0x02));
+    }
+
+    //
+
+    private static long[] __decode(final byte[] bytes)
+            throws IOException, DiSLREServerException {
+        return ObjectFreeHandler.readFreedReferences(
+                new DataInputStream(new ByteArrayInputStream(bytes)));
+    }
+
+    // same as messager_objfree_tags() in the agent
+    private static byte[] __encode(final long[] refs)
+            throws IOException {
+        __sortUnsigned(refs);
+
+        final ByteArrayOutputStream result = new ByteArrayOutputStream();
+        final DataOutputStream dos = new DataOutputStream(result);
+        dos.writeInt(refs.length);
+
+        long last = 0;
+        int i = 0;
+        while (i < refs.length) {
+            final long first = refs[i];
+            int runLength = 0;
+            while (i + runLength + 1 < refs.length
+                    && refs[i + runLength + 1] == first + runLength + 1) {
+                runLength++;
+            }
+
+            __writeVarLong(dos, first - last);
+            __writeVarLong(dos, runLength);
+
+            last = first + runLength;
+            i += runLength + 1;
+        }
+
+        dos.flush();
+        return result.toByteArray();
+    }
+
+    private static void __writeVarLong(final DataOutputStream dos, long value)
+            throws IOException {
+        do {
+            final int group = (int) (value & 0x7F);
+            value >>>= 7;
+            dos.writeByte((value != 0) ? (group | 0x80) : group);
+        } while (value != 0);
+    }
+
+    private static long[] __sortUnsigned(final long[] refs) {
+        // flipping the sign bit maps unsigned order to signed order
+        for (int i = 0; i < refs.length; i++) {
+            refs[i] ^= Long.MIN_VALUE;
+        }
+
+        Arrays.sort(refs);
+
+        for (int i = 0; i < refs.length; i++) {
+            refs[i] ^= Long.MIN_VALUE;
+        }
+
+        return refs;
+    }
+
+    private static byte[] __bytes(final int... values) {
+        final byte[] result = new byte[values.length];
+        for (int i = 0; i < values.length; i++) {
+            result[i] = (byte) values[i];
+        }
+
+        return result;
+    }
+}
@@ -0,0 +1,131 @@
+package ch.usi.dag.disl.test.junit;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertNull;
+import static org.junit.Assert.assertTrue;
+
+import java.util.Queue;
+import java.util.concurrent.ConcurrentLinkedQueue;
+import java.util.concurrent.atomic.AtomicInteger;
+
+import org.junit.Test;
+
+import ch.usi.dag.dislreserver.DiSLREServerException;
+import ch.usi.dag.dislreserver.msg.analyze.AnalysisResolver;
+import ch.usi.dag.dislreserver.msg.analyze.mtdispatch.AnalysisDispatcher;
+import ch.usi.dag.dislreserver.remoteanalysis.RemoteAnalysis;
+import ch.usi.dag.dislreserver.shadow.ShadowClass;
+import ch.usi.dag.dislreserver.shadow.ShadowClassTable;
+import ch.usi.dag.dislreserver.shadow.ShadowObject;
+import ch.usi.dag.dislreserver.shadow.ShadowObjectTable;
+
+/**
+ * Tests that a class object freed in the same batch as instances of the
+ * class is freed after them, also if the batch is split among several
+ * object free threads, and that objects the server has never seen are not
+ * reported as freed.
+ */
+public class ObjectFreeOrderTest {
+
+    private static final String PROP_FREE_THREADS = "dislreserver.freeThreads";
+
+    private static final int FREE_THREADS = 4;
+
+    private static final int INSTANCES = 20000;
+
+    private static final int CLASS_ID = 7;
+
+    // default net reference layout - class bit, 22 bits class id, object id
+    private static final long CLASS_BIT = 1L << 62;
+    private static final int CLASS_ID_POS = 40;
+
+    /**
+     * Checks that the class of each freed instance is still registered.
+     */
+    public static final class Recorder extends RemoteAnalysis {
+
+        final AtomicInteger freedInstances = new AtomicInteger();
+
+        final AtomicInteger freedClasses = new AtomicInteger();
+
+        // instances freed before the class object
+        volatile int instancesBeforeClass = -1;
+
+        final Queue<String> errors = new ConcurrentLinkedQueue<String>();
+
+        public void event() {
+            // only registered to create the analysis
+        }
+
+        @Override
+        public void objectFree(final ShadowObject obj) {
+            if (obj instanceof ShadowClass) {
+                instancesBeforeClass = freedInstances.get();
+                freedClasses.incrementAndGet();
+                return;
+            }
+
+            try {
+                if (ShadowClassTable.get(CLASS_ID) != obj.getShadowClass()) {
+                    errors.add("class of object " + obj.getId() + " replaced");
+                }
+
+            } catch (final RuntimeException e) {
+                errors.add("class of object " + obj.getId() + ": " + e);
+            }
+
+            freedInstances.incrementAndGet();
+        }
+
+        @Override
+        public void atExit() {
+            // nothing to report
+        }
+    }
+
+    @Test
+    public void testClassFreedAfterInstances()
+            throws DiSLREServerException {
+        AnalysisResolver.registerMethodId((short) 1,
+                Recorder.class.getName() + ".event");
+        final Recorder recorder =
+                (Recorder) AnalysisResolver.getAllAnalyses().iterator().next();
+
+        final long classRef = CLASS_BIT | ((long) CLASS_ID << CLASS_ID_POS) | 1;
+        ShadowClassTable.newInstance(classRef, null, null, "[I", null, false);
+
+        // the class object comes first in the batch, an unknown object last
+        final long[] batch = new long[INSTANCES + 2];
+        batch[0] = classRef;
+        for (int i = 1; i <= INSTANCES; i++) {
+            batch[i] = ((long) CLASS_ID << CLASS_ID_POS) | (i + 1);
+            ShadowObjectTable.get(batch[i]);
+        }
+
+        final long unknownRef =
+                ((long) CLASS_ID << CLASS_ID_POS) | (INSTANCES + 2);
+        batch[INSTANCES + 1] = unknownRef;
+
+        final String freeThreads = System.getProperty(PROP_FREE_THREADS);
+        System.setProperty(PROP_FREE_THREADS, String.valueOf(FREE_THREADS));
+
+        try {
+            final AnalysisDispatcher dispatcher = new AnalysisDispatcher();
+            dispatcher.objectsFreedEvent(batch);
+            dispatcher.exit();
+
+        } finally {
+            if (freeThreads != null) {
+                System.setProperty(PROP_FREE_THREADS, freeThreads);
+            } else {
+                System.clearProperty(PROP_FREE_THREADS);
+            }
+        }
+
+        assertTrue(recorder.errors.toString(), recorder.errors.isEmpty());
+        assertEquals(INSTANCES, recorder.freedInstances.get());
+        assertEquals(1, recorder.freedClasses.get());
+        assertEquals(INSTANCES, recorder.instancesBeforeClass);
+        assertNull(ShadowObjectTable.lookup(unknownRef));
+    }
+}
@@ -0,0 +1,27 @@
+package ch.usi.dag.disl.test.suite.threadend.app;
+
+public class TargetClass {
+
+    // more threads than credits granted by the shadow VM (256 by default)
+    protected static final int THREAD_COUNT = 1000;
+
+    public static class Worker implements Runnable {
+
+        @Override
+        public void run () {
+            // the instrumentation sends one event per thread
+        }
+
+    }
+
+    public static void main (final String [] args) throws InterruptedException {
+        for (int i = 0; i < THREAD_COUNT; ++i) {
+            final Thread thread = new Thread (new Worker ());
+            thread.start ();
+            thread.join ();
+        }
+
+        System.out.println ("Ended " + THREAD_COUNT + " threads");
+    }
+
+}
@@ -0,0 +1,13 @@
+package ch.usi.dag.disl.test.suite.threadend.instr;
+
+import ch.usi.dag.disl.annotation.Before;
+import ch.usi.dag.disl.marker.BodyMarker;
+
+public class DiSLClass {
+
+    @Before (marker = BodyMarker.class, scope = "*Worker.run")
+    public static void threadEvent () {
+        ThreadEndAnalysisRE.threadEvent ();
+    }
+
+}
@@ -0,0 +1,39 @@
+package ch.usi.dag.disl.test.suite.threadend.instr;
+
+import ch.usi.dag.dislreserver.remoteanalysis.ThreadConfinedAnalysis;
+import ch.usi.dag.dislreserver.shadow.ShadowObject;
+
+// Each application thread has its own instance, merged when the thread end
+// message arrives. The thread end messages must not use up the credits of
+// the agent, otherwise the agent stops sending after the credit window.
+public class ThreadEndAnalysis extends ThreadConfinedAnalysis <ThreadEndAnalysis> {
+
+    long events = 0;
+
+    long mergedInstances = 0;
+
+
+    public void threadEvent () {
+        events++;
+    }
+
+
+    @Override
+    public void merge (final ThreadEndAnalysis other) {
+        events += other.events;
+        mergedInstances += other.mergedInstances + 1;
+    }
+
+
+    @Override
+    public void atExit () {
+        System.out.println ("Total number of events: " + events);
+        System.out.println ("Total number of merged instances: " + mergedInstances);
+    }
+
+
+    @Override
+    public void objectFree (final ShadowObject netRef) {
+    }
+
+}
@@ -0,0 +1,16 @@
+package ch.usi.dag.disl.test.suite.threadend.instr;
+
+import ch.usi.dag.dislre.REDispatch;
+
+public class ThreadEndAnalysisRE {
+
+    private static short teId = REDispatch.registerMethod (
+        "ch.usi.dag.disl.test.suite.threadend.instr.ThreadEndAnalysis.threadEvent"
+    );
+
+    public static void threadEvent () {
+        REDispatch.analysisStart (teId);
+        REDispatch.analysisEnd ();
+    }
+
+}
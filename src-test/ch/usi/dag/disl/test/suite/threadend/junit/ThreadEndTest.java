@@ -0,0 +1,12 @@
+package ch.usi.dag.disl.test.suite.threadend.junit;
+
+import org.junit.runner.RunWith;
+import org.junit.runners.JUnit4;
+
+import ch.usi.dag.disl.test.suite.ShadowVmTest;
+
+
+@RunWith (JUnit4.class)
+public class ThreadEndTest extends ShadowVmTest {
+
+}
@@ -0,0 +1,256 @@
+package ch.usi.dag.dislreserver.shadow;
+
+import static org.junit.Assert.assertArrayEquals;
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertNotEquals;
+import static org.junit.Assert.assertNull;
+import static org.junit.Assert.assertTrue;
+
+import java.io.DataInput;
+import java.io.DataOutput;
+import java.io.File;
+import java.io.IOException;
+import java.util.LinkedHashMap;
+import java.util.Map;
+
+import org.junit.After;
+import org.junit.Before;
+import org.junit.Test;
+
+import ch.usi.dag.dislreserver.DiSLREServerFatalException;
+
+/**
+ * Tests the off-heap store of spilled shadow object states. The store uses
+ * small segments, so that the tests fill them with a few records.
+ */
+public class ShadowSpillStoreTest {
+
+    private static final int SEGMENT_BITS = 12;
+    private static final int SEGMENT_SIZE = 1 << SEGMENT_BITS;
+
+    // payload of a record taking a quarter of a segment
+    private static final int QUARTER = 900;
+
+    private static final ShadowStateSlot<byte[]> BYTES = ShadowStateSlot.allocate(
+            byte[].class, new ShadowStateCodec<byte[]>() {
+                @Override
+                public void encode(final byte[] state, final DataOutput out)
+                        throws IOException {
+                    out.writeInt(state.length);
+                    out.write(state);
+                }
+
+                @Override
+                public byte[] decode(final DataInput in) throws IOException {
+                    final byte[] result = new byte[in.readInt()];
+                    in.readFully(result);
+                    return result;
+                }
+            });
+
+    private static final ShadowStateSlot<Long> LONG = ShadowStateSlot.allocate(
+            Long.class, new ShadowStateCodec<Long>() {
+                @Override
+                public void encode(final Long state, final DataOutput out)
+                        throws IOException {
+                    out.writeLong(state);
+                }
+
+                @Override
+                public Long decode(final DataInput in) throws IOException {
+                    return in.readLong();
+                }
+            });
+
+    private static final ShadowStateSlot<Object> OPAQUE =
+            ShadowStateSlot.allocate(Object.class);
+
+    //
+
+    private File file;
+
+    private ShadowSpillStore store;
+
+    // payloads of the records not yet released, keyed by handle
+    private final Map<Long, byte[]> live = new LinkedHashMap<Long, byte[]>();
+
+    private long nextNetRef = 1;
+
+    @Before
+    public void setUp()
+            throws IOException {
+        file = File.createTempFile("shadow-spill", ".bin");
+        store = ShadowSpillStore.open(file, SEGMENT_BITS);
+    }
+
+    @After
+    public void tearDown() {
+        store.close();
+        file.delete();
+    }
+
+    //
+
+    @Test
+    public void testRoundTrip() {
+        final Object[] states = new Object[ShadowStateSlot.count()];
+        states[BYTES.index] = __payload(QUARTER, 1);
+        states[LONG.index] = 42L;
+
+        final long handle = store.spill(7, states);
+        assertNotEquals(0, handle);
+
+        // the record stays in the store until it is released
+        for (int i = 0; i < 2; i++) {
+            final Object[] restored = store.restore(handle, 7);
+            assertArrayEquals((byte[]) states[BYTES.index],
+                    (byte[]) restored[BYTES.index]);
+            assertEquals(42L, restored[LONG.index]);
+            assertNull(restored[OPAQUE.index]);
+        }
+    }
+
+    @Test
+    public void testStateWithoutCodec() {
+        final Object[] states = new Object[ShadowStateSlot.count()];
+        states[LONG.index] = 42L;
+        states[OPAQUE.index] = new Object();
+
+        assertEquals(0, store.spill(7, states));
+    }
+
+    @Test(expected = DiSLREServerFatalException.class)
+    public void testRestoreOtherObject() {
+        final long handle = __spill(QUARTER);
+        store.restore(handle, 0);
+    }
+
+    @Test
+    public void testReleasedRecordReused() {
+        final long first = __spill(QUARTER);
+        final long second = __spill(QUARTER);
+        __release(first);
+
+        // a record of the same size class takes the released space
+        final long reused = __spill(QUARTER - 300);
+        assertEquals(first, reused);
+
+        // a record of another size class does not
+        __release(reused);
+        final long small = __spill(10);
+        assertNotEquals(reused, small);
+        assertNotEquals(second, small);
+
+        __checkLive();
+    }
+
+    @Test
+    public void testReleaseOnAppendSegment() {
+        final long first = __spill(QUARTER);
+        final long second = __spill(QUARTER);
+
+        // the segment receiving new records stays mapped when it is empty
+        __release(first);
+        __release(second);
+        assertEquals(1, store.mappedSegments());
+
+        final long reused = __spill(QUARTER);
+        assertTrue(reused == first || reused == second);
+
+        // the rest of the segment is still used for new records
+        __spill(QUARTER);
+        __spill(QUARTER);
+        assertEquals(1, store.mappedSegments());
+        assertEquals(SEGMENT_SIZE, file.length());
+
+        __checkLive();
+    }
+
+    @Test
+    public void testSegmentUnmappedAndRemapped() {
+        final long[] full = new long[4];
+        for (int i = 0; i < full.length; i++) {
+            full[i] = __spill(QUARTER);
+            assertEquals(0, __segment(full[i]));
+        }
+
+        // the next record starts a new segment
+        assertEquals(1, __segment(__spill(QUARTER)));
+        assertEquals(2, store.mappedSegments());
+        assertEquals(2 * SEGMENT_SIZE, file.length());
+
+        // releasing all records of the full segment unmaps it
+        for (final long handle : full) {
+            __release(handle);
+        }
+
+        assertEquals(1, store.mappedSegments());
+        __checkLive();
+
+        // the space of the unmapped segment is not reused by records
+        for (int i = 0; i < 3; i++) {
+            assertEquals(1, __segment(__spill(QUARTER)));
+        }
+
+        // the unmapped segment is mapped again before the file grows
+        final long remapped = __spill(QUARTER);
+        assertEquals(0, __segment(remapped));
+        assertEquals(2, store.mappedSegments());
+        assertEquals(2 * SEGMENT_SIZE, file.length());
+
+        __checkLive();
+    }
+
+    //
+
+    private long __spill(final int length) {
+        final long netRef = nextNetRef++;
+        final byte[] payload = __payload(length, (int) netRef);
+
+        final Object[] states = new Object[ShadowStateSlot.count()];
+        states[BYTES.index] = payload;
+        states[LONG.index] = netRef;
+
+        final long handle = store.spill(netRef, states);
+        assertNotEquals(0, handle);
+
+        live.put(handle, payload);
+        return handle;
+    }
+
+    private void __release(final long handle) {
+        store.release(handle);
+        live.remove(handle);
+    }
+
+    // every record not yet released still holds its own states
+    private void __checkLive() {
+        for (final Map.Entry<Long, byte[]> entry : live.entrySet()) {
+            final byte[] payload = entry.getValue();
+            final long netRef = __netRef(payload);
+
+            final Object[] restored = store.restore(entry.getKey(), netRef);
+            assertArrayEquals(payload, (byte[]) restored[BYTES.index]);
+            assertEquals(netRef, restored[LONG.index]);
+        }
+    }
+
+    private static long __segment(final long handle) {
+        return (handle - 1) >>> SEGMENT_BITS;
+    }
+
+    // the first byte holds the seed, which is the net reference
+    private static byte[] __payload(final int length, final int seed) {
+        final byte[] result = new byte[length];
+        result[0] = (byte) seed;
+        for (int i = 1; i < length; i++) {
+            result[i] = (byte) (seed * 31 + i);
+        }
+
+        return result;
+    }
+
+    private static long __netRef(final byte[] payload) {
+        return payload[0] & 0xFF;
+    }
+}